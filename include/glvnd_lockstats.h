@@ -0,0 +1,247 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#ifndef __GLVND_LOCKSTATS_H__
+#define __GLVND_LOCKSTATS_H__
+
+#include <stdint.h>
+#include <time.h>
+
+#include "glvnd_pthread.h"
+
+/*
+ * Optional lock contention statistics.
+ *
+ * If the __GL_LOCK_STATS environment variable is set to a non-zero value, then
+ * libGLdispatch and libGLX record how long threads wait for each of their
+ * locks, and how long each lock is held for. The statistics can be queried
+ * with __glDispatchGetLockStats(), and are printed to stderr at exit.
+ *
+ * When the statistics are disabled, the only cost is a check of
+ * glvndLockStatsEnabled before each lock operation.
+ */
+
+/*
+ * The number of histogram buckets. Bucket i counts the times that were at
+ * least 2^i ns but less than 2^(i+1) ns, except that bucket 0 also counts
+ * zero-length times and the last bucket also counts anything longer.
+ */
+#define GLVND_LOCK_STATS_NUM_BUCKETS 32
+
+typedef struct GLVNDlockStatsRec {
+    /* A human-readable name for the lock. */
+    const char *name;
+
+    /*
+     * The number of times that the lock was taken, and how many of those had
+     * to wait for another thread to release it.
+     */
+    uint64_t numAcquires;
+    uint64_t numContended;
+
+    /* Time spent waiting to take the lock, in nanoseconds. */
+    uint64_t totalWaitTime;
+    uint64_t maxWaitTime;
+    uint64_t waitHistogram[GLVND_LOCK_STATS_NUM_BUCKETS];
+
+    /*
+     * Time that the lock was held for, in nanoseconds. For a reader/writer
+     * lock, this only counts the times that it was held for writing.
+     */
+    uint64_t numHolds;
+    uint64_t totalHoldTime;
+    uint64_t maxHoldTime;
+    uint64_t holdHistogram[GLVND_LOCK_STATS_NUM_BUCKETS];
+
+    /* Private bookkeeping, not meaningful to callers. */
+    uint64_t holdStart;
+    int exclusiveHeld;
+    int registered;
+    struct GLVNDlockStatsRec *next;
+} GLVNDlockStats;
+
+/*
+ * Set if lock statistics are enabled. Each library that records lock
+ * statistics has its own copy of this flag.
+ */
+extern int glvndLockStatsEnabled;
+
+static inline uint64_t glvndLockStatsGetTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static inline int glvndLockStatsBucket(uint64_t time)
+{
+    int bucket;
+
+    if (time == 0) {
+        return 0;
+    }
+    bucket = 63 - __builtin_clzll(time);
+    if (bucket >= GLVND_LOCK_STATS_NUM_BUCKETS) {
+        bucket = GLVND_LOCK_STATS_NUM_BUCKETS - 1;
+    }
+    return bucket;
+}
+
+static inline void glvndLockStatsUpdateMax(uint64_t *max, uint64_t time)
+{
+    uint64_t old = *max;
+
+    while (time > old) {
+        uint64_t prev = __sync_val_compare_and_swap(max, old, time);
+        if (prev == old) {
+            break;
+        }
+        old = prev;
+    }
+}
+
+/*
+ * Records a single lock acquisition. Readers of a reader/writer lock can get
+ * here concurrently, so everything is updated atomically.
+ */
+static inline void glvndLockStatsAddWait(GLVNDlockStats *stats,
+                                         int contended, uint64_t time)
+{
+    __sync_fetch_and_add(&stats->numAcquires, 1);
+    __sync_fetch_and_add(&stats->waitHistogram[glvndLockStatsBucket(time)], 1);
+    if (contended) {
+        __sync_fetch_and_add(&stats->numContended, 1);
+        __sync_fetch_and_add(&stats->totalWaitTime, time);
+        glvndLockStatsUpdateMax(&stats->maxWaitTime, time);
+    }
+}
+
+/*
+ * Hold times are only tracked while the lock is held exclusively, so these
+ * don't need atomics.
+ */
+static inline void glvndLockStatsBeginHold(GLVNDlockStats *stats)
+{
+    stats->holdStart = glvndLockStatsGetTime();
+    stats->exclusiveHeld = 1;
+}
+
+static inline void glvndLockStatsEndHold(GLVNDlockStats *stats)
+{
+    uint64_t time;
+
+    if (!stats->exclusiveHeld) {
+        return;
+    }
+    stats->exclusiveHeld = 0;
+
+    time = glvndLockStatsGetTime() - stats->holdStart;
+    stats->numHolds++;
+    stats->totalHoldTime += time;
+    stats->holdHistogram[glvndLockStatsBucket(time)]++;
+    if (time > stats->maxHoldTime) {
+        stats->maxHoldTime = time;
+    }
+}
+
+/*
+ * Wrappers around the GLVNDPthreadFuncs locking functions which record
+ * statistics. Each one first tries to take the lock without blocking, so that
+ * an uncontended lock doesn't need to read the clock to find its wait time.
+ */
+static inline void glvndLockStatsMutexLock(GLVNDPthreadFuncs *imp,
+                                           glvnd_mutex_t *mutex,
+                                           GLVNDlockStats *stats)
+{
+    uint64_t start;
+
+    if (imp->mutex_trylock(mutex) == 0) {
+        glvndLockStatsAddWait(stats, 0, 0);
+    } else {
+        start = glvndLockStatsGetTime();
+        imp->mutex_lock(mutex);
+        glvndLockStatsAddWait(stats, 1, glvndLockStatsGetTime() - start);
+    }
+    glvndLockStatsBeginHold(stats);
+}
+
+static inline void glvndLockStatsMutexUnlock(GLVNDPthreadFuncs *imp,
+                                             glvnd_mutex_t *mutex,
+                                             GLVNDlockStats *stats)
+{
+    glvndLockStatsEndHold(stats);
+    imp->mutex_unlock(mutex);
+}
+
+static inline void glvndLockStatsRdLock(GLVNDPthreadFuncs *imp,
+                                        glvnd_rwlock_t *rwlock,
+                                        GLVNDlockStats *stats)
+{
+    uint64_t start;
+
+    if (imp->rwlock_tryrdlock(rwlock) == 0) {
+        glvndLockStatsAddWait(stats, 0, 0);
+    } else {
+        start = glvndLockStatsGetTime();
+        imp->rwlock_rdlock(rwlock);
+        glvndLockStatsAddWait(stats, 1, glvndLockStatsGetTime() - start);
+    }
+}
+
+static inline void glvndLockStatsWrLock(GLVNDPthreadFuncs *imp,
+                                        glvnd_rwlock_t *rwlock,
+                                        GLVNDlockStats *stats)
+{
+    uint64_t start;
+
+    if (imp->rwlock_trywrlock(rwlock) == 0) {
+        glvndLockStatsAddWait(stats, 0, 0);
+    } else {
+        start = glvndLockStatsGetTime();
+        imp->rwlock_wrlock(rwlock);
+        glvndLockStatsAddWait(stats, 1, glvndLockStatsGetTime() - start);
+    }
+    glvndLockStatsBeginHold(stats);
+}
+
+/*
+ * A reader can't hold the lock at the same time as a writer, so if
+ * exclusiveHeld is set, then the caller must be the writer.
+ */
+static inline void glvndLockStatsRwUnlock(GLVNDPthreadFuncs *imp,
+                                          glvnd_rwlock_t *rwlock,
+                                          GLVNDlockStats *stats)
+{
+    glvndLockStatsEndHold(stats);
+    imp->rwlock_unlock(rwlock);
+}
+
+#endif
@@ -3,6 +3,7 @@
 
 // This is intended to be used in conjunction with uthash and libglvnd_pthread.
 #include "glvnd_pthread.h"
+#include "glvnd_lockstats.h"
 #include "uthash.h"
 
 /*
@@ -12,28 +13,53 @@
     struct {                                              \
         _hashtype *hash;                                  \
         glvnd_rwlock_t lock;                              \
+        GLVNDlockStats stats;                             \
     } _hashname
 
 #define DEFINE_INITIALIZED_LKDHASH(_hashtype, _hashname)  \
     struct {                                              \
         _hashtype *hash;                                  \
         glvnd_rwlock_t lock;                              \
-    } _hashname = { NULL, GLVND_RWLOCK_INITIALIZER }
+        GLVNDlockStats stats;                             \
+    } _hashname = { NULL, GLVND_RWLOCK_INITIALIZER, { #_hashname } }
 
 #define LKDHASH_INIT(imp, _lockedhash) do {               \
     (_lockedhash).hash = NULL;                            \
     (imp).rwlock_init(&(_lockedhash).lock, NULL);         \
+    (_lockedhash).stats =                                 \
+        (GLVNDlockStats) { #_lockedhash };                \
 } while (0)
 
 /*
- * Macros for locking/unlocking the locked hash.
+ * Macros for locking/unlocking the locked hash. If lock statistics are
+ * enabled, then these also record the wait and hold times in the hash's
+ * stats, which the caller is responsible for registering with
+ * __glDispatchRegisterLockStats().
  */
-#define LKDHASH_RDLOCK(imp, _lockedhash) \
-    (imp).rwlock_rdlock(&(_lockedhash).lock)
-#define LKDHASH_WRLOCK(imp, _lockedhash) \
-    (imp).rwlock_wrlock(&(_lockedhash).lock)
-#define LKDHASH_UNLOCK(imp, _lockedhash) \
-    (imp).rwlock_unlock(&(_lockedhash).lock)
+#define LKDHASH_RDLOCK(imp, _lockedhash) do {             \
+    if (glvndLockStatsEnabled) {                          \
+        glvndLockStatsRdLock(&(imp), &(_lockedhash).lock, \
+                             &(_lockedhash).stats);       \
+    } else {                                              \
+        (imp).rwlock_rdlock(&(_lockedhash).lock);         \
+    }                                                     \
+} while (0)
+#define LKDHASH_WRLOCK(imp, _lockedhash) do {             \
+    if (glvndLockStatsEnabled) {                          \
+        glvndLockStatsWrLock(&(imp), &(_lockedhash).lock, \
+                             &(_lockedhash).stats);       \
+    } else {                                              \
+        (imp).rwlock_wrlock(&(_lockedhash).lock);         \
+    }                                                     \
+} while (0)
+#define LKDHASH_UNLOCK(imp, _lockedhash) do {               \
+    if (glvndLockStatsEnabled) {                            \
+        glvndLockStatsRwUnlock(&(imp), &(_lockedhash).lock, \
+                               &(_lockedhash).stats);       \
+    } else {                                                \
+        (imp).rwlock_unlock(&(_lockedhash).lock);           \
+    }                                                       \
+} while (0)
 
 /*
  * Converts a locked hash into a hash suitable for use with uthash.
@@ -31,6 +31,8 @@
 #include <X11/Xlibint.h>
 #include <X11/Xproto.h>
 #include <dlfcn.h>
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 
 #include "libglxthread.h"
@@ -154,6 +156,12 @@ PUBLIC Bool glXIsDirect(Display *dpy, GLXContext context)
     return pDispatch->glx14ep.isDirect(dpy, context);
 }
 
+/*
+ * Set in __glXInit() if libGLdispatch is recording lock statistics. This is
+ * checked by the LKDHASH lock macros.
+ */
+int glvndLockStatsEnabled;
+
 static DEFINE_INITIALIZED_LKDHASH(__GLXAPIState, __glXAPIStateHash);
 
 /* NOTE this assumes the __glXAPIStateHash lock is taken! */
@@ -926,6 +934,14 @@ PUBLIC __GLXextFuncPtr glXGetProcAddress(const GLubyte *procName)
     addr = __glDispatchGetProcAddress((const char *)procName);
     assert(addr || procName[0] != 'g' || procName[1] != 'l');
 
+    /*
+     * Don't cache the shared no-op that GLdispatch hands out for names that no
+     * vendor recognizes, since a vendor that's loaded later might.
+     */
+    if (addr == (__GLXextFuncPtr)__glDispatchGetNoopProc()) {
+        return addr;
+    }
+
     /* Store the resulting proc address. */
 done:
     if (addr) {
@@ -936,15 +952,94 @@ done:
 }
 
 
+/*
+ * Set in __glXInit() if the __GLX_STARTUP_STATS environment variable is set.
+ */
+int __glXStartupStatsEnabled;
+__GLXstartupStats __glXStartupStats;
+
+static void PrintStartupStats(void)
+{
+    const __GLXstartupStats *stats = &__glXStartupStats;
+    __GLdispatchTableStats *tableStats;
+    int count, i;
+
+    fprintf(stderr, "libGLX startup times:\n");
+    fprintf(stderr, "%12s %8s  %s\n", "ns", "count", "phase");
+    fprintf(stderr, "%12llu %8d  %s\n", (unsigned long long)stats->initTime,
+            1, "__glXInit");
+    fprintf(stderr, "%12llu %8d  %s\n",
+            (unsigned long long)stats->setupPthreadsTime, 1,
+            "glvndSetupPthreads");
+    fprintf(stderr, "%12llu %8d  %s\n",
+            (unsigned long long)stats->dispatchInitTime, 1,
+            "__glDispatchInit");
+    fprintf(stderr, "%12llu %8d  %s\n",
+            (unsigned long long)stats->vendorLoadTime, stats->numVendors,
+            "vendor dlopen");
+    fprintf(stderr, "%12llu %8d  %s\n",
+            (unsigned long long)stats->vendorMainTime, stats->numVendors,
+            "vendor __glx_Main");
+    fprintf(stderr, "%12llu %8d  %s\n",
+            (unsigned long long)stats->screenQueryTime,
+            stats->numScreenQueries, "XGLVQueryScreenVendorMapping");
+    fprintf(stderr, "%12llu %8d  %s\n",
+            (unsigned long long)stats->xidQueryTime, stats->numXIDQueries,
+            "XGLVQueryXIDScreenMapping");
+
+    // Building a GL dispatch table is deferred to the first make current, so
+    // it's reported separately for each table.
+    count = __glDispatchGetStats(NULL, 0);
+    tableStats = malloc(count * sizeof(__GLdispatchTableStats));
+    if (!tableStats) {
+        return;
+    }
+    count = __glDispatchGetStats(tableStats, count);
+    for (i = 0; i < count; i++) {
+        if (tableStats[i].buildTime) {
+            fprintf(stderr, "%12llu %8d  CreateGLAPITable (table %p)\n",
+                    (unsigned long long)tableStats[i].buildTime, 1,
+                    tableStats[i].table);
+        }
+    }
+    free(tableStats);
+}
+
 void __attribute__ ((constructor)) __glXInit(void)
 {
+    const char *startupStatsStr = getenv("__GLX_STARTUP_STATS");
+    uint64_t start = 0, phaseStart = 0;
+
+    if (startupStatsStr && atoi(startupStatsStr)) {
+        __glXStartupStatsEnabled = 1;
+        start = phaseStart = glvndLockStatsGetTime();
+    }
 
     /* Initialize pthreads imports */
     glvndSetupPthreads(RTLD_DEFAULT, &__glXPthreadFuncs);
 
+    if (__glXStartupStatsEnabled) {
+        uint64_t now = glvndLockStatsGetTime();
+        __glXStartupStats.setupPthreadsTime = now - phaseStart;
+        phaseStart = now;
+    }
+
     /* Initialize GLdispatch */
     __glDispatchInit(&__glXPthreadFuncs);
 
+    if (__glXStartupStatsEnabled) {
+        __glXStartupStats.dispatchInitTime =
+            glvndLockStatsGetTime() - phaseStart;
+    }
+
+    /* Record lock statistics for our hash tables if GLdispatch does */
+    if (__glDispatchLockStatsEnabled()) {
+        glvndLockStatsEnabled = 1;
+        __glDispatchRegisterLockStats(&__glXAPIStateHash.stats);
+        __glDispatchRegisterLockStats(&__glXProcAddressHash.stats);
+        __glXRegisterMappingLockStats();
+    }
+
     {
         /*
          * Check if we need to pre-load any vendors specified via environment
@@ -957,6 +1052,11 @@ void __attribute__ ((constructor)) __glXInit(void)
         }
     }
 
+    if (__glXStartupStatsEnabled) {
+        __glXStartupStats.initTime = glvndLockStatsGetTime() - start;
+        atexit(PrintStartupStats);
+    }
+
     DBG_PRINTF(0, "Loading GLX...\n");
 
 }
@@ -964,6 +1064,16 @@ void __attribute__ ((constructor)) __glXInit(void)
 void __attribute__ ((destructor)) __glXFini(void)
 {
     // TODO teardown code here
+
+    /*
+     * GLdispatch might outlive us, so make sure it doesn't look at our lock
+     * statistics after we're unloaded.
+     */
+    if (glvndLockStatsEnabled) {
+        __glDispatchUnregisterLockStats(&__glXAPIStateHash.stats);
+        __glDispatchUnregisterLockStats(&__glXProcAddressHash.stats);
+        __glXUnregisterMappingLockStats();
+    }
 }
 
 __GLXdispatchTableDynamic *__glXGetCurrentDynDispatch(void)
@@ -68,6 +68,13 @@
  */
 typedef struct __GLXdispatchTableDynamicRec __GLXdispatchTableDynamic;
 
+/*!
+ * A vendor library callback which returns a prebuilt core GL dispatch table.
+ * See __GLXapiExports::setStaticGLDispatch().
+ */
+typedef const __GLXextFuncPtr *(*__GLXgetStaticDispatchCallback)(void *data,
+                                                                 int *count);
+
 /*!
  * This opaque structure describes the core GL dispatch table.
  */
@@ -142,10 +149,9 @@ typedef struct __GLXapiExportsRec {
      * vendor-specific callbacks and data. This data will be passed to the
      * getProcAddress callback during dispatch table construction and can be
      * used to discriminate between different flavors of entrypoints in the
-     * vendor.
-     * XXX: is the getProcAddress callback method too slow? Should we have
-     * a way for vendor libraries to declare fixed tables at startup that
-     * can be read quickly?
+     * vendor. If the vendor registered a getStaticDispatch callback with
+     * setStaticGLDispatch(), it is also passed this data, and can return a
+     * prebuilt table instead.
      */
     __GLXcoreDispatchTable   *(*createGLDispatch)(
         const __GLXvendorCallbacks *cb,
@@ -184,6 +190,84 @@ typedef struct __GLXapiExportsRec {
      */
     GLboolean (*destroyGLDispatch)(__GLXcoreDispatchTable *table);
 
+    /************************************************************************
+     * Newer exports. These must always be added at the end of this
+     * structure, so that the members above stay at the offsets that existing
+     * vendor libraries were built against.
+     ************************************************************************/
+
+    /*!
+     * This creates an auxiliary core GL dispatch table which is a copy of
+     * the base table, with the count entries at the given offsets replaced by
+     * the given functions. This is much cheaper than createGLDispatch() for a
+     * table which only differs from an existing one in a few entries.
+     *
+     * The overrides stay in place when libGLX fills in new GL extension
+     * functions. Any other functions are looked up using the base table's
+     * callbacks and data, so the base table must not be destroyed before the
+     * new one. Returns NULL on failure.
+     */
+    __GLXcoreDispatchTable   *(*createGLDispatchOverlay)(
+        __GLXcoreDispatchTable *base,
+        const GLint *offsets,
+        const __GLXextFuncPtr *procs,
+        int count
+    );
+
+    /*!
+     * This prepares the given GL dispatch table to be installed with
+     * swapGLDispatch(). libGLX keeps a validated table up to date until it is
+     * destroyed. Returns GL_FALSE on failure.
+     */
+    GLboolean (*validateGLDispatch)(__GLXcoreDispatchTable *table);
+
+    /*!
+     * This is a much cheaper version of makeGLDispatchCurrent() for tables
+     * which have been passed to validateGLDispatch(). It only replaces the
+     * current thread's GL dispatch table, which makes it cheap enough to call
+     * on GL state changes. Like makeGLDispatchCurrent(), this is only valid
+     * when there is a GL context owned by the vendor which is current, and
+     * the table stays current until the next make current.
+     */
+    void (*swapGLDispatch)(__GLXcoreDispatchTable *table);
+
+    /*!
+     * This sets the entries at offsets[0] through offsets[count - 1] in the
+     * GL dispatch table to the corresponding function addresses in addrs.
+     * This is much faster than calling setGLDispatchEntry() for each entry.
+     * Another thread using the table will see each entry either before or
+     * after it's updated, but may see some entries updated and others not.
+     */
+    void (*setGLDispatchEntries)(__GLXcoreDispatchTable *table,
+                                 const GLint *offsets,
+                                 const __GLXextFuncPtr *addrs,
+                                 int count);
+
+    /*!
+     * This registers an optional callback which retrieves a prebuilt core GL
+     * dispatch table from the vendor library, which is much faster to install
+     * than calling getProcAddress for every GL function. A vendor library
+     * which wants to use this must call it from __glx_Main(), and calls at
+     * any other time are ignored. The callback is used for the vendor's
+     * top-level dispatch table, and for the tables it creates with
+     * createGLDispatch() while one of its contexts is current.
+     *
+     * The callback is passed the vendor-specific data given to
+     * createGLDispatch(), or NULL for the top-level dispatch table. It returns
+     * an array of function pointers indexed by the GL dispatch offsets
+     * returned by getGLDispatchOffset(), and stores the number of entries in
+     * *count. Any NULL entries, and any entries past the end of the array, are
+     * looked up with getProcAddress instead. The array is copied, so it only
+     * needs to stay valid for the duration of the call. The callback may
+     * return NULL to use getProcAddress for every entry.
+     *
+     * Returns the number of entries in a GL dispatch table, which is the size
+     * of an array that covers every function.
+     */
+    GLint (*setStaticGLDispatch)(
+        __GLXgetStaticDispatchCallback getStaticDispatch
+    );
+
 } __GLXapiExports;
 
 /*****************************************************************************
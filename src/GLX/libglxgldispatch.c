@@ -30,6 +30,7 @@
 #include "libglxabi.h"
 #include "libglxcurrent.h"
 #include "libglxmapping.h"
+#include "libglxgldispatch.h"
 
 /*
  * XXX hack: cast (__GLXcoreDispatchTable *) to the real type (__GLdispatchTable
@@ -58,12 +59,47 @@ __GLXcoreDispatchTable *__glXGetTopLevelDispatch(void)
 __GLXcoreDispatchTable *__glXCreateGLDispatch(const __GLXvendorCallbacks *cb,
                                               void *data)
 {
-    __GLdispatchTable *dispatch = __glDispatchCreateTable(
+    __GLXAPIState *apiState;
+    __GLXvendorInfo *vendor;
+
+    /*
+     * Only the current vendor's prebuilt table can be used here, since we
+     * can't tell which vendor is calling otherwise.
+     */
+    apiState = __glXGetCurrentAPIState();
+    vendor = apiState ? apiState->currentVendor : NULL;
+
+    return __glXCreateGLDispatchWithStatic(cb,
+            vendor ? vendor->getStaticDispatch : NULL,
+            data);
+}
+
+__GLXcoreDispatchTable *__glXCreateGLDispatchWithStatic(const __GLXvendorCallbacks *cb,
+                                                        __GLXgetStaticDispatchCallback getStaticDispatch,
+                                                        void *data)
+{
+    __GLdispatchTable *dispatch = __glDispatchCreateTableWithStaticDispatch(
             cb->getProcAddress,
             cb->getDispatchProto,
             cb->destroyDispatchData,
-            data
-   );
+            data,
+            (__GLgetStaticDispatchCallback)getStaticDispatch
+    );
+
+    return (__GLXcoreDispatchTable *)dispatch;
+}
+
+__GLXcoreDispatchTable *__glXCreateGLDispatchOverlay(__GLXcoreDispatchTable *base,
+                                                     const GLint *offsets,
+                                                     const __GLXextFuncPtr *procs,
+                                                     int count)
+{
+    __GLdispatchTable *dispatch = __glDispatchCreateOverlayTable(
+            (__GLdispatchTable *)base,
+            offsets,
+            (const __GLdispatchProc *)procs,
+            count
+    );
 
     return (__GLXcoreDispatchTable *)dispatch;
 }
@@ -82,16 +118,39 @@ void __glXSetGLDispatchEntry(__GLXcoreDispatchTable *table,
                          (__GLdispatchProc)addr);
 }
 
+void __glXSetGLDispatchEntries(__GLXcoreDispatchTable *table,
+                               const GLint *offsets,
+                               const __GLXextFuncPtr *addrs,
+                               int count)
+{
+    __glDispatchSetEntries((__GLdispatchTable *)table,
+                           offsets,
+                           (const __GLdispatchProc *)addrs,
+                           count);
+}
+
 void __glXMakeGLDispatchCurrent(__GLXcoreDispatchTable *table)
 {
     __GLXAPIState *apiState = __glXGetCurrentAPIState();
 
     if (apiState) {
+        // GLdispatch keeps track of which table it took a reference to, so
+        // it's fine to replace glas.dispatch before making it current.
         apiState->glas.dispatch = (__GLdispatchTable *)table;
         __glDispatchMakeCurrent(&apiState->glas);
     }
 }
 
+GLboolean __glXValidateGLDispatch(__GLXcoreDispatchTable *table)
+{
+    return __glDispatchValidateTable((__GLdispatchTable *)table);
+}
+
+void __glXSwapGLDispatch(__GLXcoreDispatchTable *table)
+{
+    __glDispatchSwapTable((__GLdispatchTable *)table);
+}
+
 GLboolean __glXDestroyGLDispatch(__GLXcoreDispatchTable *table)
 {
     if (table == __glXGetTopLevelDispatch()) {
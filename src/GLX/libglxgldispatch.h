@@ -42,11 +42,24 @@ __GLXcoreDispatchTable *__glXGetCurrentGLDispatch(void);
 __GLXcoreDispatchTable *__glXGetTopLevelDispatch(void);
 __GLXcoreDispatchTable *__glXCreateGLDispatch(const __GLXvendorCallbacks *cb,
                                               void *data);
+__GLXcoreDispatchTable *__glXCreateGLDispatchWithStatic(const __GLXvendorCallbacks *cb,
+                                                        __GLXgetStaticDispatchCallback getStaticDispatch,
+                                                        void *data);
+__GLXcoreDispatchTable *__glXCreateGLDispatchOverlay(__GLXcoreDispatchTable *base,
+                                                     const GLint *offsets,
+                                                     const __GLXextFuncPtr *procs,
+                                                     int count);
 GLint __glXGetGLDispatchOffset(const GLubyte *procName);
 void __glXSetGLDispatchEntry(__GLXcoreDispatchTable *table,
                              GLint offset,
                              __GLXextFuncPtr addr);
+void __glXSetGLDispatchEntries(__GLXcoreDispatchTable *table,
+                               const GLint *offsets,
+                               const __GLXextFuncPtr *addrs,
+                               int count);
 void __glXMakeGLDispatchCurrent(__GLXcoreDispatchTable *table);
+GLboolean __glXValidateGLDispatch(__GLXcoreDispatchTable *table);
+void __glXSwapGLDispatch(__GLXcoreDispatchTable *table);
 GLboolean __glXDestroyGLDispatch(__GLXcoreDispatchTable *table);
 
 #endif // __LIBGLX_GL_DISPATCH_H__
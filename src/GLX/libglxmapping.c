@@ -248,6 +248,23 @@ __GLXextFuncPtr __glXFetchDispatchEntry(__GLXdispatchTableDynamic *dynDispatch,
     return addr;
 }
 
+/*
+ * The getStaticDispatch callback which the vendor library that's currently
+ * being loaded passed to setStaticGLDispatch(). These are protected by the
+ * __glXVendorNameHash write lock, which is held while calling __glx_Main().
+ */
+static Bool vendorLoading;
+static __GLXgetStaticDispatchCallback vendorStaticDispatch;
+
+static GLint __glXSetStaticGLDispatch(__GLXgetStaticDispatchCallback getStaticDispatch)
+{
+    if (vendorLoading) {
+        vendorStaticDispatch = getStaticDispatch;
+    }
+
+    return __glDispatchGetTableSize();
+}
+
 static __GLXapiExports glxExportsTable = {
     .getDynDispatch = __glXGetDynDispatch,
     .fetchDispatchEntry = __glXFetchDispatchEntry,
@@ -260,8 +277,14 @@ static __GLXapiExports glxExportsTable = {
     .getTopLevelDispatch = __glXGetTopLevelDispatch,
     .createGLDispatch = __glXCreateGLDispatch,
     .getGLDispatchOffset = __glXGetGLDispatchOffset,
+    .setGLDispatchEntry = __glXSetGLDispatchEntry,
     .makeGLDispatchCurrent = __glXMakeGLDispatchCurrent,
-    .destroyGLDispatch = __glXDestroyGLDispatch
+    .destroyGLDispatch = __glXDestroyGLDispatch,
+    .createGLDispatchOverlay = __glXCreateGLDispatchOverlay,
+    .validateGLDispatch = __glXValidateGLDispatch,
+    .swapGLDispatch = __glXSwapGLDispatch,
+    .setGLDispatchEntries = __glXSetGLDispatchEntries,
+    .setStaticGLDispatch = __glXSetStaticGLDispatch
 };
 
 static char *ConstructVendorLibraryFilename(const char *vendorName)
@@ -288,6 +311,7 @@ __GLXvendorInfo *__glXLookupVendorByName(const char *vendorName)
     __GLXdispatchTableDynamic *dynDispatch;
     __GLXvendorInfo *vendor = NULL;
     Bool locked = False;
+    uint64_t start = 0;
 
     LKDHASH_RDLOCK(__glXPthreadFuncs, __glXVendorNameHash);
     HASH_FIND(hh, _LH(__glXVendorNameHash), vendorName, strlen(vendorName), pEntry);
@@ -311,6 +335,9 @@ __GLXvendorInfo *__glXLookupVendorByName(const char *vendorName)
             }
 
             filename = ConstructVendorLibraryFilename(vendorName);
+            if (__glXStartupStatsEnabled) {
+                start = glvndLockStatsGetTime();
+            }
             dlhandle = dlopen(filename, RTLD_LAZY);
             free(filename);
             if (!dlhandle) {
@@ -322,13 +349,28 @@ __GLXvendorInfo *__glXLookupVendorByName(const char *vendorName)
                 goto fail;
             }
 
+            if (__glXStartupStatsEnabled) {
+                uint64_t now = glvndLockStatsGetTime();
+                __glXStartupStats.vendorLoadTime += now - start;
+                start = now;
+            }
+
+            vendorLoading = True;
+            vendorStaticDispatch = NULL;
             dispatch = (*glxMainProc)(GLX_VENDOR_ABI_VERSION,
                                       &glxExportsTable,
                                       vendorName);
+            vendorLoading = False;
             if (!dispatch) {
                 goto fail;
             }
 
+            if (__glXStartupStatsEnabled) {
+                __glXStartupStats.vendorMainTime +=
+                    glvndLockStatsGetTime() - start;
+                __glXStartupStats.numVendors++;
+            }
+
             vendor = pEntry->vendor
                 = calloc(1, sizeof(__GLXvendorInfo));
             if (!vendor) {
@@ -341,9 +383,12 @@ __GLXvendorInfo *__glXLookupVendorByName(const char *vendorName)
             }
             vendor->dlhandle = dlhandle;
             vendor->staticDispatch = dispatch;
+            vendor->getStaticDispatch = vendorStaticDispatch;
 
             vendor->glDispatch = (__GLdispatchTable *)
-                __glXCreateGLDispatch(&dispatch->glxvc, NULL);
+                __glXCreateGLDispatchWithStatic(&dispatch->glxvc,
+                                                vendor->getStaticDispatch,
+                                                NULL);
             if (!vendor->glDispatch) {
                 goto fail;
             }
@@ -357,6 +402,10 @@ __GLXvendorInfo *__glXLookupVendorByName(const char *vendorName)
             /* Initialize the dynamic dispatch table */
             LKDHASH_INIT(__glXPthreadFuncs, dynDispatch->hash);
             dynDispatch->vendor = vendor;
+            if (glvndLockStatsEnabled) {
+                dynDispatch->hash.stats.name = vendor->name;
+                __glDispatchRegisterLockStats(&dynDispatch->hash.stats);
+            }
 
             HASH_ADD_KEYPTR(hh, _LH(__glXVendorNameHash), vendorName,
                             strlen(vendorName), pEntry);
@@ -430,7 +479,15 @@ __GLXvendorInfo *__glXLookupVendorByScreen(Display *dpy, const int screen)
         }
 
         if (!vendor) {
-            queriedVendorName = XGLVQueryScreenVendorMapping(dpy, screen);
+            if (__glXStartupStatsEnabled) {
+                uint64_t start = glvndLockStatsGetTime();
+                queriedVendorName = XGLVQueryScreenVendorMapping(dpy, screen);
+                __sync_fetch_and_add(&__glXStartupStats.screenQueryTime,
+                                     glvndLockStatsGetTime() - start);
+                __sync_fetch_and_add(&__glXStartupStats.numScreenQueries, 1);
+            } else {
+                queriedVendorName = XGLVQueryScreenVendorMapping(dpy, screen);
+            }
             vendor = __glXLookupVendorByName(queriedVendorName);
             Xfree(queriedVendorName);
         }
@@ -712,7 +769,15 @@ static int ScreenFromXID(Display *dpy, XID xid)
     if (pEntry) {
         screen = pEntry->screen;
     } else {
-        screen = XGLVQueryXIDScreenMapping(dpy, xid);
+        if (__glXStartupStatsEnabled) {
+            uint64_t start = glvndLockStatsGetTime();
+            screen = XGLVQueryXIDScreenMapping(dpy, xid);
+            __sync_fetch_and_add(&__glXStartupStats.xidQueryTime,
+                                 glvndLockStatsGetTime() - start);
+            __sync_fetch_and_add(&__glXStartupStats.numXIDQueries, 1);
+        } else {
+            screen = XGLVQueryXIDScreenMapping(dpy, xid);
+        }
         AddScreenXIDMapping(xid, screen);
     }
 
@@ -738,3 +803,30 @@ int __glXScreenFromDrawable(Display *dpy, GLXDrawable drawable)
 {
     return ScreenFromXID(dpy, drawable);
 }
+
+void __glXRegisterMappingLockStats(void)
+{
+    __glDispatchRegisterLockStats(&__glXDispatchIndexHash.stats);
+    __glDispatchRegisterLockStats(&__glXVendorScreenHash.stats);
+    __glDispatchRegisterLockStats(&__glXVendorNameHash.stats);
+    __glDispatchRegisterLockStats(&__glXScreenPointerMappingHash.stats);
+    __glDispatchRegisterLockStats(&__glXScreenXIDMappingHash.stats);
+}
+
+void __glXUnregisterMappingLockStats(void)
+{
+    __GLXvendorNameHash *pEntry, *tmp;
+
+    LKDHASH_RDLOCK(__glXPthreadFuncs, __glXVendorNameHash);
+    HASH_ITER(hh, _LH(__glXVendorNameHash), pEntry, tmp) {
+        __glDispatchUnregisterLockStats(
+            &pEntry->vendor->dynDispatch->hash.stats);
+    }
+    LKDHASH_UNLOCK(__glXPthreadFuncs, __glXVendorNameHash);
+
+    __glDispatchUnregisterLockStats(&__glXDispatchIndexHash.stats);
+    __glDispatchUnregisterLockStats(&__glXVendorScreenHash.stats);
+    __glDispatchUnregisterLockStats(&__glXVendorNameHash.stats);
+    __glDispatchUnregisterLockStats(&__glXScreenPointerMappingHash.stats);
+    __glDispatchUnregisterLockStats(&__glXScreenXIDMappingHash.stats);
+}
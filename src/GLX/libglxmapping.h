@@ -42,6 +42,7 @@ typedef struct __GLXvendorInfoRec {
     const __GLXdispatchTableStatic *staticDispatch; //< static GLX dispatch table
     __GLXdispatchTableDynamic *dynDispatch; //< dynamic GLX dispatch table
     __GLdispatchTable *glDispatch; //< GL dispatch table
+    __GLXgetStaticDispatchCallback getStaticDispatch; //< prebuilt GL dispatch table, or NULL
 } __GLXvendorInfo;
 
 /*!
@@ -73,6 +74,37 @@ int __glXScreenFromDrawable(Display *dpy, GLXDrawable drawable);
 
 __GLXextFuncPtr __glXGetGLXDispatchAddress(const GLubyte *procName);
 
+/*!
+ * Registers or unregisters the lock statistics for the mapping hash tables,
+ * including each vendor's dynamic dispatch table, with libGLdispatch.
+ */
+void __glXRegisterMappingLockStats(void);
+void __glXUnregisterMappingLockStats(void);
+
+/*!
+ * Startup timings, in nanoseconds. These are only recorded if the
+ * __GLX_STARTUP_STATS environment variable is set to a non-zero value, and
+ * are printed to stderr at exit, along with how long it took to build each GL
+ * dispatch table.
+ */
+typedef struct __GLXstartupStatsRec {
+    uint64_t initTime; //< all of __glXInit()
+    uint64_t setupPthreadsTime; //< glvndSetupPthreads()
+    uint64_t dispatchInitTime; //< __glDispatchInit()
+
+    int numVendors; //< number of vendor libraries loaded
+    uint64_t vendorLoadTime; //< dlopen() of the vendor libraries
+    uint64_t vendorMainTime; //< the vendors' __glx_Main() functions
+
+    int numScreenQueries; //< XGLVQueryScreenVendorMapping() round trips
+    uint64_t screenQueryTime;
+    int numXIDQueries; //< XGLVQueryXIDScreenMapping() round trips
+    uint64_t xidQueryTime;
+} __GLXstartupStats;
+
+extern int __glXStartupStatsEnabled;
+extern __GLXstartupStats __glXStartupStats;
+
 /*!
  * Looks up the vendor by name or screen number. This has the side effect of
  * loading the vendor library if it has not been previously loaded.
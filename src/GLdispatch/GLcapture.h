@@ -0,0 +1,131 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#ifndef __GL_CAPTURE_H__
+#define __GL_CAPTURE_H__
+
+#include <stdint.h>
+
+/*
+ * The layout of a GL call capture file, as written by libGLdispatch's capture
+ * mode. See __glDispatchStartCapture().
+ *
+ * The file starts with a __GLcaptureHeader, padded out to
+ * GL_CAPTURE_HEADER_SIZE bytes. The rest of the file is a sequence of chunks
+ * of header.chunkSize bytes. Each thread reserves a chunk at a time, and
+ * writes its records directly into it, so every chunk holds the records for
+ * a single thread in the order they were made.
+ *
+ * A chunk starts with a single 64-bit word, which holds GL_CAPTURE_CHUNK_MAGIC
+ * in the low 32 bits and the thread's capture ID in the high 32 bits. That's
+ * followed by the records, each of which is a sequence of 64-bit words:
+ *
+ *     word 0:  (dispatch offset + 1) | (number of arguments << 32)
+ *     word 1:  timestamp, in ticks
+ *     word 2+: the arguments
+ *
+ * The first word of a record is never zero, so a zero word, or the end of the
+ * chunk, marks the end of the chunk's records.
+ *
+ * Integer arguments are stored as 64-bit values, sign-extended for signed
+ * types. Floats and doubles are stored as their IEEE bits, and pointers as
+ * their address. Functions called through a dynamic dispatch stub are
+ * recorded without their arguments.
+ *
+ * The names of functions in the static dispatch table are compiled into the
+ * decoder, but the names of dynamic functions are only known at runtime. Those
+ * are written to a name block when the file is flushed or finished. A name
+ * block takes up one or more whole chunks, and starts with a word holding
+ * GL_CAPTURE_NAMES_MAGIC in the low 32 bits and the number of chunks in the
+ * high 32 bits. That's followed by an entry for each dynamic function, which
+ * is a 32-bit dispatch offset, a 32-bit name length, and the name without its
+ * "gl" prefix, NUL-terminated and padded to a multiple of 8 bytes. A zero
+ * word ends the block.
+ *
+ * Timestamps are in arbitrary ticks. The header has a pair of tick counts and
+ * CLOCK_MONOTONIC times, taken when the capture starts and finishes, which
+ * the decoder uses to convert them to nanoseconds.
+ */
+
+#define GL_CAPTURE_MAGIC 0x43564c47 /* "GLVC" */
+#define GL_CAPTURE_VERSION 1
+#define GL_CAPTURE_CHUNK_MAGIC 0x4b4e4843 /* "CHNK" */
+#define GL_CAPTURE_NAMES_MAGIC 0x454d414e /* "NAME" */
+
+#define GL_CAPTURE_HEADER_SIZE 4096
+
+typedef struct __GLcaptureHeaderRec {
+    uint32_t magic;
+    uint32_t version;
+
+    /*! The size of each chunk, in bytes */
+    uint32_t chunkSize;
+
+    /*! The number of threads that recorded any calls */
+    uint32_t numThreads;
+
+    /*! The size of the file, in bytes, including this header */
+    uint64_t size;
+
+    /*! The number of calls which were dropped because the file was full */
+    uint64_t numDropped;
+
+    /*! Tick counts and times, in nanoseconds, for converting timestamps */
+    uint64_t startTicks;
+    uint64_t startTime;
+    uint64_t endTicks;
+    uint64_t endTime;
+} __GLcaptureHeader;
+
+/*
+ * Argument type codes, as used in __GLcaptureFuncInfo::argTypes.
+ */
+#define GL_CAPTURE_ARG_FLOAT    'f' /* float bits, in the low 32 bits */
+#define GL_CAPTURE_ARG_DOUBLE   'd' /* double bits */
+#define GL_CAPTURE_ARG_ENUM     'e'
+#define GL_CAPTURE_ARG_BOOLEAN  'b'
+#define GL_CAPTURE_ARG_INT      'i' /* sign-extended integer */
+#define GL_CAPTURE_ARG_UINT     'u'
+#define GL_CAPTURE_ARG_POINTER  'p'
+#define GL_CAPTURE_ARG_HEX      'x' /* bitfields and opaque handles */
+
+/*
+ * The name and argument types of a function in the dispatch table. This is
+ * generated from the GL API XML by gl_capture.py, and is indexed by dispatch
+ * offset. The argTypes string has one GL_CAPTURE_ARG_* code per argument.
+ */
+typedef struct __GLcaptureFuncInfoRec {
+    const char *name;
+    const char *argTypes;
+} __GLcaptureFuncInfo;
+
+extern const __GLcaptureFuncInfo __glCaptureFuncInfo[];
+extern const int __glCaptureFuncInfoCount;
+
+#endif
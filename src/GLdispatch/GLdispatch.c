@@ -27,13 +27,22 @@
  * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
  */
 
+#include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <pthread.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <ctype.h>
+#include <dlfcn.h>
 
 #include "trace.h"
 #include "glvnd_list.h"
+#include "uthash.h"
 #include "GLdispatch.h"
 #include "GLdispatchPrivate.h"
+#include "GLcapture.h"
 
 /*
  * Global current dispatch table list. We need this to fix up all current
@@ -41,6 +50,12 @@
  * Accesses to this need to be protected by the dispatch lock.
  */
 static struct glvnd_list currentDispatchList;
+
+/*
+ * List of every dispatch table, for __glDispatchGetStats(). Accesses to this
+ * need to be protected by the dispatch lock.
+ */
+static struct glvnd_list dispatchTableList;
 static GLVNDPthreadFuncs *pthreadFuncs;
 
 typedef struct __GLdispatchProcEntryRec {
@@ -50,40 +65,81 @@ typedef struct __GLdispatchProcEntryRec {
     // _glapi_add_dispatch()
     int offset;
 
-    // The generation in which this dispatch entry was defined.
+    // The generation in which this dispatch entry was assigned an offset.
     // Used to determine whether a given dispatch table needs to
-    // be fixed up with the right function address at this offset.
+    // be fixed up with the right function address at this offset. This is
+    // zero while the proc is on the newProcList.
     int generation;
 
-    // List handle
+    // List handle, used while the proc is on the newProcList
     struct glvnd_list entry;
+
+    // Hash handle, used while the proc is in the newProcHash
+    UT_hash_handle hh;
 } __GLdispatchProcEntry;
 
 /*
- * List of new dispatch procs which need to be given prototypes at make current
- * time. Accesses to this need to be protected by the dispatch lock.
+ * List of dispatch procs which haven't been given a prototype yet, because no
+ * vendor recognized them. Every callback in dispatchProtos has already been
+ * asked about these, so this doubles as a negative cache: another
+ * GetProcAddress() call for one of these names doesn't have to ask again, and
+ * the only time they're looked at is when a dispatch table with a new
+ * getDispatchProto callback is created. Most of these don't have a stub; see
+ * __glDispatchGetProcAddress(). Accesses to this need to be protected by the
+ * dispatch lock.
  */
 static struct glvnd_list newProcList;
 
 /*
- * List of valid extension procs which have been assigned prototypes. At make
- * current time, if the new context's generation is out-of-date, we iterate
- * through this list and fix up the new context with entrypoints with a greater
- * generation number. Accesses to this need to be protected by the dispatch
- * lock.
+ * Hash of the procs in newProcList, keyed by name, so that
+ * __glDispatchGetProcAddress() doesn't have to scan the list with the dispatch
+ * lock held. Accesses to this need to be protected by the dispatch lock.
+ */
+static __GLdispatchProcEntry *newProcHash;
+
+/*
+ * Array of valid extension procs which have been assigned prototypes. Procs
+ * are only ever appended to this, and each one is given a new generation
+ * number when it's appended, so the array is sorted by generation. At make
+ * current time, if the new context's generation is out-of-date, we only need
+ * to fix up the procs past the table's generation, rather than walking every
+ * proc that was ever added. Accesses to this need to be protected by the
+ * dispatch lock.
+ */
+static struct {
+    __GLdispatchProcEntry **procs;
+    int count;
+    int capacity;
+} extProcs;
+
+/*
+ * The distinct getDispatchProto callbacks of every dispatch table, and how
+ * many tables use each one. Overlay and layer tables normally share their
+ * base table's callback, so there's usually one of these per vendor, and a new
+ * proc only has to be offered to each of them once. Accesses to this need to
+ * be protected by the dispatch lock.
  */
-static struct glvnd_list extProcList;
+static struct {
+    struct {
+        __GLgetDispatchProtoCallback getDispatchProto;
+        int refCount;
+    } *protos;
+    int count;
+    int capacity;
+} dispatchProtos;
 
 /*
  * Monotonically increasing integer describing the most up-to-date "generation"
  * of the dispatch table. Used to determine if a given table needs fixup.
- * Accesses to this need to be protected by the dispatch lock.
+ * Writes to this need to be protected by the dispatch lock, but
+ * __glDispatchMakeCurrent() reads it without the lock to decide whether it
+ * can skip taking the lock entirely.
  *
  * Note: wrapping is theoretically an issue here, but shouldn't happen in
  * practice as it requires calling GetProcAddress() on 2^31-1 unique functions.
  * We'll run out of dispatch stubs long before then.
  */
-static int latestGeneration;
+static volatile int latestGeneration;
 
 /*
  * The dispatch lock. This should be taken around any code that manipulates the
@@ -93,34 +149,157 @@ static int latestGeneration;
 struct {
     glvnd_mutex_t lock;
     int isLocked;
-} dispatchLock = { GLVND_MUTEX_INITIALIZER, 0 };
+    GLVNDlockStats stats;
+} dispatchLock = { GLVND_MUTEX_INITIALIZER, 0, { "dispatch" } };
+
+/*
+ * Set from the __GL_LOCK_STATS environment variable. If this is set, then we
+ * keep track of how long threads wait for and hold the dispatch lock, along
+ * with any other locks registered with __glDispatchRegisterLockStats().
+ */
+int glvndLockStatsEnabled;
+
+/*
+ * List of lock statistics that __glDispatchGetLockStats() reports. Accesses
+ * to this need to be protected by the dispatch lock.
+ */
+static GLVNDlockStats *lockStatsList;
+
+/*
+ * Copies of the final statistics of locks that were unregistered, at most one
+ * per lock name. See RetireLockStats(). Accesses to this need to be protected
+ * by the dispatch lock.
+ */
+static GLVNDlockStats *retiredLockStatsList;
 
 static inline void LockDispatch(void)
 {
-    pthreadFuncs->mutex_lock(&dispatchLock.lock);
+    if (glvndLockStatsEnabled) {
+        glvndLockStatsMutexLock(pthreadFuncs, &dispatchLock.lock,
+                                &dispatchLock.stats);
+    } else {
+        pthreadFuncs->mutex_lock(&dispatchLock.lock);
+    }
     dispatchLock.isLocked = 1;
 }
 
 static inline void UnlockDispatch(void)
 {
     dispatchLock.isLocked = 0;
-    pthreadFuncs->mutex_unlock(&dispatchLock.lock);
+    if (glvndLockStatsEnabled) {
+        glvndLockStatsMutexUnlock(pthreadFuncs, &dispatchLock.lock,
+                                  &dispatchLock.stats);
+    } else {
+        pthreadFuncs->mutex_unlock(&dispatchLock.lock);
+    }
 }
 
 #define CheckDispatchLocked() assert(dispatchLock.isLocked)
 
+/*
+ * If this is set, new dispatch tables start out with a resolver trampoline in
+ * every slot, and each function is only looked up from the vendor the first
+ * time it's called. This is enabled by setting the __GL_LAZY_DISPATCH
+ * environment variable, and only takes effect if glapi supports resolver
+ * trampolines on this platform.
+ */
+static int lazyDispatch;
+
+/*
+ * The profiling table, if profiling is enabled. This has a profiling
+ * trampoline in every slot, and is installed in place of every other table at
+ * make current. The trampolines count the calls for each slot and forward
+ * them to the head of the API state's layer chain. See __glDispatchEnableProfiling().
+ */
+static __GLdispatchTable *profileDispatch;
+
+/*
+ * The table which is installed in place of every other table at make current.
+ * This is either the profiling table or the capture table, which has a
+ * capture function in every slot that records the call and forwards it to
+ * the head of the API state's layer chain. See __glDispatchStartCapture().
+ */
+static __GLdispatchTable *interposeDispatch;
+
+/*
+ * Set once __glDispatchEnableProfiling() or __glDispatchStartCapture() has
+ * started setting up its table, so that only one of them can. Accesses to
+ * this need to be protected by the dispatch lock.
+ */
+static int interposeClaimed;
+
+/*
+ * The interposer layers, starting with the outermost one. Layers are only ever
+ * appended to this. Accesses to this need to be protected by the dispatch
+ * lock, except that __glDispatchMakeCurrent() reads numLayers without the lock
+ * to decide whether a table needs a layer chain. See __glDispatchAddLayer().
+ */
+static __GLdispatchLayer *layers;
+static volatile int numLayers;
+
+#if !defined(GLDISPATCH_LAYERS_CONFIG)
+#define GLDISPATCH_LAYERS_CONFIG "/etc/glvnd/layers.conf"
+#endif
+
+static __GLdispatchProc ResolveDispatchSlot(int offset);
+static void PrintLockStats(void);
+static void LoadLayers(void);
+static void BuildLayerChain(__GLdispatchTable *dispatch);
+static void DestroyLayerTables(__GLdispatchTable *dispatch,
+                               __GLdispatchTable **tables, int count);
+
 void __glDispatchInit(GLVNDPthreadFuncs *funcs)
 {
+    const char *lazyStr;
+    const char *lockStatsStr;
+    const char *profileStr;
+    const char *intervalStr;
+    const char *captureStr;
+    const char *captureSizeStr;
+
     pthreadFuncs = funcs;
     // Call into GLAPI to see if we are multithreaded
     // TODO: fix GLAPI to use the pthread funcs provided here?
     _glapi_check_multithread();
 
+    LoadLayers();
+
+    lazyStr = getenv("__GL_LAZY_DISPATCH");
+    if (lazyStr && atoi(lazyStr) && !numLayers) {
+        _glapi_set_resolve_func(ResolveDispatchSlot);
+        lazyDispatch = (_glapi_get_resolver(0) != NULL);
+    }
+
+    lockStatsStr = getenv("__GL_LOCK_STATS");
+    if (!glvndLockStatsEnabled && lockStatsStr && atoi(lockStatsStr)) {
+        glvndLockStatsEnabled = 1;
+        __glDispatchRegisterLockStats(&dispatchLock.stats);
+        atexit(PrintLockStats);
+    }
+
     LockDispatch();
     glvnd_list_init(&newProcList);
-    glvnd_list_init(&extProcList);
+    newProcHash = NULL;
+    dispatchProtos.protos = NULL;
+    dispatchProtos.count = dispatchProtos.capacity = 0;
+    extProcs.procs = NULL;
+    extProcs.count = extProcs.capacity = 0;
     glvnd_list_init(&currentDispatchList);
+    glvnd_list_init(&dispatchTableList);
     UnlockDispatch();
+
+    profileStr = getenv("__GL_PROFILE_DISPATCH");
+    if (profileStr && atoi(profileStr)) {
+        intervalStr = getenv("__GL_PROFILE_SAMPLE_INTERVAL");
+        __glDispatchEnableProfiling(intervalStr ? atoi(intervalStr) : 0);
+    }
+
+    captureStr = getenv("__GL_CAPTURE_FILE");
+    if (captureStr && captureStr[0]) {
+        captureSizeStr = getenv("__GL_CAPTURE_SIZE");
+        __glDispatchStartCapture(captureStr, captureSizeStr ?
+                (size_t)atoi(captureSizeStr) * 1024 * 1024 : 0);
+    }
 }
 
 static void noop_func(void)
@@ -128,118 +307,512 @@ static void noop_func(void)
     // nop
 }
 
+/*
+ * Called from a resolver trampoline the first time a function is called
+ * through a lazily-built dispatch table. This looks up the function from the
+ * vendor, patches it into the current table, and returns it so that the
+ * trampoline can tail-call it.
+ */
+static __GLdispatchProc ResolveDispatchSlot(int offset)
+{
+    __GLdispatchAPIState *apiState = (__GLdispatchAPIState *)
+        _glapi_get_current(CURRENT_API_STATE);
+    __GLdispatchTable *dispatch = apiState ? apiState->dispatch : NULL;
+    struct _glapi_table *table = _glapi_get_dispatch();
+    __GLdispatchTable *curDispatch;
+    const char *name;
+    char *procName;
+    void *procAddr = NULL;
+    void **tbl;
+
+    LockDispatch();
+
+    // The profiling and capture tables forward each call to the API state's
+    // table.
+    if (interposeDispatch && (table == interposeDispatch->table) && dispatch) {
+        table = dispatch->table;
+    }
+
+    /*
+     * The installed table is normally the API state's, but it might not be
+     * if the vendor has changed tables directly. In that case, it's still on
+     * the current dispatch list.
+     */
+    if (!dispatch || (dispatch->table != table)) {
+        dispatch = NULL;
+        glvnd_list_for_each_entry(curDispatch, &currentDispatchList, entry) {
+            if (curDispatch->table == table) {
+                dispatch = curDispatch;
+                break;
+            }
+        }
+    }
+
+    if (!dispatch) {
+        // Trampolines are only ever installed in a dispatch table, so this
+        // shouldn't happen.
+        UnlockDispatch();
+        return noop_func;
+    }
+
+    tbl = (void **)dispatch->table;
+    if (tbl[offset] != (void *)_glapi_get_resolver(offset)) {
+        // Another thread or a fixup already filled this in.
+        procAddr = tbl[offset];
+        UnlockDispatch();
+        return (__GLdispatchProc)procAddr;
+    }
+
+    // glapi stores function names without the "gl" prefix.
+    name = _glapi_get_proc_name(offset);
+    if (name) {
+        procName = malloc(strlen(name) + 3);
+        if (procName) {
+            strcpy(procName, "gl");
+            strcat(procName, name);
+            procAddr = (*dispatch->getProcAddress)((const GLubyte *)procName,
+                                                   dispatch->vendorData);
+            free(procName);
+        }
+    }
+    DBG_PRINTF(20, "offset=%d, name=%s, addr=%p\n",
+               offset, name ? name : "(null)", procAddr);
+
+    if (procAddr) {
+        dispatch->numResolved++;
+    } else {
+        dispatch->numNoop++;
+        procAddr = (void *)noop_func;
+    }
+    tbl[offset] = procAddr;
+
+    UnlockDispatch();
+
+    return (__GLdispatchProc)procAddr;
+}
+
+/*
+ * Updates a table's make current statistics after taking a reference to it,
+ * where count is the new reference count. A validated table holds a reference
+ * to itself, which doesn't count as a thread.
+ */
+static inline void DispatchCurrentRefStats(__GLdispatchTable *dispatch,
+                                           int count)
+{
+    int threads = count - dispatch->validated;
+    int peak = dispatch->peakCurrentThreads;
+    int prev;
+
+    __sync_fetch_and_add(&dispatch->numMakeCurrent, 1);
+
+    while (threads > peak) {
+        prev = __sync_val_compare_and_swap(&dispatch->peakCurrentThreads,
+                                           peak, threads);
+        if (prev == peak) {
+            break;
+        }
+        peak = prev;
+    }
+}
+
 static void DispatchCurrentRef(__GLdispatchTable *dispatch)
 {
     CheckDispatchLocked();
-    dispatch->currentThreads++;
-    if (dispatch->currentThreads == 1) {
+    if (__sync_add_and_fetch(&dispatch->currentThreads, 1) == 1) {
         glvnd_list_add(&dispatch->entry, &currentDispatchList);
     }
 }
 
 static void DispatchCurrentUnref(__GLdispatchTable *dispatch)
 {
+    int count;
+
     CheckDispatchLocked();
-    dispatch->currentThreads--;
-    if (dispatch->currentThreads == 0) {
+    count = __sync_sub_and_fetch(&dispatch->currentThreads, 1);
+    if (count == 0) {
         glvnd_list_del(&dispatch->entry);
     }
-    assert(dispatch->currentThreads >= 0);
+    assert(count >= 0);
 }
 
 /*
- * Fix up a dispatch table. Calls to this function must be protected by the
- * dispatch lock.
+ * Try to take a reference to a dispatch table without the dispatch lock.
+ * This only succeeds if the table is already current on some other thread: in
+ * that case it is already on the currentDispatchList, so any new entrypoints
+ * will be fixed up in it by whoever adds them. Adding a table to the list
+ * requires the lock, so the 0 -> 1 transition is left to DispatchCurrentRef().
+ *
+ * Returns 1 if a reference was taken, or 0 if the caller needs to fall back to
+ * DispatchCurrentRef().
  */
-static void FixupDispatchTable(__GLdispatchTable *dispatch)
+static int DispatchCurrentTryRef(__GLdispatchTable *dispatch)
 {
-    DBG_PRINTF(20, "dispatch=%p\n", dispatch);
+    int count = dispatch->currentThreads;
+    int prev;
+
+    while (count > 0) {
+        prev = __sync_val_compare_and_swap(&dispatch->currentThreads,
+                                           count, count + 1);
+        if (prev == count) {
+            DispatchCurrentRefStats(dispatch, count + 1);
+            return 1;
+        }
+        count = prev;
+    }
+
+    return 0;
+}
+
+/*
+ * The counterpart to DispatchCurrentTryRef(). This drops a reference without
+ * the dispatch lock as long as it isn't the last one, since removing the
+ * table from the currentDispatchList requires the lock.
+ */
+static int DispatchCurrentTryUnref(__GLdispatchTable *dispatch)
+{
+    int count = dispatch->currentThreads;
+    int prev;
+
+    while (count > 1) {
+        prev = __sync_val_compare_and_swap(&dispatch->currentThreads,
+                                           count, count - 1);
+        if (prev == count) {
+            return 1;
+        }
+        count = prev;
+    }
+
+    return 0;
+}
+
+/*
+ * Makes sure there's room to append another proc to extProcs. Calls to this
+ * function must be protected by the dispatch lock.
+ */
+static int ReserveExtProc(void)
+{
+    __GLdispatchProcEntry **procs;
+    int capacity;
+
     CheckDispatchLocked();
 
-    __GLdispatchProcEntry *curProc, *tmpProc;
+    if (extProcs.count < extProcs.capacity) {
+        return 1;
+    }
+
+    capacity = extProcs.capacity ? extProcs.capacity * 2 : 64;
+    procs = realloc(extProcs.procs, capacity * sizeof(*procs));
+    if (!procs) {
+        return 0;
+    }
 
-    char **function_name, **function_names, *parameter_signature;
+    extProcs.procs = procs;
+    extProcs.capacity = capacity;
 
-    void *procAddr;
+    return 1;
+}
+
+/*
+ * Returns the index of the first proc in extProcs with a generation newer than
+ * the given one, or extProcs.count if there isn't one. Calls to this function
+ * must be protected by the dispatch lock.
+ */
+static int FindFirstExtProc(int generation)
+{
+    int lo = 0, hi = extProcs.count;
+    int mid;
+
+    CheckDispatchLocked();
+
+    while (lo < hi) {
+        mid = lo + (hi - lo) / 2;
+        if (extProcs.procs[mid]->generation > generation) {
+            hi = mid;
+        } else {
+            lo = mid + 1;
+        }
+    }
+
+    return lo;
+}
+
+/*
+ * Reapplies the overrides of an overlay table. Calls to this function must be
+ * protected by the dispatch lock.
+ */
+static void ApplyOverrides(__GLdispatchTable *dispatch)
+{
     void **tbl = (void **)dispatch->table;
+    int i;
+
+    CheckDispatchLocked();
+
+    for (i = 0; i < dispatch->numOverrides; i++) {
+        tbl[dispatch->overrideOffsets[i]] = (void *)dispatch->overrideProcs[i];
+    }
+}
+
+/*
+ * Asks a vendor for the dispatch prototype of a proc on the newProcList. If the
+ * vendor recognizes it, then plug the prototype into glapi, which generates
+ * its stub if it doesn't have one yet, and move the proc from the newProcList
+ * to the end of extProcs. The proc gets the next generation number, but
+ * latestGeneration isn't updated until the caller calls CommitNewProcs(), so
+ * that a batch of procs only needs one bump. Calls to this function must be
+ * protected by the dispatch lock.
+ *
+ * Returns non-zero if the proc was assigned a dispatch offset.
+ */
+static int AssignNewProc(__GLdispatchProcEntry *curProc,
+                         __GLgetDispatchProtoCallback getDispatchProto)
+{
+    char **function_name, **function_names, *parameter_signature;
+
+    CheckDispatchLocked();
+
+    DBG_PRINTF(20, "newProc procName=%s\n", curProc->procName);
+    if (!ReserveExtProc()) {
+        // Leave the proc on the newProcList. The next dispatch table that's
+        // created will ask about it again.
+        return 0;
+    }
+
+    if (!(*getDispatchProto)((const GLubyte *)curProc->procName,
+                             &function_names,
+                             &parameter_signature)) {
+        return 0;
+    }
+
+    curProc->offset =
+        _glapi_add_dispatch((const char * const *)function_names,
+                            (const char *)parameter_signature);
+    DBG_PRINTF(20, "newProc offset=%d\n", curProc->offset);
+
+    for (function_name = function_names; *function_name; function_name++) {
+        free(*function_name);
+    }
+
+    free(function_names);
+    free(parameter_signature);
+
+    if (curProc->offset == -1) {
+        // We ran out of stubs or dispatch slots. Leave the proc on the
+        // newProcList, so that it keeps dispatching to a no-op.
+        return 0;
+    }
 
     /*
-     * For each proc in the newProcList, request a dispatch prototype from the
-     * vendor library and plug it into glapi. If we succeed, move the proc
-     * from the newProcList to the extProcList, and do some cleanup.
+     * Give the proc a new generation number, so that extProcs stays sorted
+     * and every table knows that it needs to pick this proc up.
      */
-    glvnd_list_for_each_entry_safe(curProc, tmpProc, &newProcList, entry) {
+    curProc->generation = latestGeneration + 1;
+
+    glvnd_list_del(&curProc->entry);
+    HASH_DEL(newProcHash, curProc);
+    extProcs.procs[extProcs.count++] = curProc;
 
-        DBG_PRINTF(20, "newProc procName=%s\n", curProc->procName);
-        if ((*dispatch->getDispatchProto)((const GLubyte *)curProc->procName,
-                                          &function_names,
-                                          &parameter_signature)) {
+    return 1;
+}
+
+/*
+ * Adds a reference to a getDispatchProto callback in dispatchProtos. Calls to
+ * this function must be protected by the dispatch lock.
+ *
+ * Returns non-zero if no other table has this callback, in which case the
+ * caller should offer it the procs on the newProcList.
+ */
+static int RefDispatchProto(__GLgetDispatchProtoCallback getDispatchProto)
+{
+    int i, capacity;
+    void *protos;
+
+    CheckDispatchLocked();
 
-            curProc->offset =
-                _glapi_add_dispatch((const char * const *)function_names,
-                                    (const char *)parameter_signature);
-            DBG_PRINTF(20, "newProc offset=%d\n", curProc->offset);
+    for (i = 0; i < dispatchProtos.count; i++) {
+        if (dispatchProtos.protos[i].getDispatchProto == getDispatchProto) {
+            dispatchProtos.protos[i].refCount++;
+            return 0;
+        }
+    }
+
+    if (dispatchProtos.count == dispatchProtos.capacity) {
+        capacity = dispatchProtos.capacity ? dispatchProtos.capacity * 2 : 4;
+        protos = realloc(dispatchProtos.protos,
+                         capacity * sizeof(*dispatchProtos.protos));
+        if (!protos) {
+            // This callback will still be offered the procs that are on the
+            // newProcList now, but not any new ones.
+            return 1;
+        }
+        dispatchProtos.protos = protos;
+        dispatchProtos.capacity = capacity;
+    }
+
+    dispatchProtos.protos[i].getDispatchProto = getDispatchProto;
+    dispatchProtos.protos[i].refCount = 1;
+    dispatchProtos.count++;
+
+    return 1;
+}
 
-            assert(curProc->offset != -1);
+/*
+ * Drops a reference to a getDispatchProto callback in dispatchProtos. Calls to
+ * this function must be protected by the dispatch lock.
+ */
+static void UnrefDispatchProto(__GLgetDispatchProtoCallback getDispatchProto)
+{
+    int i;
 
-            glvnd_list_del(&curProc->entry);
-            glvnd_list_add(&curProc->entry, &extProcList);
+    CheckDispatchLocked();
 
-            for (function_name = function_names;
-                 *function_name; function_name++) {
-                free(*function_name);
+    for (i = 0; i < dispatchProtos.count; i++) {
+        if (dispatchProtos.protos[i].getDispatchProto == getDispatchProto) {
+            if (--dispatchProtos.protos[i].refCount == 0) {
+                dispatchProtos.protos[i] =
+                    dispatchProtos.protos[--dispatchProtos.count];
             }
+            return;
+        }
+    }
+}
+
+/*
+ * Offers a new proc to each vendor until one of them recognizes it. If none
+ * does, the proc stays on the newProcList. Calls to this function must be
+ * protected by the dispatch lock.
+ *
+ * Returns non-zero if the proc was assigned a dispatch offset.
+ */
+static int OfferNewProc(__GLdispatchProcEntry *curProc)
+{
+    int i;
 
-            free(function_names);
-            free(parameter_signature);
+    CheckDispatchLocked();
+
+    for (i = 0; i < dispatchProtos.count; i++) {
+        if (AssignNewProc(curProc, dispatchProtos.protos[i].getDispatchProto)) {
+            return 1;
         }
     }
+    return 0;
+}
+
+/*
+ * Fix up a dispatch table. Calls to this function must be protected by the
+ * dispatch lock.
+ */
+static void FixupDispatchTable(__GLdispatchTable *dispatch)
+{
+    DBG_PRINTF(20, "dispatch=%p\n", dispatch);
+    CheckDispatchLocked();
+
+    __GLdispatchProcEntry *curProc;
+
+    void *procAddr;
+    void **tbl = (void **)dispatch->table;
+    uint64_t start = glvndLockStatsGetTime();
+    int first, i;
 
     /*
-     * For each proc in the extProcList, compare its gen# against that of
-     * the context. If greater, then fix up the dispatch table to contain
-     * the right entrypoint.
-     * XXX optimization: could we assume that the list is sorted by generation
-     * number and hence early out once we reach gen# <= the context's?
+     * extProcs is sorted by generation, so skip straight to the first proc
+     * that's newer than the table, and fix up the dispatch table to contain
+     * the right entrypoint for each proc from there on.
      */
-    glvnd_list_for_each_entry(curProc, &extProcList, entry) {
-        if (curProc->generation > dispatch->generation) {
-            assert(curProc->offset != -1);
-            assert(curProc->procName);
+    first = FindFirstExtProc(dispatch->generation);
+    for (i = first; i < extProcs.count; i++) {
+        curProc = extProcs.procs[i];
+
+        assert(curProc->generation > dispatch->generation);
+        assert(curProc->offset != -1);
+        assert(curProc->procName);
+
+        procAddr = (void*)(*dispatch->getProcAddress)(
+            (const GLubyte *)curProc->procName,
+            dispatch->vendorData);
+
+        if (procAddr) {
+            dispatch->numResolved++;
+        } else {
+            dispatch->numNoop++;
+            procAddr = (void *)noop_func;
+        }
+        tbl[curProc->offset] = procAddr;
+        DBG_PRINTF(20, "extProc procName=%s, addr=%p, noop=%p\n",
+                   curProc->procName, procAddr, noop_func);
+    }
 
-            procAddr = (void*)(*dispatch->getProcAddress)(
-                (const GLubyte *)curProc->procName,
-                dispatch->vendorData);
+    dispatch->numFixups++;
+    dispatch->numProcsFixed += extProcs.count - first;
+    DBG_PRINTF(10, "dispatch=%p, fixed up %d of %d extension procs "
+               "(%lu fixups, %lu procs fixed for this table)\n",
+               dispatch, extProcs.count - first, extProcs.count,
+               dispatch->numFixups, dispatch->numProcsFixed);
 
-            tbl[curProc->offset] = procAddr ? procAddr : (void *)noop_func;
-            DBG_PRINTF(20, "extProc procName=%s, addr=%p, noop=%p\n",
-                       curProc->procName, procAddr, noop_func);
-        }
+    // An overlay's overrides take precedence over anything from the vendor.
+    if (first < extProcs.count) {
+        ApplyOverrides(dispatch);
     }
 
     dispatch->generation = latestGeneration;
+    dispatch->fixupTime += glvndLockStatsGetTime() - start;
 }
 
-static __GLdispatchProcEntry *FindProcInList(const char *procName,
-                                             struct glvnd_list *list)
+/*
+ * Fix up every dispatch table which is current on some thread. Procs are only
+ * given offsets by OfferNewProc(), never by a fixup, so one pass brings every
+ * table up to date. Calls to this function must be protected by the dispatch
+ * lock.
+ */
+static void FixupCurrentDispatchTables(void)
 {
-    DBG_PRINTF(20, "%s\n", procName);
-    __GLdispatchProcEntry *curProc;
+    __GLdispatchTable *curDispatch;
+
     CheckDispatchLocked();
-    glvnd_list_for_each_entry(curProc, list, entry) {
-        if (!strcmp(curProc->procName, procName)) {
-            DBG_PRINTF(20, "yes\n");
-            return curProc;
+
+    glvnd_list_for_each_entry(curDispatch, &currentDispatchList, entry) {
+        if (curDispatch->generation < latestGeneration) {
+            FixupDispatchTable(curDispatch);
         }
     }
+}
 
-    DBG_PRINTF(20, "no\n");
-    return NULL;
+/*
+ * Publishes the procs that AssignNewProc() has moved to extProcs since the
+ * last call. Calls to this function must be protected by the dispatch lock.
+ */
+static void CommitNewProcs(void)
+{
+    CheckDispatchLocked();
+
+    latestGeneration++;
+
+    /*
+     * With lazy dispatch, every slot that didn't have a function when a table
+     * was built starts out with a resolver trampoline, so a table that's
+     * current on another thread will look up the new procs by itself if
+     * they're called. Its fixup can wait until it's made current or
+     * validated again. Otherwise, the current tables have to be fixed up now,
+     * before anything calls through the new stubs.
+     */
+    if (!lazyDispatch) {
+        FixupCurrentDispatchTables();
+    }
+}
+
+static __GLdispatchProcEntry *FindNewProc(const char *procName)
+{
+    DBG_PRINTF(20, "%s\n", procName);
+    __GLdispatchProcEntry *curProc;
+    CheckDispatchLocked();
+    HASH_FIND_STR(newProcHash, procName, curProc);
+
+    DBG_PRINTF(20, "%s\n", curProc ? "yes" : "no");
+    return curProc;
 }
 
 PUBLIC __GLdispatchProc __glDispatchGetProcAddress(const char *procName)
 {
-    GLint offset;
+    __GLdispatchProcEntry *pEntry;
     _glapi_proc addr;
 
     /*
@@ -248,61 +821,155 @@ PUBLIC __GLdispatchProc __glDispatchGetProcAddress(const char *procName)
      */
     LockDispatch();
 
-    addr = _glapi_get_proc_address(procName);
+    /*
+     * If the function already has a stub, then it's a core function, an
+     * extension function that a vendor recognized, or a name that was looked
+     * up before there were any vendors to ask. Any procs landed in extProcs
+     * already have a valid offset, and a proc that's still on the newProcList
+     * has already been offered to every vendor, so there's nothing more to
+     * do.
+     */
+    addr = _glapi_find_proc_address(procName);
 
     DBG_PRINTF(20, "addr=%p\n", addr);
-    if (addr) {
-        /*
-         * Newly-generated entrypoints receive a temporary dispatch offset of
-         * -1 until they are given a real offset later by _glapi_add_dispatch().
-         * If this entrypoint hasn't already been added to the newProcList,
-         * do so now, and fix up tables accordingly. Any procs landed in the
-         * extProcList should already have a valid offset assigned to them,
-         * and hence we don't need to search that list as well.
-         */
-        offset = _glapi_get_proc_offset(procName);
-        if ((offset == -1) &&
-            !FindProcInList(procName, &newProcList)) {
-            __GLdispatchTable *curDispatch;
-            __GLdispatchProcEntry *pEntry = malloc(sizeof(*pEntry));
-            pEntry->procName = strdup(procName);
+    if (!addr && (strncmp(procName, "gl", 2) == 0)) {
+        pEntry = FindNewProc(procName);
+        if (!pEntry) {
+            pEntry = malloc(sizeof(*pEntry));
+            pEntry->procName = pEntry ? strdup(procName) : NULL;
+            if (!pEntry || !pEntry->procName) {
+                free(pEntry);
+                UnlockDispatch();
+                return NULL;
+            }
             pEntry->offset = -1; // To be assigned later
-
-            /*
-             * Bump the latestGeneration, then assign it to this proc.
-             */
-            pEntry->generation = ++latestGeneration;
+            pEntry->generation = 0;
 
             glvnd_list_add(&pEntry->entry, &newProcList);
-
-            /*
-             * Fixup any current dispatch tables to contain the right pointer
-             * to this proc.
-             */
-            glvnd_list_for_each_entry(curDispatch, &currentDispatchList, entry) {
-                FixupDispatchTable(curDispatch);
+            HASH_ADD_KEYPTR(hh, newProcHash, pEntry->procName,
+                            strlen(pEntry->procName), pEntry);
+
+            if (dispatchProtos.count == 0) {
+                /*
+                 * There aren't any vendors to ask yet, and the first one
+                 * might recognize this name, so it needs a real stub. The
+                 * stub dispatches to a no-op until a vendor gives it a
+                 * prototype.
+                 */
+                addr = _glapi_get_proc_address(procName);
+            } else if (OfferNewProc(pEntry)) {
+                addr = _glapi_find_proc_address(procName);
+                CommitNewProcs();
             }
         }
+
+        /*
+         * If no vendor recognized the name, then don't use up a stub on it.
+         * A program that probes for hundreds of functions that don't exist
+         * would run out. It gets the shared no-op instead. If a vendor that's
+         * loaded later recognizes the name, then it gets a stub then.
+         */
+        if (!addr) {
+            addr = (_glapi_proc)noop_func;
+        }
     }
     UnlockDispatch();
 
     return addr;
 }
 
-PUBLIC void __glDispatchSetEntry(__GLdispatchTable *dispatch,
-                                 GLint offset,
-                                 __GLdispatchProc addr)
+PUBLIC __GLdispatchProc __glDispatchGetNoopProc(void)
 {
-    void **tbl;
+    return (__GLdispatchProc)noop_func;
+}
 
-    LockDispatch();
-    if (dispatch) {
-        tbl = (void **)dispatch->table;
-        if (tbl) {
-            tbl[offset] = addr;
+/*
+ * Returns true if an entry is one of an overlay table's overrides.
+ */
+static int IsOverride(const __GLdispatchTable *dispatch, GLint offset)
+{
+    int i;
+
+    for (i = 0; i < dispatch->numOverrides; i++) {
+        if (dispatch->overrideOffsets[i] == offset) {
+            return 1;
         }
     }
-    UnlockDispatch();
+    return 0;
+}
+
+/*
+ * Sets a single dispatch table entry. Other threads may be dispatching through
+ * the table at the same time, so the entry is written with an atomic store to
+ * make sure they never see a partially-written pointer. Calls to this function
+ * must be protected by the dispatch lock.
+ */
+static void SetEntryLocked(__GLdispatchTable *dispatch,
+                           GLint offset,
+                           __GLdispatchProc addr)
+{
+    void **tbl = (void **)dispatch->table;
+    int i;
+
+    CheckDispatchLocked();
+
+    if (!tbl || (offset < 0) ||
+        (offset >= _glapi_get_dispatch_table_size())) {
+        return;
+    }
+
+    __atomic_store_n(&tbl[offset], (void *)addr, __ATOMIC_RELEASE);
+
+    // If this is one of an overlay's overrides, then update the override as
+    // well, so that the next fixup doesn't put the old function back.
+    for (i = 0; i < dispatch->numOverrides; i++) {
+        if (dispatch->overrideOffsets[i] == offset) {
+            dispatch->overrideProcs[i] = addr;
+        }
+    }
+
+    // Pass the new entry up through any layers which don't override it.
+    if (dispatch->layerTables) {
+        __GLdispatchTable *next = dispatch;
+        __GLdispatchTable *layer;
+
+        for (i = dispatch->numLayerTables - 1; i >= 0; i--) {
+            layer = dispatch->layerTables[i];
+            if ((layer->overlayBase == next) && !IsOverride(layer, offset)) {
+                __atomic_store_n(&((void **)layer->table)[offset],
+                                 ((void **)next->table)[offset],
+                                 __ATOMIC_RELEASE);
+            }
+            next = layer;
+        }
+    }
+}
+
+PUBLIC void __glDispatchSetEntry(__GLdispatchTable *dispatch,
+                                 GLint offset,
+                                 __GLdispatchProc addr)
+{
+    LockDispatch();
+    if (dispatch) {
+        SetEntryLocked(dispatch, offset, addr);
+    }
+    UnlockDispatch();
+}
+
+PUBLIC void __glDispatchSetEntries(__GLdispatchTable *dispatch,
+                                   const GLint *offsets,
+                                   const __GLdispatchProc *addrs,
+                                   int count)
+{
+    int i;
+
+    LockDispatch();
+    if (dispatch) {
+        for (i = 0; i < count; i++) {
+            SetEntryLocked(dispatch, offsets[i], addrs[i]);
+        }
+    }
+    UnlockDispatch();
 }
 
 GLint __glDispatchGetOffset(const char *procName)
@@ -310,23 +977,89 @@ GLint __glDispatchGetOffset(const char *procName)
     return _glapi_get_proc_offset(procName);
 }
 
+GLint __glDispatchGetTableSize(void)
+{
+    return _glapi_get_dispatch_table_size();
+}
+
 PUBLIC __GLdispatchTable *__glDispatchCreateTable(__GLgetProcAddressCallback getProcAddress,
                                                   __GLgetDispatchProtoCallback getDispatchProto,
                                                   __GLdestroyVendorDataCallback destroyVendorData,
                                                   void *vendorData)
 {
-    __GLdispatchTable *dispatch = malloc(sizeof(__GLdispatchTable));
+    return __glDispatchCreateTableWithStaticDispatch(getProcAddress,
+                                                     getDispatchProto,
+                                                     destroyVendorData,
+                                                     vendorData,
+                                                     NULL);
+}
+
+PUBLIC __GLdispatchTable *__glDispatchCreateTableWithStaticDispatch(
+    __GLgetProcAddressCallback getProcAddress,
+    __GLgetDispatchProtoCallback getDispatchProto,
+    __GLdestroyVendorDataCallback destroyVendorData,
+    void *vendorData,
+    __GLgetStaticDispatchCallback getStaticDispatch)
+{
+    __GLdispatchTable *dispatch;
+
+    // Align the table so that currentThreads really does get a cache line of
+    // its own.
+    if (posix_memalign((void **)&dispatch, GLDISPATCH_CACHELINE_SIZE,
+                       sizeof(__GLdispatchTable)) != 0) {
+        return NULL;
+    }
 
     dispatch->generation = 0;
     dispatch->currentThreads = 0;
     dispatch->table = NULL;
+    dispatch->validated = 0;
+
+    dispatch->numOverrides = 0;
+    dispatch->overrideOffsets = NULL;
+    dispatch->overrideProcs = NULL;
+    dispatch->overlayBase = NULL;
+
+    dispatch->layerTables = NULL;
+    dispatch->numLayerTables = 0;
 
     dispatch->getProcAddress = getProcAddress;
     dispatch->getDispatchProto = getDispatchProto;
     dispatch->destroyVendorData = destroyVendorData;
+    dispatch->getStaticDispatch = getStaticDispatch;
 
     dispatch->vendorData = vendorData;
 
+    dispatch->buildTime = 0;
+    dispatch->numResolved = 0;
+    dispatch->numNoop = 0;
+    dispatch->numFixups = 0;
+    dispatch->numProcsFixed = 0;
+    dispatch->fixupTime = 0;
+    dispatch->numMakeCurrent = 0;
+    dispatch->peakCurrentThreads = 0;
+
+    LockDispatch();
+
+    /*
+     * The procs on the newProcList have been offered to every callback in
+     * dispatchProtos, but this might be a vendor that hasn't seen them yet.
+     */
+    if (getDispatchProto && RefDispatchProto(getDispatchProto)) {
+        __GLdispatchProcEntry *curProc, *tmpProc;
+        int assigned = 0;
+
+        glvnd_list_for_each_entry_safe(curProc, tmpProc, &newProcList, entry) {
+            assigned |= AssignNewProc(curProc, getDispatchProto);
+        }
+        if (assigned) {
+            CommitNewProcs();
+        }
+    }
+
+    glvnd_list_add(&dispatch->tableEntry, &dispatchTableList);
+    UnlockDispatch();
+
     return dispatch;
 }
 
@@ -335,53 +1068,282 @@ PUBLIC void __glDispatchDestroyTable(__GLdispatchTable *dispatch)
     // NOTE this assumes the table is not current!
     // TODO: delete the global lists
     // TODO: this is currently unused...
+    DestroyLayerTables(dispatch, dispatch->layerTables,
+                       dispatch->numLayerTables);
     LockDispatch();
-    dispatch->destroyVendorData(dispatch->vendorData);
+    if (dispatch->validated) {
+        DispatchCurrentUnref(dispatch);
+    }
+    glvnd_list_del(&dispatch->tableEntry);
+    if (dispatch->getDispatchProto) {
+        UnrefDispatchProto(dispatch->getDispatchProto);
+    }
+    if (dispatch->destroyVendorData) {
+        dispatch->destroyVendorData(dispatch->vendorData);
+    }
+    free(dispatch->overrideOffsets);
+    free(dispatch->overrideProcs);
     free(dispatch->table);
     free(dispatch);
     UnlockDispatch();
 }
 
+/*
+ * A getProcAddress callback for _glapi_init_table_from_callback() which counts
+ * how many functions the vendor provides. The private data is the dispatch
+ * table being built.
+ */
+static void *CountingGetProcAddress(const GLubyte *procName, void *data)
+{
+    __GLdispatchTable *dispatch = (__GLdispatchTable *)data;
+    void *procAddr = (*dispatch->getProcAddress)(procName,
+                                                 dispatch->vendorData);
+
+    if (procAddr) {
+        dispatch->numResolved++;
+    } else {
+        dispatch->numNoop++;
+    }
+    return procAddr;
+}
+
 static struct _glapi_table
-*CreateGLAPITable(__GLgetProcAddressCallback getProcAddress,
-                  void *vendorData)
+*CreateGLAPITable(__GLdispatchTable *dispatch)
 {
     size_t entries = _glapi_get_dispatch_table_size();
+    uint64_t start = glvndLockStatsGetTime();
     struct _glapi_table *table = (struct _glapi_table *)
         calloc(1, entries * sizeof(void *));
+    const __GLdispatchProc *staticProcs = NULL;
+    int count = 0;
+    size_t i;
 
     CheckDispatchLocked();
 
     if (table) {
-        _glapi_init_table_from_callback(table,
-                                        entries,
-                                        getProcAddress,
-                                        vendorData);
+        /*
+         * If the vendor has a prebuilt table, then start by copying it in.
+         * _glapi_init_table_from_callback() only looks up the entries which
+         * are still NULL, so if the vendor's table is complete, this saves a
+         * getProcAddress callback for every entry.
+         */
+        if (dispatch->getStaticDispatch) {
+            staticProcs = (*dispatch->getStaticDispatch)(dispatch->vendorData,
+                                                         &count);
+        }
+        if (staticProcs && (count > 0)) {
+            if (count > entries) {
+                count = entries;
+            }
+            memcpy(table, staticProcs, count * sizeof(void *));
+            for (i = 0; i < count; i++) {
+                if (!staticProcs[i]) {
+                    continue;
+                }
+                if (_glapi_get_proc_name(i)) {
+                    dispatch->numResolved++;
+                } else {
+                    // The vendor can't know what goes in a dynamic slot that
+                    // hasn't been given a function yet. Leave it for a
+                    // resolver or a later fixup.
+                    ((void **)table)[i] = NULL;
+                }
+            }
+        }
+
+        if (lazyDispatch) {
+            // Defer looking up anything else until it's called.
+            for (i = 0; i < entries; i++) {
+                if (!((void **)table)[i]) {
+                    ((void **)table)[i] = (void *)_glapi_get_resolver(i);
+                }
+            }
+        } else {
+            _glapi_init_table_from_callback(table,
+                                            entries,
+                                            CountingGetProcAddress,
+                                            dispatch);
+        }
+
+        dispatch->buildTime = glvndLockStatsGetTime() - start;
     }
 
     return table;
 }
 
+PUBLIC __GLdispatchTable *__glDispatchCreateOverlayTable(__GLdispatchTable *base,
+                                                         const GLint *offsets,
+                                                         const __GLdispatchProc *procs,
+                                                         int count)
+{
+    size_t entries = _glapi_get_dispatch_table_size();
+    __GLdispatchTable *dispatch;
+    struct _glapi_table *table;
+    uint64_t start;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        if ((offsets[i] < 0) || (offsets[i] >= entries)) {
+            return NULL;
+        }
+    }
+
+    /*
+     * The overlay looks up new extension functions with the base table's
+     * callbacks and data. The vendor data belongs to the base table, so the
+     * overlay doesn't get a destroyVendorData callback.
+     */
+    dispatch = __glDispatchCreateTable(base->getProcAddress,
+                                       base->getDispatchProto,
+                                       NULL,
+                                       base->vendorData);
+    if (!dispatch) {
+        return NULL;
+    }
+    dispatch->overlayBase = base;
+
+    if (count > 0) {
+        dispatch->overrideOffsets = malloc(count * sizeof(GLint));
+        dispatch->overrideProcs = malloc(count * sizeof(__GLdispatchProc));
+        if (!dispatch->overrideOffsets || !dispatch->overrideProcs) {
+            goto fail;
+        }
+        memcpy(dispatch->overrideOffsets, offsets, count * sizeof(GLint));
+        memcpy(dispatch->overrideProcs, procs,
+               count * sizeof(__GLdispatchProc));
+        dispatch->numOverrides = count;
+    }
+
+    dispatch->table = malloc(entries * sizeof(void *));
+    if (!dispatch->table) {
+        goto fail;
+    }
+
+    LockDispatch();
+
+    // Make sure the base table is built and up to date before copying it.
+    if (!base->table) {
+        table = CreateGLAPITable(base);
+        if (!table) {
+            UnlockDispatch();
+            goto fail;
+        }
+        __sync_synchronize();
+        base->table = table;
+    }
+    if (base->generation < latestGeneration) {
+        FixupDispatchTable(base);
+        FixupCurrentDispatchTables();
+    }
+
+    start = glvndLockStatsGetTime();
+    memcpy(dispatch->table, base->table, entries * sizeof(void *));
+    ApplyOverrides(dispatch);
+    dispatch->generation = base->generation;
+    dispatch->numResolved = base->numResolved;
+    dispatch->numNoop = base->numNoop;
+    dispatch->buildTime = glvndLockStatsGetTime() - start;
+
+    UnlockDispatch();
+
+    return dispatch;
+
+fail:
+    __glDispatchDestroyTable(dispatch);
+    return NULL;
+}
+
+/*
+ * Returns the table to install for a make current, which is the profiling or
+ * capture table if either is enabled, or else the head of the table's layer
+ * chain.
+ */
+static inline struct _glapi_table *InstalledTable(__GLdispatchTable *dispatch)
+{
+    return interposeDispatch ? interposeDispatch->table :
+        __glDispatchLayerHead(dispatch);
+}
+
+/*
+ * Records which table a make current took a reference to. The previous API
+ * state, if it's a different one, no longer holds a reference.
+ */
+static inline void SetCurrentDispatch(__GLdispatchAPIState *apiState,
+                                      __GLdispatchAPIState *curApiState,
+                                      __GLdispatchTable *dispatch)
+{
+    if (curApiState && (curApiState != apiState)) {
+        curApiState->currentDispatch = NULL;
+    }
+    apiState->currentDispatch = dispatch;
+}
+
 PUBLIC void __glDispatchMakeCurrent(__GLdispatchAPIState *apiState)
 {
     __GLdispatchAPIState *curApiState = (__GLdispatchAPIState *)
         _glapi_get_current(CURRENT_API_STATE);
     __GLdispatchTable *dispatch = apiState->dispatch;
-    __GLdispatchTable *curDispatch = curApiState ? curApiState->dispatch : NULL;
+    /*
+     * Use the table we took a reference to for the current API state, not
+     * curApiState->dispatch. The winsys library may have already replaced
+     * that, since apiState and curApiState are often the same structure.
+     */
+    __GLdispatchTable *curDispatch =
+        curApiState ? curApiState->currentDispatch : NULL;
+
+    DBG_PRINTF(20, "dispatch=%p\n", dispatch);
+
+    // Layers call back into GLdispatch to create their tables, so the chain
+    // has to be built before taking the dispatch lock.
+    if (numLayers && !dispatch->layerTables) {
+        BuildLayerChain(dispatch);
+    }
+
+    /*
+     * Fast path: if the table is up to date and either already current on
+     * this thread or current on some other thread, then it's already on the
+     * currentDispatchList and we don't need the dispatch lock to install it.
+     * If we're profiling or capturing, then the table that gets installed
+     * has to be up to date, too.
+     */
+    if (dispatch->table &&
+        (dispatch->generation == latestGeneration) &&
+        (!interposeDispatch ||
+         (interposeDispatch->generation == latestGeneration)) &&
+        ((curDispatch == dispatch) || DispatchCurrentTryRef(dispatch))) {
+
+        if (curDispatch && (curDispatch != dispatch) &&
+            !DispatchCurrentTryUnref(curDispatch)) {
+            LockDispatch();
+            DispatchCurrentUnref(curDispatch);
+            UnlockDispatch();
+        }
+        SetCurrentDispatch(apiState, curApiState, dispatch);
+
+        _glapi_set_dispatch(InstalledTable(dispatch));
+
+        _glapi_set_current(apiState->context, CURRENT_CONTEXT);
+        _glapi_set_current(apiState, CURRENT_API_STATE);
+        return;
+    }
 
     // We need to fix up the dispatch table if it hasn't been
     // initialized, or there are new dynamic entries which were
     // added since the last time make current was called.
     LockDispatch();
-    DBG_PRINTF(20, "dispatch=%p\n", dispatch);
 
     if (!dispatch->table ||
         (dispatch->generation < latestGeneration)) {
 
         // Lazily create the dispatch table if we haven't already
         if (!dispatch->table) {
-            dispatch->table = CreateGLAPITable(dispatch->getProcAddress,
-                                               dispatch->vendorData);
+            struct _glapi_table *table = CreateGLAPITable(dispatch);
+
+            // Make sure the contents of the table are visible to other
+            // threads before the pointer is, since the fast path above reads
+            // it without the lock.
+            __sync_synchronize();
+            dispatch->table = table;
         }
 
         FixupDispatchTable(dispatch);
@@ -392,6 +1354,15 @@ PUBLIC void __glDispatchMakeCurrent(__GLdispatchAPIState *apiState)
             DispatchCurrentUnref(curDispatch);
         }
         DispatchCurrentRef(dispatch);
+        DispatchCurrentRefStats(dispatch, dispatch->currentThreads);
+    }
+    SetCurrentDispatch(apiState, curApiState, dispatch);
+
+    // With lazy dispatch, the profiling or capture table isn't fixed up when
+    // a new extension function is added, so catch it up before installing it.
+    if (interposeDispatch &&
+        (interposeDispatch->generation < latestGeneration)) {
+        FixupDispatchTable(interposeDispatch);
     }
 
     /*
@@ -401,7 +1372,7 @@ PUBLIC void __glDispatchMakeCurrent(__GLdispatchAPIState *apiState)
      * XXX: this would be cleaner if this used
      * _glapi_set_current(dispatch->table, CURRENT_DISPATCH)
      */
-    _glapi_set_dispatch(dispatch->table);
+    _glapi_set_dispatch(InstalledTable(dispatch));
 
     DBG_PRINTF(20, "done\n");
     UnlockDispatch();
@@ -417,13 +1388,1075 @@ PUBLIC void __glDispatchLoseCurrent(void)
 
     DBG_PRINTF(20, "\n");
 
-    if (curApiState) {
-        LockDispatch();
-        DispatchCurrentUnref(curApiState->dispatch);
-        UnlockDispatch();
+    if (curApiState && curApiState->currentDispatch) {
+        if (!DispatchCurrentTryUnref(curApiState->currentDispatch)) {
+            LockDispatch();
+            DispatchCurrentUnref(curApiState->currentDispatch);
+            UnlockDispatch();
+        }
+        curApiState->currentDispatch = NULL;
     }
 
     _glapi_set_current(NULL, CURRENT_API_STATE);
     _glapi_set_current(NULL, CURRENT_CONTEXT);
     _glapi_set_dispatch(NULL);
 }
+
+/*
+ * Builds a table and keeps it up to date. This is __glDispatchValidateTable()
+ * without the layer chain, for tables which are never made current
+ * themselves.
+ */
+static GLboolean ValidateTable(__GLdispatchTable *dispatch)
+{
+    struct _glapi_table *table;
+
+    LockDispatch();
+
+    if (!dispatch->table) {
+        table = CreateGLAPITable(dispatch);
+        if (!table) {
+            UnlockDispatch();
+            return GL_FALSE;
+        }
+        __sync_synchronize();
+        dispatch->table = table;
+    }
+
+    /*
+     * Holding a reference keeps the table on the current dispatch list, so
+     * it gets fixed up along with every other current table whenever a new
+     * extension function is added. That way, __glDispatchSwapTable() can
+     * install it without checking the generation.
+     */
+    if (!dispatch->validated) {
+        DispatchCurrentRef(dispatch);
+        dispatch->validated = 1;
+    }
+
+    FixupCurrentDispatchTables();
+
+    UnlockDispatch();
+
+    return GL_TRUE;
+}
+
+PUBLIC GLboolean __glDispatchValidateTable(__GLdispatchTable *dispatch)
+{
+    if (numLayers && !dispatch->layerTables) {
+        BuildLayerChain(dispatch);
+    }
+    return ValidateTable(dispatch);
+}
+
+PUBLIC void __glDispatchInvalidateTable(__GLdispatchTable *dispatch)
+{
+    LockDispatch();
+    if (dispatch->validated) {
+        DispatchCurrentUnref(dispatch);
+        dispatch->validated = 0;
+    }
+    UnlockDispatch();
+}
+
+PUBLIC void __glDispatchSwapTable(__GLdispatchTable *dispatch)
+{
+    __GLdispatchAPIState *apiState = (__GLdispatchAPIState *)
+        _glapi_get_current(CURRENT_API_STATE);
+
+    assert(dispatch->validated);
+    assert(apiState);
+
+    // The reference for the make current stays with
+    // apiState->currentDispatch, so this doesn't need any bookkeeping. If
+    // we're profiling or capturing, then the profiling or capture table stays
+    // installed and forwards to the new table.
+    apiState->dispatch = dispatch;
+    if (!interposeDispatch) {
+        _glapi_swap_dispatch(__glDispatchLayerHead(dispatch));
+    }
+}
+
+PUBLIC GLboolean __glDispatchAddLayer(__GLdispatchLayerInitFunc init)
+{
+    __GLdispatchLayer *newLayers;
+    GLboolean ret = GL_FALSE;
+
+    if (lazyDispatch) {
+        return GL_FALSE;
+    }
+
+    LockDispatch();
+
+    newLayers = realloc(layers, (numLayers + 1) * sizeof(__GLdispatchLayer));
+    if (newLayers) {
+        layers = newLayers;
+        memset(&layers[numLayers], 0, sizeof(__GLdispatchLayer));
+        if (init(GLDISPATCH_LAYER_VERSION, numLayers, &layers[numLayers]) &&
+            layers[numLayers].createTable) {
+            numLayers++;
+            ret = GL_TRUE;
+        }
+    }
+
+    UnlockDispatch();
+
+    return ret;
+}
+
+/*
+ * Loads a layer library and adds its layer.
+ */
+static void LoadLayer(const char *name)
+{
+    __GLdispatchLayerInitFunc init;
+    void *handle;
+
+    handle = dlopen(name, RTLD_LAZY);
+    if (!handle) {
+        DBG_PRINTF(0, "Can't load layer %s: %s\n", name, dlerror());
+        return;
+    }
+
+    init = (__GLdispatchLayerInitFunc)dlsym(handle, GLDISPATCH_LAYER_INIT_NAME);
+    if (!init || !__glDispatchAddLayer(init)) {
+        DBG_PRINTF(0, "Can't initialize layer %s\n", name);
+        dlclose(handle);
+    }
+}
+
+/*
+ * Loads the layers listed in the __GL_LAYERS environment variable, or else in
+ * the layers config file. The environment variables are ignored for setuid
+ * programs.
+ */
+static void LoadLayers(void)
+{
+    const char *layersStr = NULL;
+    const char *configName = NULL;
+    char *str, *name, *end, *saveptr;
+    char line[1024];
+    FILE *config;
+
+    if (getuid() == geteuid()) {
+        layersStr = getenv("__GL_LAYERS");
+        configName = getenv("__GL_LAYERS_CONFIG");
+    }
+
+    if (layersStr) {
+        str = strdup(layersStr);
+        if (!str) {
+            return;
+        }
+        for (name = strtok_r(str, ":", &saveptr); name != NULL;
+             name = strtok_r(NULL, ":", &saveptr)) {
+            LoadLayer(name);
+        }
+        free(str);
+        return;
+    }
+
+    config = fopen(configName ? configName : GLDISPATCH_LAYERS_CONFIG, "r");
+    if (!config) {
+        return;
+    }
+
+    // One library per line. Blank lines and anything after a '#' are ignored.
+    while (fgets(line, sizeof(line), config)) {
+        if ((end = strchr(line, '#')) != NULL) {
+            *end = '\0';
+        }
+        for (name = line; isspace((unsigned char)*name); name++) {
+        }
+        end = name + strlen(name);
+        while (end > name && isspace((unsigned char)end[-1])) {
+            end--;
+        }
+        *end = '\0';
+
+        if (name[0]) {
+            LoadLayer(name);
+        }
+    }
+
+    fclose(config);
+}
+
+/*
+ * Builds the chain of layer tables on top of a table. The layers call back
+ * into GLdispatch to create their tables, so this must be called without the
+ * dispatch lock.
+ */
+static void BuildLayerChain(__GLdispatchTable *dispatch)
+{
+    __GLdispatchLayer *chainLayers;
+    __GLdispatchTable **tables;
+    __GLdispatchTable *next, *layer;
+    size_t size;
+    int count;
+    int i;
+
+    // Take a snapshot of the layers, since another thread could add one
+    // while we're calling into them.
+    LockDispatch();
+    count = numLayers;
+    chainLayers = malloc(count * sizeof(__GLdispatchLayer));
+    if (chainLayers) {
+        memcpy(chainLayers, layers, count * sizeof(__GLdispatchLayer));
+    }
+    UnlockDispatch();
+
+    tables = malloc(count * sizeof(__GLdispatchTable *));
+    if (!chainLayers || !tables) {
+        free(chainLayers);
+        free(tables);
+        return;
+    }
+
+    // Build the chain from the bottom up, so that each layer gets the table
+    // below it.
+    next = dispatch;
+    for (i = count - 1; i >= 0; i--) {
+        layer = chainLayers[i].createTable(next, chainLayers[i].layerData);
+        if (layer && (layer != next) && !ValidateTable(layer)) {
+            if (chainLayers[i].destroyTable) {
+                chainLayers[i].destroyTable(layer, chainLayers[i].layerData);
+            } else {
+                __glDispatchDestroyTable(layer);
+            }
+            layer = NULL;
+        }
+        tables[i] = layer ? layer : next;
+        next = tables[i];
+    }
+
+    free(chainLayers);
+
+    LockDispatch();
+    if (dispatch->layerTables) {
+        // Another thread got here first.
+        UnlockDispatch();
+        DestroyLayerTables(dispatch, tables, count);
+        return;
+    }
+
+    /*
+     * Each overlay copied the table below it when it was created, so bring
+     * them up to date with any entries that were set since then. Nothing is
+     * dispatching through these tables yet. The layer tables are validated,
+     * so they're already up to date with any new extension functions, but
+     * the vendor's table might not be.
+     */
+    if (dispatch->table && (dispatch->generation < latestGeneration)) {
+        FixupDispatchTable(dispatch);
+        FixupCurrentDispatchTables();
+    }
+    size = _glapi_get_dispatch_table_size() * sizeof(void *);
+    next = dispatch;
+    for (i = count - 1; i >= 0; i--) {
+        layer = tables[i];
+        if ((layer != next) && (layer->overlayBase == next) &&
+            next->table && layer->table) {
+            memcpy(layer->table, next->table, size);
+            ApplyOverrides(layer);
+        }
+        next = layer;
+    }
+
+    dispatch->numLayerTables = count;
+    __sync_synchronize();
+    dispatch->layerTables = tables;
+    UnlockDispatch();
+}
+
+/*
+ * Destroys the layer tables of a chain, from the top down, since each one
+ * might depend on the table below it. This must be called without the
+ * dispatch lock.
+ */
+static void DestroyLayerTables(__GLdispatchTable *dispatch,
+                               __GLdispatchTable **tables, int count)
+{
+    __GLdispatchTable *next;
+    __GLdispatchLayer layer;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        next = (i + 1 < count) ? tables[i + 1] : dispatch;
+        if (tables[i] == next) {
+            continue;
+        }
+
+        LockDispatch();
+        layer = layers[i];
+        UnlockDispatch();
+
+        if (layer.destroyTable) {
+            layer.destroyTable(tables[i], layer.layerData);
+        } else {
+            __glDispatchDestroyTable(tables[i]);
+        }
+    }
+    free(tables);
+}
+
+PUBLIC const __GLdispatchProc *__glDispatchGetLayerNext(int layerIndex)
+{
+    __GLdispatchAPIState *apiState = (__GLdispatchAPIState *)
+        _glapi_get_current(CURRENT_API_STATE);
+    __GLdispatchTable *dispatch = apiState->dispatch;
+
+    if (layerIndex + 1 < dispatch->numLayerTables) {
+        return (const __GLdispatchProc *)
+            dispatch->layerTables[layerIndex + 1]->table;
+    }
+    return (const __GLdispatchProc *)dispatch->table;
+}
+
+PUBLIC int __glDispatchGetStats(__GLdispatchTableStats *stats, int maxCount)
+{
+    __GLdispatchTable *cur;
+    int count = 0;
+
+    LockDispatch();
+    glvnd_list_for_each_entry(cur, &dispatchTableList, tableEntry) {
+        if (count < maxCount) {
+            stats[count].table = cur;
+            stats[count].vendorData = cur->vendorData;
+            stats[count].buildTime = cur->buildTime;
+            stats[count].numResolved = cur->numResolved;
+            stats[count].numNoop = cur->numNoop;
+            stats[count].numFixups = cur->numFixups;
+            stats[count].numProcsFixed = cur->numProcsFixed;
+            stats[count].fixupTime = cur->fixupTime;
+            stats[count].numMakeCurrent = cur->numMakeCurrent;
+            stats[count].peakCurrentThreads = cur->peakCurrentThreads;
+        }
+        count++;
+    }
+    UnlockDispatch();
+
+    return count;
+}
+
+PUBLIC GLboolean __glDispatchLockStatsEnabled(void)
+{
+    return glvndLockStatsEnabled ? GL_TRUE : GL_FALSE;
+}
+
+/*
+ * Keeps a lock's final statistics when the owner unregisters them. Other
+ * libraries unregister their locks from their destructors, which run before
+ * PrintLockStats() at exit, so otherwise their statistics would never be
+ * printed. A library can be loaded and unloaded any number of times, so the
+ * statistics are added to the retired entry with the same name if there is
+ * one, rather than making a new copy each time. Calls to this function must
+ * be protected by the dispatch lock.
+ */
+static void RetireLockStats(const GLVNDlockStats *stats)
+{
+    GLVNDlockStats *retired;
+    int i;
+
+    CheckDispatchLocked();
+
+    if (stats->numAcquires == 0) {
+        return;
+    }
+
+    for (retired = retiredLockStatsList; retired; retired = retired->next) {
+        if (!strcmp(retired->name, stats->name)) {
+            break;
+        }
+    }
+
+    if (!retired) {
+        retired = calloc(1, sizeof(*retired));
+        if (!retired) {
+            return;
+        }
+        retired->name = strdup(stats->name);
+        if (!retired->name) {
+            free(retired);
+            return;
+        }
+        retired->next = retiredLockStatsList;
+        retiredLockStatsList = retired;
+    }
+
+    retired->numAcquires += stats->numAcquires;
+    retired->numContended += stats->numContended;
+    retired->totalWaitTime += stats->totalWaitTime;
+    retired->numHolds += stats->numHolds;
+    retired->totalHoldTime += stats->totalHoldTime;
+    if (stats->maxWaitTime > retired->maxWaitTime) {
+        retired->maxWaitTime = stats->maxWaitTime;
+    }
+    if (stats->maxHoldTime > retired->maxHoldTime) {
+        retired->maxHoldTime = stats->maxHoldTime;
+    }
+    for (i = 0; i < GLVND_LOCK_STATS_NUM_BUCKETS; i++) {
+        retired->waitHistogram[i] += stats->waitHistogram[i];
+        retired->holdHistogram[i] += stats->holdHistogram[i];
+    }
+}
+
+PUBLIC void __glDispatchRegisterLockStats(GLVNDlockStats *stats)
+{
+    LockDispatch();
+    if (!stats->registered) {
+        stats->next = lockStatsList;
+        lockStatsList = stats;
+        stats->registered = 1;
+    }
+    UnlockDispatch();
+}
+
+PUBLIC void __glDispatchUnregisterLockStats(GLVNDlockStats *stats)
+{
+    GLVNDlockStats **prev;
+
+    LockDispatch();
+    for (prev = &lockStatsList; *prev; prev = &(*prev)->next) {
+        if (*prev == stats) {
+            *prev = stats->next;
+            stats->next = NULL;
+            stats->registered = 0;
+            RetireLockStats(stats);
+            break;
+        }
+    }
+    UnlockDispatch();
+}
+
+PUBLIC int __glDispatchGetLockStats(GLVNDlockStats *stats, int maxCount)
+{
+    GLVNDlockStats *cur;
+    int count = 0;
+
+    LockDispatch();
+    for (cur = lockStatsList; cur; cur = cur->next) {
+        if (count < maxCount) {
+            stats[count] = *cur;
+            stats[count].next = NULL;
+        }
+        count++;
+    }
+    for (cur = retiredLockStatsList; cur; cur = cur->next) {
+        if (count < maxCount) {
+            stats[count] = *cur;
+            stats[count].next = NULL;
+        }
+        count++;
+    }
+    UnlockDispatch();
+
+    return count;
+}
+
+static void PrintLockHistogram(const char *label, const uint64_t *histogram)
+{
+    int i;
+
+    fprintf(stderr, "    %s:", label);
+    for (i = 0; i < GLVND_LOCK_STATS_NUM_BUCKETS; i++) {
+        if (histogram[i]) {
+            fprintf(stderr, " %lluns=%llu",
+                    (i == 0) ? 0ULL : (1ULL << i),
+                    (unsigned long long)histogram[i]);
+        }
+    }
+    fprintf(stderr, "\n");
+}
+
+static void PrintOneLockStats(const GLVNDlockStats *stats)
+{
+    if (stats->numAcquires == 0) {
+        return;
+    }
+    fprintf(stderr, "  %s: %llu acquires, %llu contended, "
+            "wait total %lluns max %lluns, "
+            "hold total %lluns max %lluns\n",
+            stats->name,
+            (unsigned long long)stats->numAcquires,
+            (unsigned long long)stats->numContended,
+            (unsigned long long)stats->totalWaitTime,
+            (unsigned long long)stats->maxWaitTime,
+            (unsigned long long)stats->totalHoldTime,
+            (unsigned long long)stats->maxHoldTime);
+    PrintLockHistogram("wait", stats->waitHistogram);
+    PrintLockHistogram("hold", stats->holdHistogram);
+}
+
+/*
+ * Registered with atexit() if __GL_LOCK_STATS is set. Locks that were never
+ * taken are skipped, and each histogram bucket is labeled with the shortest
+ * time that it counts.
+ */
+static void PrintLockStats(void)
+{
+    GLVNDlockStats *cur;
+
+    LockDispatch();
+    fprintf(stderr, "libglvnd lock statistics:\n");
+    for (cur = lockStatsList; cur; cur = cur->next) {
+        PrintOneLockStats(cur);
+    }
+    for (cur = retiredLockStatsList; cur; cur = cur->next) {
+        PrintOneLockStats(cur);
+    }
+    UnlockDispatch();
+}
+
+/*
+ * Per-slot counters for the profiling table. The call counts are updated on
+ * every call, and the rest only on sampled calls.
+ */
+static __GLdispatchProfileStats *profileStats;
+static __GLdispatchProc *profileProcs;
+static unsigned int profileSampleInterval;
+
+#define DEFAULT_PROFILE_SAMPLE_INTERVAL 100
+
+static __GLdispatchProc ProfileEnter(int offset, unsigned long long *sample)
+{
+    __GLdispatchAPIState *apiState = (__GLdispatchAPIState *)
+        _glapi_get_current(CURRENT_API_STATE);
+    uint64_t count = __sync_add_and_fetch(&profileStats[offset].numCalls, 1);
+
+    if ((count % profileSampleInterval) == 0) {
+        *sample = glvndLockStatsGetTime();
+    }
+
+    return ((__GLdispatchProc *)
+            __glDispatchLayerHead(apiState->dispatch))[offset];
+}
+
+static void ProfileExit(int offset, unsigned long long sample)
+{
+    __GLdispatchProfileStats *stats = &profileStats[offset];
+    uint64_t time = glvndLockStatsGetTime() - sample;
+
+    __sync_fetch_and_add(&stats->numSamples, 1);
+    __sync_fetch_and_add(&stats->totalTime, time);
+    glvndLockStatsUpdateMax(&stats->maxTime, time);
+}
+
+static void *ProfileGetProcAddress(const GLubyte *procName, void *vendorData)
+{
+    GLint offset = _glapi_get_proc_offset((const char *)procName);
+
+    return (offset >= 0) ? (void *)_glapi_get_profiler(offset) : NULL;
+}
+
+static const __GLdispatchProc *ProfileGetStaticDispatch(void *vendorData,
+                                                        int *count)
+{
+    *count = _glapi_get_dispatch_table_size();
+    return profileProcs;
+}
+
+static int CompareProfileSlots(const void *a, const void *b)
+{
+    const __GLdispatchProfileStats *sa = &profileStats[*(const int *)a];
+    const __GLdispatchProfileStats *sb = &profileStats[*(const int *)b];
+    double ta = sa->numSamples ?
+        (double)sa->totalTime * sa->numCalls / sa->numSamples : 0.0;
+    double tb = sb->numSamples ?
+        (double)sb->totalTime * sb->numCalls / sb->numSamples : 0.0;
+
+    if (ta != tb) {
+        return (ta < tb) ? 1 : -1;
+    }
+    if (sa->numCalls != sb->numCalls) {
+        return (sa->numCalls < sb->numCalls) ? 1 : -1;
+    }
+    return 0;
+}
+
+/*
+ * Registered with atexit() when profiling is enabled. This prints every
+ * function that was called, sorted by its estimated total time, which is its
+ * call count times its average sampled time.
+ */
+static void PrintProfile(void)
+{
+    int entries = _glapi_get_dispatch_table_size();
+    const __GLdispatchProfileStats *stats;
+    const char *name;
+    int *slots;
+    int count = 0;
+    int i;
+
+    slots = malloc(entries * sizeof(int));
+    if (!slots) {
+        return;
+    }
+    for (i = 0; i < entries; i++) {
+        if (profileStats[i].numCalls) {
+            slots[count++] = i;
+        }
+    }
+    qsort(slots, count, sizeof(int), CompareProfileSlots);
+
+    fprintf(stderr, "libglvnd dispatch profile (1 in %u calls timed):\n",
+            profileSampleInterval);
+    fprintf(stderr, "%12s %10s %10s %10s %12s  %s\n",
+            "calls", "samples", "avg ns", "max ns", "est. ms", "function");
+    for (i = 0; i < count; i++) {
+        stats = &profileStats[slots[i]];
+        name = _glapi_get_proc_name(slots[i]);
+        fprintf(stderr, "%12llu %10llu %10llu %10llu %12.3f  gl%s\n",
+                (unsigned long long)stats->numCalls,
+                (unsigned long long)stats->numSamples,
+                (unsigned long long)(stats->numSamples ?
+                    stats->totalTime / stats->numSamples : 0),
+                (unsigned long long)stats->maxTime,
+                stats->numSamples ? ((double)stats->totalTime *
+                    stats->numCalls / stats->numSamples / 1e6) : 0.0,
+                name ? name : "(unknown)");
+    }
+
+    free(slots);
+}
+
+/*
+ * Claims the interposer for the profiling or capture table. Only the thread
+ * that claims it may set up its table, so two threads can't set up tables at
+ * the same time. The table is built without the dispatch lock, since creating
+ * and validating it take the lock. Returns GL_FALSE if it's already claimed.
+ */
+static GLboolean ClaimInterposer(void)
+{
+    GLboolean ret = GL_FALSE;
+
+    LockDispatch();
+    if (!interposeClaimed) {
+        interposeClaimed = 1;
+        ret = GL_TRUE;
+    }
+    UnlockDispatch();
+
+    return ret;
+}
+
+static void ReleaseInterposer(void)
+{
+    LockDispatch();
+    interposeClaimed = 0;
+    UnlockDispatch();
+}
+
+/*
+ * Installs a fully set-up profiling or capture table. __glDispatchMakeCurrent()
+ * and the trampolines read interposeDispatch without the lock, so everything
+ * they use has to be visible before it is.
+ */
+static void PublishInterposer(__GLdispatchTable *dispatch)
+{
+    LockDispatch();
+    __sync_synchronize();
+    interposeDispatch = dispatch;
+    UnlockDispatch();
+}
+
+PUBLIC GLboolean __glDispatchEnableProfiling(unsigned int sampleInterval)
+{
+    int entries = _glapi_get_dispatch_table_size();
+    __GLdispatchTable *dispatch;
+    int i;
+
+    if (profileDispatch) {
+        return GL_TRUE;
+    }
+    if (!ClaimInterposer()) {
+        return GL_FALSE;
+    }
+
+    _glapi_set_profile_funcs(ProfileEnter, ProfileExit);
+    if (!_glapi_get_profiler(0)) {
+        ReleaseInterposer();
+        return GL_FALSE;
+    }
+
+    profileSampleInterval = sampleInterval ? sampleInterval :
+        DEFAULT_PROFILE_SAMPLE_INTERVAL;
+    profileStats = calloc(entries, sizeof(__GLdispatchProfileStats));
+    profileProcs = malloc(entries * sizeof(__GLdispatchProc));
+    if (!profileStats || !profileProcs) {
+        goto fail;
+    }
+    for (i = 0; i < entries; i++) {
+        profileProcs[i] = (__GLdispatchProc)_glapi_get_profiler(i);
+    }
+
+    /*
+     * The profiling table is built like any other, with the trampolines as
+     * its static dispatch table. Validating it keeps it on the current list,
+     * so that it picks up new extension functions.
+     */
+    dispatch = __glDispatchCreateTableWithStaticDispatch(ProfileGetProcAddress,
+                                                         NULL,
+                                                         NULL,
+                                                         NULL,
+                                                         ProfileGetStaticDispatch);
+    if (!dispatch) {
+        goto fail;
+    }
+    if (!ValidateTable(dispatch)) {
+        __glDispatchDestroyTable(dispatch);
+        goto fail;
+    }
+
+    // __glDispatchGetProfileStats() reads profileDispatch without the lock.
+    __sync_synchronize();
+    profileDispatch = dispatch;
+    PublishInterposer(dispatch);
+    atexit(PrintProfile);
+
+    return GL_TRUE;
+
+fail:
+    free(profileStats);
+    free(profileProcs);
+    profileStats = NULL;
+    profileProcs = NULL;
+    ReleaseInterposer();
+    return GL_FALSE;
+}
+
+PUBLIC GLboolean __glDispatchGetProfileStats(GLint offset,
+                                             __GLdispatchProfileStats *stats)
+{
+    if (!profileDispatch || (offset < 0) ||
+        (offset >= _glapi_get_dispatch_table_size())) {
+        return GL_FALSE;
+    }
+
+    *stats = profileStats[offset];
+    return GL_TRUE;
+}
+
+#if defined(GLX_USE_TLS)
+
+/*
+ * State for the capture mode. The capture file is mapped in its entirety, and
+ * captureUsed is the offset of the next free chunk in it. Threads reserve
+ * chunks by atomically adding to captureUsed, so recording a call never
+ * takes a lock.
+ */
+static __GLcaptureHeader *captureHeader;
+static int captureFd = -1;
+static uint64_t captureSize;
+static volatile uint64_t captureUsed;
+static volatile uint32_t captureNumThreads;
+static volatile uint64_t captureDropped;
+static __GLdispatchProc *captureProcs;
+
+#define CAPTURE_CHUNK_SIZE (64 * 1024)
+#define DEFAULT_CAPTURE_SIZE (256 * 1024 * 1024)
+
+__thread __GLcaptureThread __glCaptureThread
+    __attribute__((tls_model("initial-exec")));
+
+/*
+ * Called from __glCaptureBegin() when the current thread's chunk is full, or
+ * if it doesn't have one yet. This reserves a new chunk and starts the record
+ * in it.
+ */
+uint64_t *__glCaptureReserve(int offset, int numArgs)
+{
+    __GLcaptureThread *thr = &__glCaptureThread;
+    uint64_t start;
+    uint64_t *chunk;
+
+    thr->pos = thr->end = NULL;
+
+    if (captureUsed + CAPTURE_CHUNK_SIZE > captureSize) {
+        __sync_fetch_and_add(&captureDropped, 1);
+        return NULL;
+    }
+    start = __sync_fetch_and_add(&captureUsed, CAPTURE_CHUNK_SIZE);
+    if (start + CAPTURE_CHUNK_SIZE > captureSize) {
+        __sync_fetch_and_add(&captureDropped, 1);
+        return NULL;
+    }
+
+    if (!thr->id) {
+        thr->id = __sync_add_and_fetch(&captureNumThreads, 1);
+    }
+
+    chunk = (uint64_t *)((char *)captureHeader + start);
+#if defined(MADV_POPULATE_WRITE)
+    // Fault in the whole chunk at once, rather than a page at a time while
+    // recording calls.
+    madvise(chunk, CAPTURE_CHUNK_SIZE, MADV_POPULATE_WRITE);
+#endif
+    chunk[0] = GL_CAPTURE_CHUNK_MAGIC | ((uint64_t)thr->id << 32);
+    thr->pos = chunk + 1;
+    thr->end = chunk + (CAPTURE_CHUNK_SIZE / sizeof(uint64_t));
+
+    return __glCaptureBegin(offset, numArgs);
+}
+
+/*
+ * Called from the forwarding trampolines in the capture table's dynamic
+ * slots. There's no generated capture function for those, so the call is
+ * recorded without its arguments.
+ */
+static __GLdispatchProc CaptureEnter(int offset, unsigned long long *sample)
+{
+    __glCaptureBegin(offset, 0);
+    return ((__GLdispatchProc *)__glCaptureTable())[offset];
+}
+
+static void CaptureExit(int offset, unsigned long long sample)
+{
+    // CaptureEnter() never asks for a sample, so this isn't called.
+}
+
+static void *CaptureGetProcAddress(const GLubyte *procName, void *vendorData)
+{
+    GLint offset = _glapi_get_proc_offset((const char *)procName);
+
+    if (offset < 0) {
+        return NULL;
+    } else if (offset < __glCaptureProcCount) {
+        return (void *)__glCaptureProcs[offset];
+    } else {
+        return (void *)_glapi_get_profiler(offset);
+    }
+}
+
+static const __GLdispatchProc *CaptureGetStaticDispatch(void *vendorData,
+                                                        int *count)
+{
+    *count = _glapi_get_dispatch_table_size();
+    return captureProcs;
+}
+
+/*
+ * Writes a name block with the names of the dynamic functions, since the
+ * decoder only knows the static ones. This is called with the dispatch lock
+ * held, so the set of dynamic functions can't change in the meantime.
+ */
+static void WriteCaptureNames(void)
+{
+    int entries = _glapi_get_dispatch_table_size();
+    const char *name;
+    size_t size = 2 * sizeof(uint64_t);
+    uint64_t start, numChunks;
+    uint64_t *words;
+    char *pos;
+    uint32_t len;
+    int i;
+
+    CheckDispatchLocked();
+
+    for (i = __glCaptureProcCount; i < entries; i++) {
+        name = _glapi_get_proc_name(i);
+        if (name) {
+            size += 2 * sizeof(uint32_t) + ((strlen(name) + 8) & ~7);
+        }
+    }
+    if (size == 2 * sizeof(uint64_t)) {
+        return;
+    }
+
+    numChunks = (size + CAPTURE_CHUNK_SIZE - 1) / CAPTURE_CHUNK_SIZE;
+    start = __sync_fetch_and_add(&captureUsed, numChunks * CAPTURE_CHUNK_SIZE);
+    if (start + numChunks * CAPTURE_CHUNK_SIZE > captureSize) {
+        return;
+    }
+
+    // The chunk is freshly mapped, so it's already zero-filled.
+    words = (uint64_t *)((char *)captureHeader + start);
+    words[0] = GL_CAPTURE_NAMES_MAGIC | (numChunks << 32);
+    pos = (char *)(words + 1);
+    for (i = __glCaptureProcCount; i < entries; i++) {
+        name = _glapi_get_proc_name(i);
+        if (name) {
+            len = strlen(name);
+            ((uint32_t *)pos)[0] = i;
+            ((uint32_t *)pos)[1] = len;
+            memcpy(pos + 2 * sizeof(uint32_t), name, len + 1);
+            pos += 2 * sizeof(uint32_t) + ((len + 8) & ~7);
+        }
+    }
+}
+
+/*
+ * Fills in the parts of the capture file header that change as calls are
+ * recorded.
+ */
+static void UpdateCaptureHeader(uint64_t size)
+{
+    captureHeader->size = size;
+    captureHeader->numThreads = captureNumThreads;
+    captureHeader->numDropped = captureDropped;
+    captureHeader->endTicks = __glCaptureTicks();
+    captureHeader->endTime = glvndLockStatsGetTime();
+}
+
+static uint64_t CaptureFileSize(void)
+{
+    uint64_t size = captureUsed;
+    return (size < captureSize) ? size : captureSize;
+}
+
+/*
+ * Registered with atexit() when capturing is enabled. This stops any more
+ * chunks from being reserved, and then truncates the file to the chunks that
+ * were used. Threads can still write to the chunks they already have, but
+ * those are all within the file.
+ */
+static void FinishCapture(void)
+{
+    uint64_t size;
+
+    LockDispatch();
+    WriteCaptureNames();
+    UnlockDispatch();
+
+    size = __sync_fetch_and_add(&captureUsed, captureSize);
+
+    if (size > captureSize) {
+        size = captureSize;
+    }
+
+    UpdateCaptureHeader(size);
+    msync(captureHeader, size, MS_SYNC);
+    if (ftruncate(captureFd, size) != 0) {
+        fprintf(stderr, "libglvnd: failed to truncate the capture file\n");
+    }
+    close(captureFd);
+    captureFd = -1;
+}
+
+#endif /* defined(GLX_USE_TLS) */
+
+PUBLIC GLboolean __glDispatchStartCapture(const char *filename,
+                                          size_t maxSize)
+{
+#if defined(GLX_USE_TLS)
+    int entries = _glapi_get_dispatch_table_size();
+    __GLdispatchTable *dispatch;
+    int i;
+
+    if (maxSize == 0) {
+        maxSize = DEFAULT_CAPTURE_SIZE;
+    }
+    // The file is the header followed by whole chunks, so that it doesn't
+    // end in a partial chunk once it's full.
+    if (maxSize < GL_CAPTURE_HEADER_SIZE + CAPTURE_CHUNK_SIZE) {
+        return GL_FALSE;
+    }
+    maxSize -= (maxSize - GL_CAPTURE_HEADER_SIZE) % CAPTURE_CHUNK_SIZE;
+
+    if (!ClaimInterposer()) {
+        return GL_FALSE;
+    }
+
+    // The dynamic slots use the profiling trampolines to forward calls, so
+    // capturing is only supported where those are.
+    _glapi_set_profile_funcs(CaptureEnter, CaptureExit);
+    if (!_glapi_get_profiler(0) || (__glCaptureProcCount > entries)) {
+        ReleaseInterposer();
+        return GL_FALSE;
+    }
+
+    captureProcs = malloc(entries * sizeof(__GLdispatchProc));
+    if (!captureProcs) {
+        ReleaseInterposer();
+        return GL_FALSE;
+    }
+    for (i = 0; i < entries; i++) {
+        if (i < __glCaptureProcCount && __glCaptureProcs[i]) {
+            captureProcs[i] = __glCaptureProcs[i];
+        } else {
+            captureProcs[i] = (__GLdispatchProc)_glapi_get_profiler(i);
+        }
+    }
+
+    captureFd = open(filename, O_RDWR | O_CREAT | O_TRUNC | O_CLOEXEC, 0644);
+    if (captureFd < 0) {
+        goto fail;
+    }
+    if (ftruncate(captureFd, maxSize) != 0) {
+        goto fail;
+    }
+    captureHeader = mmap(NULL, maxSize, PROT_READ | PROT_WRITE, MAP_SHARED,
+                         captureFd, 0);
+    if (captureHeader == MAP_FAILED) {
+        captureHeader = NULL;
+        goto fail;
+    }
+
+    captureSize = maxSize;
+    captureUsed = GL_CAPTURE_HEADER_SIZE;
+    captureHeader->magic = GL_CAPTURE_MAGIC;
+    captureHeader->version = GL_CAPTURE_VERSION;
+    captureHeader->chunkSize = CAPTURE_CHUNK_SIZE;
+    captureHeader->startTicks = __glCaptureTicks();
+    captureHeader->startTime = glvndLockStatsGetTime();
+    UpdateCaptureHeader(GL_CAPTURE_HEADER_SIZE);
+
+    // Like the profiling table, the capture table is validated so that it
+    // picks up new extension functions.
+    dispatch = __glDispatchCreateTableWithStaticDispatch(CaptureGetProcAddress,
+                                                         NULL,
+                                                         NULL,
+                                                         NULL,
+                                                         CaptureGetStaticDispatch);
+    if (!dispatch) {
+        goto fail;
+    }
+    if (!ValidateTable(dispatch)) {
+        __glDispatchDestroyTable(dispatch);
+        goto fail;
+    }
+
+    PublishInterposer(dispatch);
+    atexit(FinishCapture);
+
+    return GL_TRUE;
+
+fail:
+    if (captureHeader) {
+        munmap(captureHeader, maxSize);
+        captureHeader = NULL;
+    }
+    if (captureFd >= 0) {
+        close(captureFd);
+        unlink(filename);
+        captureFd = -1;
+    }
+    free(captureProcs);
+    captureProcs = NULL;
+    ReleaseInterposer();
+    return GL_FALSE;
+#else
+    return GL_FALSE;
+#endif
+}
+
+PUBLIC GLboolean __glDispatchFlushCapture(void)
+{
+#if defined(GLX_USE_TLS)
+    uint64_t size;
+
+    if (captureFd < 0) {
+        return GL_FALSE;
+    }
+
+    LockDispatch();
+    WriteCaptureNames();
+    UnlockDispatch();
+
+    size = CaptureFileSize();
+    UpdateCaptureHeader(size);
+    return (msync(captureHeader, size, MS_SYNC) == 0);
+#else
+    return GL_FALSE;
+#endif
+}
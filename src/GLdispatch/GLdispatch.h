@@ -33,6 +33,7 @@
 #include "glheader.h"
 #include "compiler.h"
 #include "glvnd_pthread.h"
+#include "glvnd_lockstats.h"
 
 /*!
  * \defgroup gldispatch core GL/GLES dispatch and TLS module
@@ -62,6 +63,8 @@ typedef GLboolean (*__GLgetDispatchProtoCallback)(const GLubyte *procName,
                                                   char ***function_names,
                                                   char **parameter_signature);
 typedef void (*__GLdestroyVendorDataCallback)(void *vendorData);
+typedef const __GLdispatchProc *(*__GLgetStaticDispatchCallback)(
+    void *vendorData, int *count);
 
 /* Opaque dispatch table structure. */
 typedef struct __GLdispatchTableRec __GLdispatchTable;
@@ -99,6 +102,14 @@ typedef struct __GLdispatchAPIStateRec {
      */
     __GLdispatchTable *dispatch;
 
+    /*!
+     * The dispatch table which GLdispatch holds a current reference to on
+     * behalf of this API state. This is private to GLdispatch, and is how it
+     * tells which table to release when the winsys library changes dispatch
+     * before calling __glDispatchMakeCurrent().
+     */
+    __GLdispatchTable *currentDispatch;
+
     /*!
      * The current (vendor-specific) GL context
      */
@@ -107,15 +118,33 @@ typedef struct __GLdispatchAPIStateRec {
 
 /*!
  * Initialize GLdispatch with pthreads functions needed for locking.
+ *
+ * If the __GL_LAZY_DISPATCH environment variable is set to a non-zero value,
+ * then dispatch tables are built lazily: rather than looking up every function
+ * from the vendor when a table is first made current, each function is looked
+ * up the first time it's called. Lazy dispatch is disabled if any interposer
+ * layers are loaded; see __glDispatchAddLayer().
  */
 PUBLIC void __glDispatchInit(GLVNDPthreadFuncs *funcs);
 
 /*!
  * Get a dispatch stub suitable for returning to the application from
  * GetProcAddress().
+ *
+ * A function that isn't a core GL function only gets its own stub once a
+ * vendor's getDispatchProto callback recognizes it, or if there isn't any
+ * vendor to ask yet. Otherwise, this returns the shared no-op from
+ * __glDispatchGetNoopProc(), and a later call might return a real stub if a
+ * vendor that's loaded in the meantime recognizes the name.
  */
 PUBLIC __GLdispatchProc __glDispatchGetProcAddress(const char *procName);
 
+/*!
+ * Returns the no-op function that __glDispatchGetProcAddress() returns for
+ * names that no vendor recognizes. Callers shouldn't cache it.
+ */
+PUBLIC __GLdispatchProc __glDispatchGetNoopProc(void);
+
 /*!
  * Create a new dispatch table in GLdispatch. This reference hangs off the
  * client GLX or EGL context, and is passed into GLdispatch during make current.
@@ -125,7 +154,10 @@ PUBLIC __GLdispatchProc __glDispatchGetProcAddress(const char *procName);
  * query addresses of functions from the vendor. This callback also takes
  * a pointer to vendor-private data.
  * \param [in] getDispatchProto a vendor library callback GLdispatch can use to
- * query prototypes of functions it doesn't know about from the vendor.
+ * query prototypes of functions it doesn't know about from the vendor. Each
+ * name is only asked about once per callback: when the name is first passed
+ * to __glDispatchGetProcAddress(), or when the table is created. This may be
+ * NULL if the table doesn't add any functions.
  * \param [in] destroyVendorData a vendor library callback to destroy private
  * data when the dispatch table is destroyed.
  * \param [in] vendorData a pointer to vendor library private data, which can
@@ -138,6 +170,50 @@ PUBLIC __GLdispatchTable *__glDispatchCreateTable(
     void *vendorData
 );
 
+/*!
+ * The same as __glDispatchCreateTable(), but with a vendor library callback
+ * which returns a prebuilt table.
+ *
+ * \param [in] getStaticDispatch an optional vendor library callback which
+ * returns an array of function pointers indexed by dispatch offset, and the
+ * number of entries in it. If this is provided, GLdispatch copies the array
+ * into the table when it's built, and only calls getProcAddress for the
+ * entries which are missing or NULL. It's passed vendorData. This may be NULL.
+ */
+PUBLIC __GLdispatchTable *__glDispatchCreateTableWithStaticDispatch(
+    __GLgetProcAddressCallback getProcAddress,
+    __GLgetDispatchProtoCallback getDispatchProto,
+    __GLdestroyVendorDataCallback destroyVendorData,
+    void *vendorData,
+    __GLgetStaticDispatchCallback getStaticDispatch
+);
+
+/*!
+ * Create an overlay dispatch table in GLdispatch. The new table starts out as
+ * a copy of the base table, with the given entries replaced. The overrides
+ * are kept with the table, so they stay in place when the table is fixed up
+ * for new extension functions. The overlay uses the base table's callbacks
+ * and vendor data to look up everything else, so the base table must outlive
+ * it.
+ *
+ * This is much cheaper than creating a new table with
+ * __glDispatchCreateTable() when the new table only differs from an existing
+ * one in a few entries.
+ *
+ * \param [in] base The table to copy.
+ * \param [in] offsets The offsets of the entries to override, as returned by
+ * __glDispatchGetOffset().
+ * \param [in] procs The functions to use for each of those entries.
+ * \param [in] count The number of entries in offsets and procs.
+ * \return The new table, or NULL on failure.
+ */
+PUBLIC __GLdispatchTable *__glDispatchCreateOverlayTable(
+    __GLdispatchTable *base,
+    const GLint *offsets,
+    const __GLdispatchProc *procs,
+    int count
+);
+
 /*!
  * Destroy a dispatch table in GLdispatch.
  */
@@ -155,6 +231,114 @@ PUBLIC void __glDispatchMakeCurrent(__GLdispatchAPIState *apiState);
  */
 PUBLIC void __glDispatchLoseCurrent(void);
 
+/*!
+ * This prepares a dispatch table for use with __glDispatchSwapTable(). It
+ * builds the table if necessary and keeps it up to date with any new
+ * extension functions until __glDispatchInvalidateTable() is called, so that
+ * swapping it in doesn't need any further bookkeeping. Returns GL_FALSE on
+ * failure.
+ */
+PUBLIC GLboolean __glDispatchValidateTable(__GLdispatchTable *dispatch);
+
+/*!
+ * This undoes __glDispatchValidateTable().
+ *
+ * GLdispatch doesn't keep track of which threads have swapped a table in, so
+ * the caller must make sure that no thread still has this table installed
+ * with __glDispatchSwapTable() before invalidating it, by swapping in another
+ * table or by calling __glDispatchMakeCurrent() or __glDispatchLoseCurrent()
+ * on that thread. Otherwise, the table can be dropped from the list of tables
+ * that get fixed up when a new extension function is added, and it may not
+ * get fixed up for the threads still using it.
+ */
+PUBLIC void __glDispatchInvalidateTable(__GLdispatchTable *dispatch);
+
+/*!
+ * This replaces the current thread's dispatch table with the given one, which
+ * must have been validated with __glDispatchValidateTable(). The current API
+ * state and context are unchanged. This is only valid while some context is
+ * current, and the table is only installed until the next make current or
+ * lose current.
+ */
+PUBLIC void __glDispatchSwapTable(__GLdispatchTable *dispatch);
+
+/*!
+ * The version of the layer interface, which is passed to a layer's init
+ * function.
+ */
+#define GLDISPATCH_LAYER_VERSION 1
+
+/*!
+ * The name of the init function that a layer library exports. Its type is
+ * __GLdispatchLayerInitFunc.
+ */
+#define GLDISPATCH_LAYER_INIT_NAME "__glDispatchLayerInit"
+
+/*!
+ * The callbacks for an interposer layer. A layer wraps each dispatch table in
+ * a table of its own, which is normally an overlay table created with
+ * __glDispatchCreateOverlayTable() that overrides only the functions that the
+ * layer is interested in. Every other entry is copied from the next table
+ * down, so a layer costs nothing for functions that it doesn't override.
+ */
+typedef struct __GLdispatchLayerRec {
+    /*!
+     * Creates the layer's table on top of next, which is either the next
+     * layer's table or the vendor's table. This is called without the
+     * dispatch lock held. If this returns NULL or next, then the layer is
+     * skipped for this table.
+     */
+    __GLdispatchTable *(*createTable)(__GLdispatchTable *next,
+                                      void *layerData);
+
+    /*!
+     * Destroys a table returned by createTable, when the vendor's table is
+     * destroyed. If this is NULL, then the table is destroyed with
+     * __glDispatchDestroyTable().
+     */
+    void (*destroyTable)(__GLdispatchTable *table, void *layerData);
+
+    /*! Private data for the layer, passed to the callbacks */
+    void *layerData;
+} __GLdispatchLayer;
+
+/*!
+ * A layer's init function. This fills in the layer's callbacks and returns
+ * GL_TRUE, or returns GL_FALSE if it doesn't support the given version of the
+ * layer interface. The layer index is what the layer passes to
+ * __glDispatchGetLayerNext().
+ */
+typedef GLboolean (*__GLdispatchLayerInitFunc)(int version, int layerIndex,
+                                               __GLdispatchLayer *layer);
+
+/*!
+ * Adds an interposer layer below any existing layers. Once any layers are
+ * added, __glDispatchMakeCurrent() installs the head of a chain of layer
+ * tables on top of each vendor table, starting with the first layer added.
+ *
+ * Layers are normally loaded by __glDispatchInit(). The __GL_LAYERS
+ * environment variable is a colon-separated list of layer libraries to load.
+ * If that isn't set, then the libraries are read from a config file, one per
+ * line, which is named by the __GL_LAYERS_CONFIG environment variable or else
+ * is the system-wide layers.conf file. Each library is loaded with dlopen()
+ * and must export GLDISPATCH_LAYER_INIT_NAME.
+ *
+ * A table's layer chain is built the first time it's made current or
+ * validated while any layers are loaded, so a layer added after that doesn't
+ * apply to it. Returns GL_FALSE if the layer's init function fails, or if lazy
+ * dispatch is enabled, since the layer tables would copy the unresolved
+ * entries.
+ */
+PUBLIC GLboolean __glDispatchAddLayer(__GLdispatchLayerInitFunc init);
+
+/*!
+ * Returns the table below the given layer in the current thread's chain, for
+ * a layer function to call the next function down. The result is indexed by
+ * dispatch offset. This must only be called from a function in that layer's
+ * table while a context is current.
+ */
+PUBLIC const __GLdispatchProc *__glDispatchGetLayerNext(int layerIndex);
+
 /*!
  * This gets the current (opaque) API state pointer. If the pointer is
  * NULL, no context is current, otherwise the contents of the pointer depends on
@@ -186,6 +370,12 @@ static inline void *__glDispatchGetCurrentContext(void)
  */
 PUBLIC GLint __glDispatchGetOffset(const char *procName);
 
+/*!
+ * This returns the number of entries in a GL dispatch table, which is one
+ * more than the largest offset that __glDispatchGetOffset() can return.
+ */
+PUBLIC GLint __glDispatchGetTableSize(void);
+
 /*!
  * This sets the dispatch table entry given by <offset> to the entrypoint
  * address given by <addr>.
@@ -193,4 +383,164 @@ PUBLIC GLint __glDispatchGetOffset(const char *procName);
 PUBLIC void __glDispatchSetEntry(__GLdispatchTable *dispatch,
                                  GLint offset, __GLdispatchProc addr);
 
+/*!
+ * This sets several dispatch table entries at once: the entry given by
+ * offsets[i] is set to addrs[i] for each i < count. This only takes the
+ * dispatch lock once, so it's much cheaper than calling
+ * __glDispatchSetEntry() for each entry. Each entry is updated atomically,
+ * so another thread dispatching through the table sees either the old or the
+ * new function, but the entries are not all updated at once.
+ */
+PUBLIC void __glDispatchSetEntries(__GLdispatchTable *dispatch,
+                                   const GLint *offsets,
+                                   const __GLdispatchProc *addrs,
+                                   int count);
+
+/*!
+ * Statistics for a single dispatch table, as reported by
+ * __glDispatchGetStats(). All times are in nanoseconds.
+ */
+typedef struct __GLdispatchTableStatsRec {
+    /*! The table and the vendor data it was created with */
+    const __GLdispatchTable *table;
+    void *vendorData;
+
+    /*!
+     * How long it took to build the table. This is 0 if the table hasn't been
+     * made current yet.
+     */
+    uint64_t buildTime;
+
+    /*!
+     * The number of entries that the vendor provided a function for, and the
+     * number that it didn't, which dispatch to a no-op instead. With
+     * __GL_LAZY_DISPATCH, these only count the functions that have been
+     * called.
+     */
+    int numResolved;
+    int numNoop;
+
+    /*!
+     * The number of times the table was fixed up to pick up new extension
+     * functions, the number of entries those fixups filled in, and how long
+     * they took in total.
+     */
+    unsigned long numFixups;
+    unsigned long numProcsFixed;
+    uint64_t fixupTime;
+
+    /*!
+     * The number of times the table was made current on a thread where it
+     * wasn't already current, and the most threads it's been current on at
+     * once.
+     */
+    unsigned long numMakeCurrent;
+    int peakCurrentThreads;
+} __GLdispatchTableStats;
+
+/*!
+ * Copies the statistics for up to maxCount dispatch tables into stats, and
+ * returns the total number of tables that exist.
+ */
+PUBLIC int __glDispatchGetStats(__GLdispatchTableStats *stats, int maxCount);
+
+/*!
+ * Per-function counts from the profiling table. All times are in nanoseconds.
+ */
+typedef struct __GLdispatchProfileStatsRec {
+    /*! The number of times the function was called */
+    uint64_t numCalls;
+
+    /*! The number of calls that were timed, and their total and max time */
+    uint64_t numSamples;
+    uint64_t totalTime;
+    uint64_t maxTime;
+} __GLdispatchProfileStats;
+
+/*!
+ * Enables the profiling dispatch mode. After this, each make current installs
+ * a profiling table instead of the vendor's table. The profiling table counts
+ * the calls to each function and times one in every sampleInterval calls,
+ * and then forwards the call to the vendor's table. A report is printed to
+ * stderr at exit.
+ *
+ * This is also enabled by setting the __GL_PROFILE_DISPATCH environment
+ * variable, in which case __GL_PROFILE_SAMPLE_INTERVAL sets the sample
+ * interval. A sampleInterval of 0 selects the default interval.
+ *
+ * Profiling can't be disabled once it's enabled, and only affects later make
+ * currents. This returns GL_FALSE if profiling isn't supported on this
+ * platform, if a capture is running or being started, or on failure. It's
+ * safe to call this while other threads are making contexts current.
+ */
+PUBLIC GLboolean __glDispatchEnableProfiling(unsigned int sampleInterval);
+
+/*!
+ * Returns the profiling counts for the function at the given dispatch offset.
+ * Returns GL_FALSE if profiling isn't enabled or the offset is invalid.
+ */
+PUBLIC GLboolean __glDispatchGetProfileStats(GLint offset,
+                                             __GLdispatchProfileStats *stats);
+
+/*!
+ * Starts capturing GL calls to a file. After this, each make current installs
+ * a capture table instead of the vendor's table. The capture table records
+ * the dispatch offset, thread, timestamp, and scalar arguments of each call,
+ * and then forwards the call to the vendor's table. See GLcapture.h for the
+ * file format, and glcapturedecode for a tool to print it.
+ *
+ * Each thread writes its calls directly into its own chunk of the memory
+ * mapped file, so recording a call doesn't take a lock. The file is created
+ * with a size of maxSize bytes, or 256MB if maxSize is 0, and calls are
+ * dropped once it's full. The number of dropped calls is kept in the file's
+ * header. The file is truncated to the space that was used at exit.
+ *
+ * This is also enabled by setting the __GL_CAPTURE_FILE environment variable
+ * to the name of the file, in which case __GL_CAPTURE_SIZE sets the maximum
+ * size in megabytes.
+ *
+ * Capturing can't be stopped once it's started, and only affects later make
+ * currents. This returns GL_FALSE if capturing isn't supported on this
+ * platform, if profiling is enabled or being enabled, or on failure.
+ * Recording needs TLS, so this always returns GL_FALSE if GLdispatch was
+ * built without it. It's safe to call this while other threads are making
+ * contexts current.
+ */
+PUBLIC GLboolean __glDispatchStartCapture(const char *filename,
+                                          size_t maxSize);
+
+/*!
+ * Updates the capture file's header and writes it out, so that the calls
+ * recorded so far can be decoded while the process is still running. Calls
+ * that are being recorded while this runs may not be included.
+ */
+PUBLIC GLboolean __glDispatchFlushCapture(void);
+
+/*!
+ * Returns GL_TRUE if lock statistics are enabled. These are enabled by
+ * setting the __GL_LOCK_STATS environment variable; see glvnd_lockstats.h.
+ */
+PUBLIC GLboolean __glDispatchLockStatsEnabled(void);
+
+/*!
+ * Adds a lock's statistics to the list that __glDispatchGetLockStats()
+ * reports and that are printed at exit. The stats must stay valid until
+ * __glDispatchUnregisterLockStats() is called. The dispatch lock itself is
+ * always registered.
+ *
+ * Unregistering a lock that was ever taken leaves a copy of its final
+ * statistics in the list, so that they're still printed at exit. Locks with
+ * the same name share one copy, which adds up the statistics of each of them.
+ */
+PUBLIC void __glDispatchRegisterLockStats(GLVNDlockStats *stats);
+PUBLIC void __glDispatchUnregisterLockStats(GLVNDlockStats *stats);
+
+/*!
+ * Copies up to maxCount registered lock statistics into stats, and returns
+ * the total number registered. Statistics for reader/writer locks are updated
+ * without a lock, so the counts in a snapshot may be slightly inconsistent
+ * with each other.
+ */
+PUBLIC int __glDispatchGetLockStats(GLVNDlockStats *stats, int maxCount);
+
 #endif
@@ -30,25 +30,34 @@
 #ifndef __GL_DISPATCH_PRIVATE_H__
 #define __GL_DISPATCH_PRIVATE_H__
 
+#include <string.h>
+
 #include "GLdispatch.h"
 #include "glapi.h"
 #include "glvnd_list.h"
 
+/*!
+ * Assumed size of a cache line, used to keep frequently-written fields away
+ * from read-mostly ones.
+ */
+#define GLDISPATCH_CACHELINE_SIZE 64
+
 /*!
  * Private dispatch table structure. This is used by GLdispatch for tracking
  * and updating dispatch tables.
  */
 typedef struct __GLdispatchTableRec {
-    /*! Number of threads this dispatch is current on */
-    int currentThreads;
-
-    /*! Generation number for tracking whether this needs fixup */
-    int generation;
+    /*!
+     * Generation number for tracking whether this needs fixup. This is only
+     * written with the dispatch lock held, but may be read without it.
+     */
+    volatile int generation;
 
     /*! Saved vendor library callbacks */
     __GLgetProcAddressCallback getProcAddress;
     __GLgetDispatchProtoCallback getDispatchProto;
     __GLdestroyVendorDataCallback destroyVendorData;
+    __GLgetStaticDispatchCallback getStaticDispatch;
 
     /*! A pointer to vendor-specific data */
     void *vendorData;
@@ -56,8 +65,183 @@ typedef struct __GLdispatchTableRec {
     /*! The real dispatch table */
     struct _glapi_table *table;
 
+    /*!
+     * For overlay tables, the entries which override the base table. These
+     * are reapplied after every fixup, in case a fixup overwrote one of them.
+     */
+    int numOverrides;
+    GLint *overrideOffsets;
+    __GLdispatchProc *overrideProcs;
+
     /*! List handle */
     struct glvnd_list entry;
+
+    /*! List handle for the list of all dispatch tables */
+    struct glvnd_list tableEntry;
+
+    /*!
+     * The chain of interposer layer tables on top of this table, starting
+     * with the head of the chain, or NULL if it hasn't been built. A layer
+     * which skipped this table has the next table down in its place. This is
+     * set once with an atomic compare-and-swap, and may be read without the
+     * dispatch lock.
+     */
+    __GLdispatchTable **layerTables;
+    int numLayerTables;
+
+    /*!
+     * The table that this one was created from, if it's an overlay table.
+     * Changes to the base table's entries are copied into a layer's overlay
+     * table, except for the ones that it overrides.
+     */
+    __GLdispatchTable *overlayBase;
+
+    /*!
+     * Statistics reported by __glDispatchGetStats(). These are protected by
+     * the dispatch lock.
+     */
+    uint64_t buildTime;
+    int numResolved;
+    int numNoop;
+    unsigned long numFixups;
+    unsigned long numProcsFixed;
+    uint64_t fixupTime;
+
+    /*!
+     * Non-zero if __glDispatchValidateTable() has been called, in which case
+     * the table holds a reference to itself so that it stays on the current
+     * dispatch list.
+     */
+    int validated;
+
+    /*!
+     * Number of threads this dispatch is current on. This is updated with
+     * atomic operations so that a thread can take a reference to a table
+     * which is already current elsewhere without the dispatch lock. It lives
+     * on its own cache line so those updates don't contend with the fields
+     * above, which are read on every make current.
+     */
+    volatile int currentThreads
+        __attribute__((aligned(GLDISPATCH_CACHELINE_SIZE)));
+
+    /*!
+     * Statistics which are updated along with currentThreads, and so share its
+     * cache line: the number of times the table was made current on a thread
+     * where it wasn't already current, and the most threads it's been current
+     * on at once.
+     */
+    volatile unsigned long numMakeCurrent;
+    volatile int peakCurrentThreads;
 } __GLdispatchTable;
 
+/*
+ * Helpers for the capture table, which is generated by gl_capture.py. See
+ * __glDispatchStartCapture() and GLcapture.h.
+ */
+extern const __GLdispatchProc __glCaptureProcs[];
+extern const int __glCaptureProcCount;
+
+static inline uint64_t __glCaptureFloat(GLfloat f)
+{
+    union { GLfloat f; uint32_t u; } v;
+    v.f = f;
+    return v.u;
+}
+
+static inline uint64_t __glCaptureDouble(GLdouble d)
+{
+    union { GLdouble d; uint64_t u; } v;
+    v.d = d;
+    return v.u;
+}
+
+static inline uint64_t __glCaptureBits(const void *value, size_t size)
+{
+    uint64_t v = 0;
+    memcpy(&v, value, size);
+    return v;
+}
+
+/*
+ * Returns the table at the head of a table's layer chain, which is the table
+ * itself if there are no layers.
+ */
+static inline struct _glapi_table *__glDispatchLayerHead(
+    const __GLdispatchTable *dispatch)
+{
+    return dispatch->layerTables ? dispatch->layerTables[0]->table :
+        dispatch->table;
+}
+
+/*
+ * Returns the table that a capture function forwards to, which is the head
+ * of the API state's layer chain.
+ */
+static inline const struct _glapi_table *__glCaptureTable(void)
+{
+    __GLdispatchAPIState *apiState = (__GLdispatchAPIState *)
+        _glapi_get_current(CURRENT_API_STATE);
+    return __glDispatchLayerHead(apiState->dispatch);
+}
+
+/*
+ * Returns a timestamp for a capture record. This is the TSC where there is
+ * one, since it's much cheaper than clock_gettime().
+ */
+static inline uint64_t __glCaptureTicks(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#else
+    return glvndLockStatsGetTime();
+#endif
+}
+
+#if defined(GLX_USE_TLS)
+
+/*
+ * The current thread's position in its capture chunk. Both are NULL until the
+ * thread records its first call.
+ */
+typedef struct __GLcaptureThreadRec {
+    uint64_t *pos;
+    uint64_t *end;
+    uint32_t id;
+} __GLcaptureThread;
+
+extern __thread __GLcaptureThread __glCaptureThread
+    __attribute__((tls_model("initial-exec")));
+
+uint64_t *__glCaptureReserve(int offset, int numArgs);
+
+/*
+ * Starts a capture record for a call, and returns a pointer to where its
+ * arguments should go, or NULL if the call can't be recorded. This only
+ * falls back to __glCaptureReserve() when the thread's chunk is full.
+ */
+static inline uint64_t *__glCaptureBegin(int offset, int numArgs)
+{
+    __GLcaptureThread *thr = &__glCaptureThread;
+    uint64_t *rec = thr->pos;
+
+    if (__builtin_expect((uintptr_t)thr->end - (uintptr_t)rec <
+                         (2 + numArgs) * sizeof(uint64_t), 0)) {
+        return __glCaptureReserve(offset, numArgs);
+    }
+
+    thr->pos = rec + 2 + numArgs;
+    rec[0] = (uint64_t)(offset + 1) | ((uint64_t)numArgs << 32);
+    rec[1] = __glCaptureTicks();
+    return rec + 2;
+}
+
+#else /* defined(GLX_USE_TLS) */
+
+static inline uint64_t *__glCaptureBegin(int offset, int numArgs)
+{
+    return NULL;
+}
+
+#endif /* defined(GLX_USE_TLS) */
+
 #endif
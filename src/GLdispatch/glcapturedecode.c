@@ -0,0 +1,420 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+/*
+ * Prints a GL call capture file, as written by __glDispatchStartCapture().
+ * See GLcapture.h for the format.
+ */
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "GLcapture.h"
+
+typedef struct CaptureRecordRec {
+    const uint64_t *words;
+    uint32_t thread;
+} CaptureRecord;
+
+typedef struct CaptureFileRec {
+    const __GLcaptureHeader *header;
+    CaptureRecord *records;
+    size_t numRecords;
+    size_t capacity;
+
+    /* The names of dynamic functions, from the file's name blocks */
+    const char **dynamicNames;
+    uint32_t numDynamicNames;
+} CaptureFile;
+
+static void print_help(const char *name)
+{
+    printf("Usage: %s [options] <capture file>\n"
+           "Options: \n"
+           " -h, --help       Print this help message.\n"
+           " -s, --sort       Print the calls from all threads in time order.\n"
+           " -c, --counts     Only print the number of calls to each function.\n",
+           name);
+}
+
+static const char *GetFuncName(const CaptureFile *file, uint32_t offset)
+{
+    if (offset < (uint32_t)__glCaptureFuncInfoCount) {
+        return __glCaptureFuncInfo[offset].name;
+    } else if (offset < file->numDynamicNames) {
+        return file->dynamicNames[offset];
+    }
+    return NULL;
+}
+
+/*
+ * Reads the dynamic function names from a name block. A later block replaces
+ * the names from an earlier one.
+ */
+static int ReadNames(CaptureFile *file, const uint64_t *words,
+                     const uint64_t *end)
+{
+    const char **names;
+    uint32_t offset, len;
+
+    for (words++; words < end && words[0] != 0;
+         words += 1 + (len + 8) / sizeof(uint64_t)) {
+        offset = ((const uint32_t *)words)[0];
+        len = ((const uint32_t *)words)[1];
+        if (words + 1 + (len + 8) / sizeof(uint64_t) > end) {
+            fprintf(stderr, "Truncated name block\n");
+            return 0;
+        }
+
+        if (offset >= file->numDynamicNames) {
+            names = realloc(file->dynamicNames,
+                            (offset + 1) * sizeof(const char *));
+            if (!names) {
+                fprintf(stderr, "Out of memory\n");
+                return 0;
+            }
+            memset(names + file->numDynamicNames, 0,
+                   (offset + 1 - file->numDynamicNames) * sizeof(const char *));
+            file->dynamicNames = names;
+            file->numDynamicNames = offset + 1;
+        }
+        file->dynamicNames[offset] = (const char *)(words + 1);
+    }
+    return 1;
+}
+
+static int AddRecord(CaptureFile *file, const uint64_t *words, uint32_t thread)
+{
+    CaptureRecord *records;
+
+    if (file->numRecords == file->capacity) {
+        file->capacity = file->capacity ? file->capacity * 2 : 1024;
+        records = realloc(file->records,
+                          file->capacity * sizeof(CaptureRecord));
+        if (!records) {
+            return 0;
+        }
+        file->records = records;
+    }
+    file->records[file->numRecords].words = words;
+    file->records[file->numRecords].thread = thread;
+    file->numRecords++;
+    return 1;
+}
+
+/*
+ * Collects the records from every chunk in the file, in file order.
+ */
+static int ReadRecords(CaptureFile *file, const char *data)
+{
+    const __GLcaptureHeader *header = file->header;
+    uint64_t offset;
+    const uint64_t *words, *end;
+    uint32_t thread, numArgs = 0;
+    uint64_t numChunks;
+
+    for (offset = GL_CAPTURE_HEADER_SIZE;
+         offset + header->chunkSize <= header->size;
+         offset += header->chunkSize) {
+        words = (const uint64_t *)(data + offset);
+        end = words + (header->chunkSize / sizeof(uint64_t));
+
+        if ((uint32_t)words[0] == GL_CAPTURE_NAMES_MAGIC) {
+            numChunks = words[0] >> 32;
+            if (numChunks == 0 ||
+                offset + numChunks * header->chunkSize > header->size) {
+                fprintf(stderr, "Bad name block at offset %llu\n",
+                        (unsigned long long)offset);
+                return 0;
+            }
+            end = words + numChunks * (header->chunkSize / sizeof(uint64_t));
+            if (!ReadNames(file, words, end)) {
+                return 0;
+            }
+            offset += (numChunks - 1) * header->chunkSize;
+            continue;
+        } else if ((uint32_t)words[0] != GL_CAPTURE_CHUNK_MAGIC) {
+            continue;
+        }
+        thread = (uint32_t)(words[0] >> 32);
+
+        for (words++; words + 2 <= end && words[0] != 0;
+             words += 2 + numArgs) {
+            numArgs = (uint32_t)(words[0] >> 32);
+            if (words + 2 + numArgs > end) {
+                fprintf(stderr, "Truncated record at offset %llu\n",
+                        (unsigned long long)((const char *)words - data));
+                break;
+            }
+            if (!AddRecord(file, words, thread)) {
+                fprintf(stderr, "Out of memory\n");
+                return 0;
+            }
+        }
+    }
+    return 1;
+}
+
+static int CompareRecords(const void *a, const void *b)
+{
+    const CaptureRecord *ra = (const CaptureRecord *)a;
+    const CaptureRecord *rb = (const CaptureRecord *)b;
+
+    if (ra->words[1] != rb->words[1]) {
+        return (ra->words[1] < rb->words[1]) ? -1 : 1;
+    }
+    // Keep each thread's records in the order they were made.
+    return (ra->words < rb->words) ? -1 : (ra->words > rb->words);
+}
+
+/*
+ * Converts a timestamp to nanoseconds since the start of the capture.
+ */
+static uint64_t TicksToNanoseconds(const __GLcaptureHeader *header,
+                                   uint64_t ticks)
+{
+    double scale = 1.0;
+
+    if (header->endTicks > header->startTicks) {
+        scale = (double)(header->endTime - header->startTime) /
+            (double)(header->endTicks - header->startTicks);
+    }
+    if (ticks < header->startTicks) {
+        return 0;
+    }
+    return (uint64_t)((double)(ticks - header->startTicks) * scale);
+}
+
+static void PrintArg(char type, uint64_t value)
+{
+    union { uint32_t u; float f; } f;
+    union { uint64_t u; double d; } d;
+
+    switch (type) {
+    case GL_CAPTURE_ARG_FLOAT:
+        f.u = (uint32_t)value;
+        printf("%g", f.f);
+        break;
+    case GL_CAPTURE_ARG_DOUBLE:
+        d.u = value;
+        printf("%g", d.d);
+        break;
+    case GL_CAPTURE_ARG_ENUM:
+        printf("0x%04llx", (unsigned long long)value);
+        break;
+    case GL_CAPTURE_ARG_BOOLEAN:
+        printf("%s", value == 0 ? "GL_FALSE" :
+               (value == 1 ? "GL_TRUE" : "(invalid)"));
+        break;
+    case GL_CAPTURE_ARG_INT:
+        printf("%lld", (long long)value);
+        break;
+    case GL_CAPTURE_ARG_UINT:
+        printf("%llu", (unsigned long long)value);
+        break;
+    case GL_CAPTURE_ARG_POINTER:
+        if (value) {
+            printf("%p", (void *)(uintptr_t)value);
+        } else {
+            printf("NULL");
+        }
+        break;
+    default:
+        printf("0x%llx", (unsigned long long)value);
+        break;
+    }
+}
+
+static void PrintRecord(const CaptureFile *file, const CaptureRecord *rec)
+{
+    uint32_t offset = (uint32_t)rec->words[0] - 1;
+    uint32_t numArgs = (uint32_t)(rec->words[0] >> 32);
+    const char *name = GetFuncName(file, offset);
+    const char *argTypes = "";
+    uint32_t i;
+
+    if (offset < (uint32_t)__glCaptureFuncInfoCount &&
+        strlen(__glCaptureFuncInfo[offset].argTypes) == numArgs) {
+        argTypes = __glCaptureFuncInfo[offset].argTypes;
+    }
+
+    printf("%u %llu ", rec->thread,
+           (unsigned long long)TicksToNanoseconds(file->header,
+                                                  rec->words[1]));
+    if (name) {
+        printf("gl%s(", name);
+    } else {
+        printf("slot%u(", offset);
+    }
+    for (i = 0; i < numArgs; i++) {
+        if (i > 0) {
+            printf(", ");
+        }
+        PrintArg(argTypes[0] ? argTypes[i] : GL_CAPTURE_ARG_HEX,
+                 rec->words[2 + i]);
+    }
+    printf(")\n");
+}
+
+static int PrintCounts(const CaptureFile *file)
+{
+    uint64_t *counts;
+    uint32_t maxOffset = 0;
+    uint32_t offset;
+    const char *name;
+    size_t i;
+
+    for (i = 0; i < file->numRecords; i++) {
+        offset = (uint32_t)file->records[i].words[0] - 1;
+        if (offset > maxOffset) {
+            maxOffset = offset;
+        }
+    }
+
+    counts = calloc(maxOffset + 1, sizeof(uint64_t));
+    if (!counts) {
+        fprintf(stderr, "Out of memory\n");
+        return 0;
+    }
+    for (i = 0; i < file->numRecords; i++) {
+        counts[(uint32_t)file->records[i].words[0] - 1]++;
+    }
+    for (offset = 0; offset <= maxOffset; offset++) {
+        if (counts[offset]) {
+            name = GetFuncName(file, offset);
+            if (name) {
+                printf("%12llu gl%s\n", (unsigned long long)counts[offset],
+                       name);
+            } else {
+                printf("%12llu slot%u\n", (unsigned long long)counts[offset],
+                       offset);
+            }
+        }
+    }
+
+    free(counts);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "sort", no_argument, NULL, 's' },
+        { "counts", no_argument, NULL, 'c' },
+        { NULL, no_argument, NULL, 0 }
+    };
+    CaptureFile file;
+    const __GLcaptureHeader *header;
+    struct stat st;
+    const char *data;
+    int sort = 0;
+    int countsOnly = 0;
+    int fd, c;
+    size_t i;
+
+    while ((c = getopt_long(argc, argv, "hsc", long_options, NULL)) != -1) {
+        switch (c) {
+        case 'h':
+            print_help(argv[0]);
+            return 0;
+        case 's':
+            sort = 1;
+            break;
+        case 'c':
+            countsOnly = 1;
+            break;
+        default:
+            print_help(argv[0]);
+            return 1;
+        }
+    }
+    if (optind + 1 != argc) {
+        print_help(argv[0]);
+        return 1;
+    }
+
+    fd = open(argv[optind], O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        fprintf(stderr, "Can't open %s\n", argv[optind]);
+        return 1;
+    }
+    if ((size_t)st.st_size < GL_CAPTURE_HEADER_SIZE) {
+        fprintf(stderr, "%s is not a capture file\n", argv[optind]);
+        return 1;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        fprintf(stderr, "Can't map %s\n", argv[optind]);
+        return 1;
+    }
+
+    header = (const __GLcaptureHeader *)data;
+    if (header->magic != GL_CAPTURE_MAGIC ||
+        header->version != GL_CAPTURE_VERSION ||
+        header->chunkSize == 0 || (header->chunkSize % sizeof(uint64_t)) ||
+        header->size > (uint64_t)st.st_size) {
+        fprintf(stderr, "%s is not a valid capture file\n", argv[optind]);
+        return 1;
+    }
+
+    memset(&file, 0, sizeof(file));
+    file.header = header;
+    if (!ReadRecords(&file, data)) {
+        return 1;
+    }
+
+    printf("# %llu calls from %u threads, %llu dropped\n",
+           (unsigned long long)file.numRecords, header->numThreads,
+           (unsigned long long)header->numDropped);
+
+    if (countsOnly) {
+        return PrintCounts(&file) ? 0 : 1;
+    }
+
+    if (sort) {
+        qsort(file.records, file.numRecords, sizeof(CaptureRecord),
+              CompareRecords);
+    }
+    for (i = 0; i < file.numRecords; i++) {
+        PrintRecord(&file, &file.records[i]);
+    }
+
+    free(file.records);
+    free(file.dynamicNames);
+    munmap((void *)data, st.st_size);
+    return 0;
+}
@@ -44,4 +44,23 @@ entry_generate(int slot);
 void
 entry_patch(mapi_func entry, int slot);
 
+typedef mapi_func (*entry_resolve_func)(int slot);
+
+void
+entry_set_resolve_func(entry_resolve_func func);
+
+mapi_func
+entry_get_resolver(int slot);
+
+typedef mapi_func (*entry_profile_enter_func)(int slot,
+                                              unsigned long long *sample);
+typedef void (*entry_profile_exit_func)(int slot, unsigned long long sample);
+
+void
+entry_set_profile_funcs(entry_profile_enter_func enter,
+                        entry_profile_exit_func exit);
+
+mapi_func
+entry_get_profiler(int slot);
+
 #endif /* _ENTRY_H_ */
@@ -26,6 +26,7 @@
  */
 
 #include "u_macros.h"
+#include "table.h"
 
 __asm__(".text\n"
         ".balign 32\n"
@@ -45,6 +46,9 @@ __asm__(".text\n"
 #define MAPI_TMP_STUB_ASM_GCC
 #include "mapi_tmp.h"
 
+__asm__(".balign 32\n"
+        "x86_64_entry_end:");
+
 #ifndef MAPI_MODE_BRIDGE
 
 __asm__("x86_64_current_tls:\n\t"
@@ -54,17 +58,113 @@ __asm__("x86_64_current_tls:\n\t"
 extern unsigned long
 x86_64_current_tls();
 
+#include <stdlib.h>
 #include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "u_execmem.h"
 
+/*
+ * A stub which loads the current table with a single %fs-relative move. This
+ * only works if the TLS offset of the current table fits in a sign-extended
+ * 32-bit displacement.
+ */
+static const char x86_64_direct_templ[16] = {
+   /* movq %fs:0x12345678, %r11 */
+   0x64, 0x4c, 0x8b, 0x1c, 0x25, 0x78, 0x56, 0x34, 0x12,
+   /* jmp *0x1234(%r11) */
+   0x41, 0xff, 0xa3, 0x34, 0x12, 0x00, 0x00,
+};
+
+/*
+ * A stub which carries the whole 64-bit TLS offset of the current table, for
+ * when it doesn't fit in a displacement.
+ */
+static const char x86_64_cached_templ[21] = {
+   /* movabsq $0x1122334455667788, %r11 */
+   0x49, 0xbb, 0x88, 0x77, 0x66, 0x55, 0x44, 0x33, 0x22, 0x11,
+   /* movq %fs:(%r11), %r11 */
+   0x64, 0x4d, 0x8b, 0x1b,
+   /* jmp *0x1234(%r11) */
+   0x41, 0xff, 0xa3, 0x34, 0x12, 0x00, 0x00,
+};
+
+/* set by x86_64_entry_init() */
+static int x86_64_entry_direct;
+static int x86_64_entry_slot_offset;
+
+static char
+x86_64_entry_start[];
+
+static char
+x86_64_entry_end[];
+
+/**
+ * Rewrite the public stubs to load the current table directly from
+ * %fs:offset. The stubs are in .text, so their pages are only made writable
+ * while they're being patched. If that isn't allowed, the stubs are left as
+ * they are.
+ */
+static void
+x86_64_entry_patch_direct(unsigned int offset)
+{
+   unsigned long page_size = sysconf(_SC_PAGESIZE);
+   unsigned long start = (unsigned long) x86_64_entry_start & ~(page_size - 1);
+   unsigned long end = ((unsigned long) x86_64_entry_end + page_size - 1) &
+      ~(page_size - 1);
+   char *entry;
+   int slot = 0;
+
+   /* other code can share the first and last pages, so keep them executable */
+   if (mprotect((void *) start, end - start,
+                PROT_READ | PROT_WRITE | PROT_EXEC) != 0)
+      return;
+
+   for (entry = x86_64_entry_start; entry < x86_64_entry_end;
+        entry += 32, slot++) {
+      memcpy(entry, x86_64_direct_templ, sizeof(x86_64_direct_templ));
+      *((unsigned int *) (entry + 5)) = offset;
+      *((unsigned int *) (entry + 12)) = slot * sizeof(mapi_func);
+   }
+
+   mprotect((void *) start, end - start, PROT_READ | PROT_EXEC);
+}
+
+/**
+ * Choose the kind of dynamic stub to generate, and rewrite the public stubs to
+ * use direct %fs-relative loads where possible. The public stubs otherwise load
+ * the TLS offset from the GOT on every call.
+ *
+ * The offset of the current table fits in a displacement whenever it's in the
+ * static TLS block below the thread pointer, which is where initial-exec TLS
+ * normally goes, even if libGLdispatch is loaded with dlopen(). If it doesn't,
+ * the public stubs are left alone and dynamic stubs carry the whole offset,
+ * so that entry_generate() still works. Setting __GL_DIRECT_TLS_STUBS=0 picks
+ * the second kind of stub regardless.
+ *
+ * This runs when libGLdispatch is loaded, before anything else can have the
+ * address of a public stub, so it's safe to patch them in place.
+ */
+static void __attribute__((constructor))
+x86_64_entry_init(void)
+{
+   const char *str = getenv("__GL_DIRECT_TLS_STUBS");
+   unsigned long addr = x86_64_current_tls();
+
+   x86_64_entry_direct = ((addr >> 32) == 0xffffffff) && (!str || atoi(str));
+   x86_64_entry_slot_offset = (x86_64_entry_direct) ?
+      sizeof(x86_64_direct_templ) - 4 : sizeof(x86_64_cached_templ) - 4;
+
+   if (x86_64_entry_direct)
+      x86_64_entry_patch_direct(addr & 0xffffffff);
+}
+
 void
 entry_patch_public(void)
 {
+   /* the public stubs are patched by x86_64_entry_init() */
 }
 
-static char
-x86_64_entry_start[];
-
 mapi_func
 entry_get_public(int slot)
 {
@@ -75,38 +175,257 @@ void
 entry_patch(mapi_func entry, int slot)
 {
    char *code = (char *) entry;
-   *((unsigned int *) (code + 12)) = slot * sizeof(mapi_func);
+   *((unsigned int *) (code + x86_64_entry_slot_offset)) =
+      slot * sizeof(mapi_func);
 }
 
 mapi_func
 entry_generate(int slot)
 {
-   const char code_templ[16] = {
-      /* movq %fs:0, %r11 */
-      0x64, 0x4c, 0x8b, 0x1c, 0x25, 0x00, 0x00, 0x00, 0x00,
-      /* jmp *0x1234(%r11) */
-      0x41, 0xff, 0xa3, 0x34, 0x12, 0x00, 0x00,
-   };
    unsigned long addr;
-   void *code;
+   char *code;
    mapi_func entry;
 
    addr = x86_64_current_tls();
-   if ((addr >> 32) != 0xffffffff)
-      return NULL;
-   addr &= 0xffffffff;
-
-   code = u_execmem_alloc(sizeof(code_templ));
-   if (!code)
-      return NULL;
 
-   memcpy(code, code_templ, sizeof(code_templ));
+   if (x86_64_entry_direct) {
+      code = u_execmem_alloc(sizeof(x86_64_direct_templ));
+      if (!code)
+         return NULL;
+      memcpy(code, x86_64_direct_templ, sizeof(x86_64_direct_templ));
+      *((unsigned int *) (code + 5)) = addr & 0xffffffff;
+   } else {
+      code = u_execmem_alloc(sizeof(x86_64_cached_templ));
+      if (!code)
+         return NULL;
+      memcpy(code, x86_64_cached_templ, sizeof(x86_64_cached_templ));
+      *((unsigned long *) (code + 2)) = addr;
+   }
 
-   *((unsigned int *) (code + 5)) = addr;
    entry = (mapi_func) code;
    entry_patch(entry, slot);
 
    return entry;
 }
 
+/*
+ * Resolver trampolines. There's one 16-byte trampoline for each slot, which
+ * loads the slot number into %r11d and jumps to x86_64_resolver_common. That
+ * saves the argument registers, calls the resolve function to find the real
+ * function for the slot, restores the arguments, and then tail-calls the real
+ * function.
+ *
+ * On entry, %rsp is 8 bytes off of 16-byte alignment because of the return
+ * address. The six pushes and the 136 bytes for %xmm0-%xmm7 (plus 8 bytes of
+ * padding) bring it back into alignment for the call.
+ */
+static entry_resolve_func x86_64_resolve_func __attribute__((used));
+
+__asm__(".text\n"
+        ".balign 16\n"
+        "x86_64_resolver_common:\n\t"
+        "pushq %rdi\n\t"
+        "pushq %rsi\n\t"
+        "pushq %rdx\n\t"
+        "pushq %rcx\n\t"
+        "pushq %r8\n\t"
+        "pushq %r9\n\t"
+        "subq $136, %rsp\n\t"
+        "movdqu %xmm0, 0(%rsp)\n\t"
+        "movdqu %xmm1, 16(%rsp)\n\t"
+        "movdqu %xmm2, 32(%rsp)\n\t"
+        "movdqu %xmm3, 48(%rsp)\n\t"
+        "movdqu %xmm4, 64(%rsp)\n\t"
+        "movdqu %xmm5, 80(%rsp)\n\t"
+        "movdqu %xmm6, 96(%rsp)\n\t"
+        "movdqu %xmm7, 112(%rsp)\n\t"
+        "movl %r11d, %edi\n\t"
+        "call *x86_64_resolve_func(%rip)\n\t"
+        "movq %rax, %r11\n\t"
+        "movdqu 0(%rsp), %xmm0\n\t"
+        "movdqu 16(%rsp), %xmm1\n\t"
+        "movdqu 32(%rsp), %xmm2\n\t"
+        "movdqu 48(%rsp), %xmm3\n\t"
+        "movdqu 64(%rsp), %xmm4\n\t"
+        "movdqu 80(%rsp), %xmm5\n\t"
+        "movdqu 96(%rsp), %xmm6\n\t"
+        "movdqu 112(%rsp), %xmm7\n\t"
+        "addq $136, %rsp\n\t"
+        "popq %r9\n\t"
+        "popq %r8\n\t"
+        "popq %rcx\n\t"
+        "popq %rdx\n\t"
+        "popq %rsi\n\t"
+        "popq %rdi\n\t"
+        "jmp *%r11\n"
+        ".balign 16\n"
+        "x86_64_resolver_start:\n"
+        ".set x86_64_resolver_slot, 0\n"
+        ".rept " U_STRINGIFY(MAPI_TABLE_NUM_SLOTS) "\n\t"
+        "movl $x86_64_resolver_slot, %r11d\n\t"
+        "jmp x86_64_resolver_common\n\t"
+        ".balign 16\n"
+        ".set x86_64_resolver_slot, x86_64_resolver_slot + 1\n"
+        ".endr");
+
+extern char
+x86_64_resolver_start[];
+
+void
+entry_set_resolve_func(entry_resolve_func func)
+{
+   x86_64_resolve_func = func;
+}
+
+mapi_func
+entry_get_resolver(int slot)
+{
+   if (!x86_64_resolve_func || slot < 0 || slot >= MAPI_TABLE_NUM_SLOTS)
+      return NULL;
+
+   return (mapi_func) (x86_64_resolver_start + slot * 16);
+}
+
+/*
+ * Profiling trampolines. These work like the resolver trampolines, except
+ * that x86_64_profile_common calls the profile enter function on every call.
+ * If it asks to sample the call, then the trampoline also replaces the
+ * caller's return address with x86_64_profile_return, so that the profile exit
+ * function gets called when the real function returns. The real return
+ * address is kept on a small per-thread stack in the meantime.
+ *
+ * At x86_64_profile_return, %rsp is 16-byte aligned, and the return value is
+ * in %rax/%rdx or %xmm0/%xmm1, which need to be preserved.
+ */
+#define X86_64_PROFILE_STACK_SIZE 16
+
+struct x86_64_profile_frame {
+   void *retaddr;
+   int slot;
+   unsigned long long sample;
+};
+
+static __thread struct x86_64_profile_frame
+x86_64_profile_stack[X86_64_PROFILE_STACK_SIZE];
+static __thread int x86_64_profile_depth;
+
+static entry_profile_enter_func x86_64_profile_enter_func;
+static entry_profile_exit_func x86_64_profile_exit_func;
+
+extern char
+x86_64_profile_return[];
+
+static mapi_func __attribute__((used))
+x86_64_profile_enter(int slot, void **retaddr)
+{
+   unsigned long long sample = 0;
+   mapi_func func = x86_64_profile_enter_func(slot, &sample);
+   struct x86_64_profile_frame *frame;
+
+   if (sample && x86_64_profile_depth < X86_64_PROFILE_STACK_SIZE) {
+      frame = &x86_64_profile_stack[x86_64_profile_depth++];
+      frame->retaddr = *retaddr;
+      frame->slot = slot;
+      frame->sample = sample;
+      *retaddr = x86_64_profile_return;
+   }
+
+   return func;
+}
+
+static void * __attribute__((used))
+x86_64_profile_exit(void)
+{
+   struct x86_64_profile_frame *frame =
+      &x86_64_profile_stack[--x86_64_profile_depth];
+
+   x86_64_profile_exit_func(frame->slot, frame->sample);
+
+   return frame->retaddr;
+}
+
+__asm__(".text\n"
+        ".balign 16\n"
+        "x86_64_profile_common:\n\t"
+        "pushq %rdi\n\t"
+        "pushq %rsi\n\t"
+        "pushq %rdx\n\t"
+        "pushq %rcx\n\t"
+        "pushq %r8\n\t"
+        "pushq %r9\n\t"
+        "subq $136, %rsp\n\t"
+        "movdqu %xmm0, 0(%rsp)\n\t"
+        "movdqu %xmm1, 16(%rsp)\n\t"
+        "movdqu %xmm2, 32(%rsp)\n\t"
+        "movdqu %xmm3, 48(%rsp)\n\t"
+        "movdqu %xmm4, 64(%rsp)\n\t"
+        "movdqu %xmm5, 80(%rsp)\n\t"
+        "movdqu %xmm6, 96(%rsp)\n\t"
+        "movdqu %xmm7, 112(%rsp)\n\t"
+        "movl %r11d, %edi\n\t"
+        "leaq 184(%rsp), %rsi\n\t"
+        "call x86_64_profile_enter\n\t"
+        "movq %rax, %r11\n\t"
+        "movdqu 0(%rsp), %xmm0\n\t"
+        "movdqu 16(%rsp), %xmm1\n\t"
+        "movdqu 32(%rsp), %xmm2\n\t"
+        "movdqu 48(%rsp), %xmm3\n\t"
+        "movdqu 64(%rsp), %xmm4\n\t"
+        "movdqu 80(%rsp), %xmm5\n\t"
+        "movdqu 96(%rsp), %xmm6\n\t"
+        "movdqu 112(%rsp), %xmm7\n\t"
+        "addq $136, %rsp\n\t"
+        "popq %r9\n\t"
+        "popq %r8\n\t"
+        "popq %rcx\n\t"
+        "popq %rdx\n\t"
+        "popq %rsi\n\t"
+        "popq %rdi\n\t"
+        "jmp *%r11\n"
+        ".balign 16\n"
+        "x86_64_profile_return:\n\t"
+        "subq $48, %rsp\n\t"
+        "movq %rax, 0(%rsp)\n\t"
+        "movq %rdx, 8(%rsp)\n\t"
+        "movdqu %xmm0, 16(%rsp)\n\t"
+        "movdqu %xmm1, 32(%rsp)\n\t"
+        "call x86_64_profile_exit\n\t"
+        "movq %rax, %r11\n\t"
+        "movq 0(%rsp), %rax\n\t"
+        "movq 8(%rsp), %rdx\n\t"
+        "movdqu 16(%rsp), %xmm0\n\t"
+        "movdqu 32(%rsp), %xmm1\n\t"
+        "addq $48, %rsp\n\t"
+        "jmp *%r11\n"
+        ".balign 16\n"
+        "x86_64_profile_start:\n"
+        ".set x86_64_profile_slot, 0\n"
+        ".rept " U_STRINGIFY(MAPI_TABLE_NUM_SLOTS) "\n\t"
+        "movl $x86_64_profile_slot, %r11d\n\t"
+        "jmp x86_64_profile_common\n\t"
+        ".balign 16\n"
+        ".set x86_64_profile_slot, x86_64_profile_slot + 1\n"
+        ".endr");
+
+extern char
+x86_64_profile_start[];
+
+void
+entry_set_profile_funcs(entry_profile_enter_func enter,
+                        entry_profile_exit_func exit)
+{
+   x86_64_profile_enter_func = enter;
+   x86_64_profile_exit_func = exit;
+}
+
+mapi_func
+entry_get_profiler(int slot)
+{
+   if (!x86_64_profile_enter_func || !x86_64_profile_exit_func ||
+       slot < 0 || slot >= MAPI_TABLE_NUM_SLOTS)
+      return NULL;
+
+   return (mapi_func) (x86_64_profile_start + slot * 16);
+}
+
 #endif /* MAPI_MODE_BRIDGE */
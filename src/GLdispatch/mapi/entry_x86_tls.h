@@ -129,4 +129,29 @@ entry_generate(int slot)
    return entry;
 }
 
+void
+entry_set_resolve_func(entry_resolve_func func)
+{
+}
+
+mapi_func
+entry_get_resolver(int slot)
+{
+   /* resolver trampolines are not supported */
+   return NULL;
+}
+
+void
+entry_set_profile_funcs(entry_profile_enter_func enter,
+                        entry_profile_exit_func exit)
+{
+}
+
+mapi_func
+entry_get_profiler(int slot)
+{
+   /* profiling trampolines are not supported */
+   return NULL;
+}
+
 #endif /* MAPI_MODE_BRIDGE */
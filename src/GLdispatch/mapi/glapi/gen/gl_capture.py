@@ -0,0 +1,218 @@
+#!/usr/bin/env python
+
+# Copyright (c) 2013, NVIDIA CORPORATION.
+#
+# Permission is hereby granted, free of charge, to any person obtaining a
+# copy of this software and/or associated documentation files (the
+# "Materials"), to deal in the Materials without restriction, including
+# without limitation the rights to use, copy, modify, merge, publish,
+# distribute, sublicense, and/or sell copies of the Materials, and to
+# permit persons to whom the Materials are furnished to do so, subject to
+# the following conditions:
+#
+# The above copyright notice and this permission notice shall be included
+# unaltered in all copies or substantial portions of the Materials.
+# Any additions, deletions, or changes to the original source files
+# must be clearly indicated in accompanying documentation.
+#
+# If only executable code is distributed, then the accompanying
+# documentation must state that "this software is based in part on the
+# work of the Khronos Group."
+#
+# THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+# EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+# MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+# IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+# CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+# TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+# MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+
+# Generates the call capture table for libGLdispatch.
+#
+# In "wrappers" mode, this prints a capture function for every function in
+# the dispatch table. Each one records its dispatch offset and scalar
+# arguments with __glCaptureBegin(), and then calls through the head of the
+# API state's layer chain.
+#
+# In "info" mode, this prints the name and argument types of each function,
+# which the capture decoder uses to print a capture file.
+
+import license
+import gl_XML, glX_XML
+import sys, getopt
+
+# Argument type codes. These must match the GL_CAPTURE_ARG_* values in
+# GLcapture.h. Anything not listed here is stored by copying its bits, and
+# decoded as a hex value.
+arg_types = {
+    'GLfloat'    : 'f',
+    'GLclampf'   : 'f',
+    'GLdouble'   : 'd',
+    'GLclampd'   : 'd',
+    'GLenum'     : 'e',
+    'GLbitfield' : 'x',
+    'GLboolean'  : 'b',
+    'GLbyte'     : 'i',
+    'GLshort'    : 'i',
+    'GLint'      : 'i',
+    'GLsizei'    : 'i',
+    'GLintptr'   : 'i',
+    'GLsizeiptr' : 'i',
+    'GLfixed'    : 'i',
+    'GLclampx'   : 'i',
+    'GLint64'    : 'i',
+    'GLubyte'    : 'u',
+    'GLushort'   : 'u',
+    'GLuint'     : 'u',
+    'GLuint64'   : 'u',
+}
+
+def get_arg_type(p):
+    if p.is_pointer():
+        return 'p'
+    return arg_types.get(p.get_base_type_string(), 'x')
+
+def get_store_expr(p):
+    t = get_arg_type(p)
+    if t == 'p':
+        return '(uint64_t) (uintptr_t) %s' % (p.name)
+    elif t == 'f':
+        return '__glCaptureFloat(%s)' % (p.name)
+    elif t == 'd':
+        return '__glCaptureDouble(%s)' % (p.name)
+    elif t == 'i':
+        return '(uint64_t) (int64_t) %s' % (p.name)
+    elif t == 'x' and p.get_base_type_string() != 'GLbitfield':
+        return '__glCaptureBits(&%s, sizeof(%s))' % (p.name, p.name)
+    else:
+        return '(uint64_t) %s' % (p.name)
+
+def get_params(f):
+    return [p for p in f.parameterIterator() if not p.is_padding]
+
+
+class PrintWrappers(gl_XML.gl_print_base):
+
+    def __init__(self):
+        gl_XML.gl_print_base.__init__(self)
+
+        self.name = "gl_capture.py"
+        self.license = license.bsd_license_template % ( \
+"""Copyright (c) 2013, NVIDIA CORPORATION.""", "NVIDIA")
+        return
+
+
+    def printRealHeader(self):
+        print '#include <string.h>'
+        print '#include <stdint.h>'
+        print '#include <GL/gl.h>'
+        print ''
+        print '#include "GLdispatchPrivate.h"'
+        print '#include "glapitable.h"'
+        print ''
+        return
+
+
+    def printBody(self, api):
+        functions = list(api.functionIterateByOffset())
+
+        for f in functions:
+            params = get_params(f)
+
+            print 'static %s GLAPIENTRY' % (f.return_type)
+            print '__glCapture_%s(%s)' % (f.name, f.get_parameter_string())
+            print '{'
+            if len(params):
+                print '    uint64_t *args = __glCaptureBegin(%d, %d);' \
+                    % (f.offset, len(params))
+                print ''
+                print '    if (args) {'
+                for (i, p) in enumerate(params):
+                    print '        args[%d] = %s;' % (i, get_store_expr(p))
+                print '    }'
+                print ''
+            else:
+                print '    __glCaptureBegin(%d, 0);' % (f.offset)
+            if f.return_type == 'void':
+                print '    __glCaptureTable()->%s(%s);' \
+                    % (f.name, f.get_called_parameter_string())
+            else:
+                print '    return __glCaptureTable()->%s(%s);' \
+                    % (f.name, f.get_called_parameter_string())
+            print '}'
+            print ''
+
+        print 'const __GLdispatchProc __glCaptureProcs[] = {'
+        for f in functions:
+            print '    [%d] = (__GLdispatchProc) __glCapture_%s,' \
+                % (f.offset, f.name)
+        print '};'
+        print ''
+        print 'const int __glCaptureProcCount ='
+        print '    sizeof(__glCaptureProcs) / sizeof(__glCaptureProcs[0]);'
+        return
+
+
+class PrintInfo(gl_XML.gl_print_base):
+
+    def __init__(self):
+        gl_XML.gl_print_base.__init__(self)
+
+        self.name = "gl_capture.py"
+        self.license = license.bsd_license_template % ( \
+"""Copyright (c) 2013, NVIDIA CORPORATION.""", "NVIDIA")
+        return
+
+
+    def printRealHeader(self):
+        print '#include <stddef.h>'
+        print ''
+        print '#include "GLcapture.h"'
+        print ''
+        return
+
+
+    def printBody(self, api):
+        functions = list(api.functionIterateByOffset())
+
+        print 'const __GLcaptureFuncInfo __glCaptureFuncInfo[] = {'
+        for f in functions:
+            params = get_params(f)
+            print '    [%d] = { "%s", "%s" },' % (f.offset, f.name,
+                ''.join([get_arg_type(p) for p in params]))
+        print '};'
+        print ''
+        print 'const int __glCaptureFuncInfoCount ='
+        print '    sizeof(__glCaptureFuncInfo) / sizeof(__glCaptureFuncInfo[0]);'
+        return
+
+
+def show_usage():
+    print "Usage: %s [-f input_file_name] [-m mode]" % sys.argv[0]
+    print "    -m mode   Mode can be 'wrappers' or 'info'."
+    sys.exit(1)
+
+if __name__ == '__main__':
+    file_name = "gl_API.xml"
+
+    try:
+        (args, trail) = getopt.getopt(sys.argv[1:], "m:f:")
+    except Exception,e:
+        show_usage()
+
+    mode = "wrappers"
+    for (arg,val) in args:
+        if arg == "-f":
+            file_name = val
+        elif arg == "-m":
+            mode = val
+
+    if mode == "wrappers":
+        printer = PrintWrappers()
+    elif mode == "info":
+        printer = PrintInfo()
+    else:
+        show_usage()
+
+    api = gl_XML.parse_GL_API(file_name, glX_XML.glx_item_factory())
+    printer.Print(api)
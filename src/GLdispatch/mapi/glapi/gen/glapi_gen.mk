@@ -55,3 +55,14 @@ define glapi_gen_remap
 $(AM_V_GEN)$(PYTHON2) $(PYTHON_FLAGS) $(glapi_gen_remap_script) \
 	-f $(1) $(if $(2),-c $(2),) > $@
 endef
+
+glapi_gen_capture_script := $(top_srcdir)/$(MAPI_PREFIX)/glapi/gen/gl_capture.py
+glapi_gen_capture_deps := $(glapi_gen_common_deps)
+
+# $(1): path to an XML file
+# $(2): wrappers or info
+define glapi_gen_capture
+@mkdir -p $(dir $@)
+$(AM_V_GEN)$(PYTHON2) $(PYTHON_FLAGS) $(glapi_gen_capture_script) \
+	-f $(1) -m $(2) > $@
+endef
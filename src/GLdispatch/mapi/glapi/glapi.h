@@ -152,6 +152,13 @@ _glapi_get_context(void);
 _GLAPI_EXPORT void
 _glapi_set_dispatch(struct _glapi_table *dispatch);
 
+/*
+ * Like _glapi_set_dispatch(), but only valid on a thread which already has a
+ * dispatch table, and dispatch must not be NULL.
+ */
+_GLAPI_EXPORT void
+_glapi_swap_dispatch(struct _glapi_table *dispatch);
+
 _GLAPI_EXPORT void
 _glapi_set_current(void *p, int index);
 
@@ -179,10 +186,32 @@ _GLAPI_EXPORT _glapi_proc
 _glapi_get_proc_address(const char *funcName);
 
 
+_GLAPI_EXPORT _glapi_proc
+_glapi_find_proc_address(const char *funcName);
+
+
 _GLAPI_EXPORT const char *
 _glapi_get_proc_name(unsigned int offset);
 
 
+_GLAPI_EXPORT void
+_glapi_set_resolve_func(_glapi_proc (*func)(int offset));
+
+
+_GLAPI_EXPORT _glapi_proc
+_glapi_get_resolver(unsigned int offset);
+
+
+_GLAPI_EXPORT void
+_glapi_set_profile_funcs(_glapi_proc (*enter)(int offset,
+                                              unsigned long long *sample),
+                         void (*exit)(int offset, unsigned long long sample));
+
+
+_GLAPI_EXPORT _glapi_proc
+_glapi_get_profiler(unsigned int offset);
+
+
 _GLAPI_EXPORT struct _glapi_table *
 _glapi_create_table_from_handle(void *handle, const char *symbol_prefix);
 
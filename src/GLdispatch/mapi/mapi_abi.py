@@ -37,8 +37,78 @@ import gl_XML
 import glX_XML
 
 
-# number of dynamic entries
-ABI_NUM_DYNAMIC_ENTRIES = 256
+# The average number of names in each bucket of the public stub hash, and the
+# number of seeds to try before giving up. See _abi_try_perfect_hash().
+ABI_HASH_BUCKET_SIZE = 4
+ABI_HASH_MAX_SEEDS = 100
+
+# number of dynamic entries. Every dispatch table has room for all of them,
+# so this costs 8 bytes per table per entry, but the stubs themselves are only
+# generated as they're needed.
+ABI_NUM_DYNAMIC_ENTRIES = 4096
+
+def _abi_hash(name, seed):
+    """Return the two hashes of a stub name. This must match stub_hash() in
+    stub.c."""
+    h1 = (2166136261 ^ seed) & 0xffffffff
+    h2 = seed
+    for c in name:
+        h1 = ((h1 ^ ord(c)) * 16777619) & 0xffffffff
+        h2 = (h2 * 31 + ord(c)) & 0xffffffff
+    return (h1, h2)
+
+def _abi_hash_mix(h):
+    """Return the 32-bit finalizer from MurmurHash3. This must match
+    stub_hash_mix() in stub.c."""
+    h ^= h >> 16
+    h = (h * 0x85ebca6b) & 0xffffffff
+    h ^= h >> 13
+    h = (h * 0xc2b2ae35) & 0xffffffff
+    h ^= h >> 16
+    return h
+
+def _abi_try_perfect_hash(entries, num_buckets, seed):
+    """Try to build a minimal perfect hash of the entry names, using the
+    hash-and-displace method.
+
+    The first hash of each name picks a bucket. Each bucket gets the smallest
+    displacement d which sends all of its names to unused indices, where the
+    index of a name is mix(h2 + d) % len(entries). The biggest buckets are
+    placed first, while most indices are still free.
+
+    Returns (displacements, entries in index order), or None if two names
+    can't be separated with this seed.
+    """
+    num_entries = len(entries)
+    buckets = [[] for i in xrange(num_buckets)]
+    for ent in entries:
+        h1, h2 = _abi_hash(ent.name, seed)
+        buckets[h1 % num_buckets].append((ent, h2))
+
+    order = range(num_buckets)
+    order.sort(lambda x, y: cmp(len(buckets[y]), len(buckets[x])))
+
+    displacements = [0] * num_buckets
+    placed = [None] * num_entries
+    for b in order:
+        if not buckets[b]:
+            break
+
+        for d in xrange(65536):
+            indices = [_abi_hash_mix((h2 + d) & 0xffffffff) % num_entries
+                    for ent, h2 in buckets[b]]
+            if len(set(indices)) != len(indices):
+                continue
+            if [i for i in indices if placed[i] is not None]:
+                continue
+            for i, (ent, h2) in zip(indices, buckets[b]):
+                placed[i] = ent
+            displacements[b] = d
+            break
+        else:
+            return None
+
+    return (displacements, placed)
 
 class ABIEntry(object):
     """Represent an ABI entry."""
@@ -486,15 +556,74 @@ class ABIPrinter(object):
                 ('\\0"\n' + self.indent + '"').join(pool) + '";'
         return (pool_str, offsets)
 
-    def c_stub_initializer(self, prefix, pool_offsets):
+    def c_stub_initializer(self, prefix, pool_offsets, stub_entries):
         """Return the initializer for struct mapi_stub array."""
         stubs = []
-        for ent in self.entries_sorted_by_names:
+        for ent in stub_entries:
             stubs.append('%s{ (void *) %d, %d, NULL }' % (
                 self.indent, pool_offsets[ent], ent.slot))
 
         return ',\n'.join(stubs)
 
+    def c_stub_lengths(self, stub_entries):
+        """Return the initializer for the name lengths of the stubs."""
+        lengths = []
+        for ent in stub_entries:
+            if len(ent.name) > 255:
+                raise Exception('%s is too long' % (ent.name))
+            lengths.append('%d' % (len(ent.name)))
+
+        return self._c_wrap_list(lengths)
+
+    def c_stub_slot_index(self, stub_entries):
+        """Return the initializer for the index of the stub of each slot.
+
+        Each slot maps to the entry that the others alias, so that looking
+        up a slot gives the same name no matter what order the stubs are in.
+        """
+        num_static_entries = self.entries[-1].slot + 1
+        if len(stub_entries) > 65535:
+            raise Exception('too many stubs for public_stubs_by_slot')
+
+        indices = [None] * num_static_entries
+        for i, ent in enumerate(stub_entries):
+            if not ent.alias:
+                indices[ent.slot] = '%d' % (i)
+
+        return self._c_wrap_list(indices)
+
+    def c_stub_perfect_hash(self):
+        """Return a minimal perfect hash of the stub names.
+
+        This returns (seed, displacements, entries). The entries are in the
+        order that the hash maps them to, so that the hash of a name is the
+        index of its stub. The C side of this is stub_find_public().
+        """
+        num_entries = len(self.entries_sorted_by_names)
+        num_buckets = max(num_entries // ABI_HASH_BUCKET_SIZE, 1)
+
+        for seed in xrange(ABI_HASH_MAX_SEEDS):
+            result = _abi_try_perfect_hash(self.entries_sorted_by_names,
+                    num_buckets, seed)
+            if result:
+                return (seed, result[0], result[1])
+
+        raise Exception('failed to find a perfect hash for %d stubs' %
+                (num_entries))
+
+    def _c_wrap_list(self, values):
+        """Return a comma-separated list of values, wrapped to 80 columns."""
+        lines = []
+        line = self.indent
+        for val in values:
+            if len(line) + len(val) + 2 > 79:
+                lines.append(line.rstrip())
+                line = self.indent
+            line += val + ', '
+        lines.append(line.rstrip())
+
+        return '\n'.join(lines)
+
     def c_noop_functions(self, prefix, warn_prefix, keywords):
         """Return the noop functions."""
         noops = []
@@ -628,8 +757,26 @@ class ABIPrinter(object):
             print 'static const char public_string_pool[] ='
             print pool
             print
+            seed, displacements, stub_entries = self.c_stub_perfect_hash()
             print 'static const struct mapi_stub public_stubs[] = {'
-            print self.c_stub_initializer(self.prefix_lib, pool_offsets)
+            print self.c_stub_initializer(self.prefix_lib, pool_offsets,
+                                          stub_entries)
+            print '};'
+            print
+            print 'static const unsigned char public_stub_lengths[] = {'
+            print self.c_stub_lengths(stub_entries)
+            print '};'
+            print
+            print '#define PUBLIC_STUB_HASH_SEED %du' % (seed)
+            print '#define PUBLIC_STUB_HASH_NUM_BUCKETS %d' % (
+                    len(displacements))
+            print
+            print 'static const unsigned short public_stub_hash_displacements[] = {'
+            print self._c_wrap_list(['%d' % (d) for d in displacements])
+            print '};'
+            print
+            print 'static const unsigned short public_stubs_by_slot[] = {'
+            print self.c_stub_slot_index(stub_entries)
             print '};'
             print '#undef MAPI_TMP_PUBLIC_STUBS'
             print '#endif /* MAPI_TMP_PUBLIC_STUBS */'
@@ -66,6 +66,12 @@ _glapi_set_dispatch(struct _glapi_table *dispatch)
    u_current_set((const struct mapi_table *) dispatch);
 }
 
+void
+_glapi_swap_dispatch(struct _glapi_table *dispatch)
+{
+   u_current_swap((const struct mapi_table *) dispatch);
+}
+
 void
 _glapi_set_current(void *p, int index)
 {
@@ -222,6 +228,17 @@ _glapi_get_proc_address(const char *funcName)
    return (stub) ? (_glapi_proc) stub_get_addr(stub) : NULL;
 }
 
+/**
+ * Like _glapi_get_proc_address(), but return NULL instead of generating a
+ * new entrypoint if the function doesn't have one yet.
+ */
+_glapi_proc
+_glapi_find_proc_address(const char *funcName)
+{
+   const struct mapi_stub *stub = _glapi_get_stub(funcName, 0);
+   return (stub) ? (_glapi_proc) stub_get_addr(stub) : NULL;
+}
+
 /**
  * Return the name of the function at the given dispatch offset.
  * This is only intended for debugging.
@@ -233,6 +250,58 @@ _glapi_get_proc_name(unsigned int offset)
    return stub ? stub_get_name(stub) : NULL;
 }
 
+/**
+ * Set the function which the resolver trampolines call on their first call to
+ * look up the real function for a dispatch offset.
+ */
+void
+_glapi_set_resolve_func(_glapi_proc (*func)(int offset))
+{
+   entry_set_resolve_func((entry_resolve_func) func);
+}
+
+/**
+ * Return the resolver trampoline for the given dispatch offset. When called,
+ * the trampoline calls the resolve function with the offset, and then jumps
+ * to the function it returns with the original arguments.
+ *
+ * Returns NULL if resolver trampolines aren't supported on this platform, or
+ * if no resolve function has been set.
+ */
+_glapi_proc
+_glapi_get_resolver(unsigned int offset)
+{
+   return (_glapi_proc) entry_get_resolver(offset);
+}
+
+/**
+ * Set the functions which the profiling trampolines call. The enter function
+ * is called before every call with the dispatch offset, and returns the real
+ * function to call. If it sets *sample to a non-zero value, then the exit
+ * function is called with the offset and that value when the real function
+ * returns.
+ */
+void
+_glapi_set_profile_funcs(_glapi_proc (*enter)(int offset,
+                                              unsigned long long *sample),
+                         void (*exit)(int offset, unsigned long long sample))
+{
+   entry_set_profile_funcs((entry_profile_enter_func) enter,
+                           (entry_profile_exit_func) exit);
+}
+
+/**
+ * Return the profiling trampoline for the given dispatch offset.
+ *
+ * Returns NULL if profiling trampolines aren't supported on this platform, or
+ * if no profile functions have been set.
+ */
+_glapi_proc
+_glapi_get_profiler(unsigned int offset)
+{
+   return (_glapi_proc) entry_get_profiler(offset);
+}
+
 unsigned long
 _glthread_GetID(void)
 {
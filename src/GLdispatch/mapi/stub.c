@@ -51,6 +51,26 @@ static struct mapi_stub dynamic_stubs[MAPI_TABLE_NUM_DYNAMIC];
 static int num_dynamic_stubs;
 static int next_dynamic_slot = MAPI_TABLE_NUM_STATIC;
 
+/*
+ * An open-addressing hash of the dynamic stubs by name, with linear probing.
+ * It's twice as big as dynamic_stubs, so it never fills up. Stubs are never
+ * removed, so readers can search it without a lock: a writer fills in a stub
+ * before it stores the stub's pointer here, and a reader stops at the first
+ * empty entry.
+ */
+#define DYNAMIC_HASH_SIZE (2 * MAPI_TABLE_NUM_DYNAMIC)
+
+static struct mapi_stub *dynamic_hash[DYNAMIC_HASH_SIZE];
+
+/*
+ * The dynamic stub for each dynamic slot, indexed by slot minus
+ * MAPI_TABLE_NUM_STATIC. If several stubs share a slot, this is the first
+ * one that was given it.
+ */
+static struct mapi_stub *dynamic_stubs_by_slot[MAPI_TABLE_NUM_DYNAMIC];
+
+u_mutex_declare_static(dynamic_mutex);
+
 void
 stub_init_once(void)
 {
@@ -66,30 +86,116 @@ stub_init_once(void)
 #endif
 }
 
-static int
-stub_compare(const void *key, const void *elem)
+/**
+ * The 32-bit finalizer from MurmurHash3. This must match _abi_hash_mix() in
+ * mapi_abi.py.
+ */
+static INLINE unsigned int
+stub_hash_mix(unsigned int h)
 {
-   const char *name = (const char *) key;
-   const struct mapi_stub *stub = (const struct mapi_stub *) elem;
-   const char *stub_name;
+   h ^= h >> 16;
+   h *= 0x85ebca6bu;
+   h ^= h >> 13;
+   h *= 0xc2b2ae35u;
+   h ^= h >> 16;
+   return h;
+}
 
-   stub_name = &public_string_pool[(unsigned long) stub->name];
+/**
+ * Return the index in public_stubs that a name hashes to, and the length of
+ * the name. This must match _abi_hash() in mapi_abi.py.
+ */
+static INLINE unsigned int
+stub_hash(const char *name, size_t *len)
+{
+   unsigned int h1 = 2166136261u ^ PUBLIC_STUB_HASH_SEED;
+   unsigned int h2 = PUBLIC_STUB_HASH_SEED;
+   const unsigned char *p;
+   unsigned int d;
+
+   for (p = (const unsigned char *) name; *p; p++) {
+      h1 = (h1 ^ *p) * 16777619u;
+      h2 = h2 * 31 + *p;
+   }
+   *len = p - (const unsigned char *) name;
 
-   return strcmp(name, stub_name);
+   d = public_stub_hash_displacements[h1 % PUBLIC_STUB_HASH_NUM_BUCKETS];
+   return stub_hash_mix(h2 + d) % ARRAY_SIZE(public_stubs);
 }
 
 /**
  * Return the public stub with the given name.
+ *
+ * mapi_abi.py generates a minimal perfect hash of the public stub names, and
+ * sorts public_stubs by it, so the only stub that can match is the one that
+ * the name hashes to.
  */
 const struct mapi_stub *
 stub_find_public(const char *name)
 {
-   return (const struct mapi_stub *) bsearch(name, public_stubs,
-         ARRAY_SIZE(public_stubs), sizeof(public_stubs[0]), stub_compare);
+   const struct mapi_stub *stub;
+   unsigned int idx;
+   size_t len;
+
+   idx = stub_hash(name, &len);
+   stub = &public_stubs[idx];
+
+   if (public_stub_lengths[idx] != len ||
+       memcmp(name, &public_string_pool[(unsigned long) stub->name], len))
+      return NULL;
+
+   return stub;
+}
+
+static unsigned int
+dynamic_hash_index(const char *name)
+{
+   unsigned int h = 2166136261u;
+   const unsigned char *p;
+
+   for (p = (const unsigned char *) name; *p; p++)
+      h = (h ^ *p) * 16777619u;
+
+   return stub_hash_mix(h) % DYNAMIC_HASH_SIZE;
 }
 
 /**
- * Add a dynamic stub.
+ * Return the dynamic stub with the given name, or NULL. This doesn't need
+ * the dynamic stub mutex.
+ */
+static struct mapi_stub *
+dynamic_hash_find(const char *name)
+{
+   unsigned int idx = dynamic_hash_index(name);
+   struct mapi_stub *stub;
+
+   while ((stub = __atomic_load_n(&dynamic_hash[idx], __ATOMIC_ACQUIRE))) {
+      if (strcmp(name, (const char *) stub->name) == 0)
+         return stub;
+      idx = (idx + 1) % DYNAMIC_HASH_SIZE;
+   }
+
+   return NULL;
+}
+
+/**
+ * Add a stub to the dynamic stub hash. Calls to this function must be
+ * protected by the dynamic stub mutex.
+ */
+static void
+dynamic_hash_add(struct mapi_stub *stub)
+{
+   unsigned int idx = dynamic_hash_index((const char *) stub->name);
+
+   while (dynamic_hash[idx])
+      idx = (idx + 1) % DYNAMIC_HASH_SIZE;
+
+   __atomic_store_n(&dynamic_hash[idx], stub, __ATOMIC_RELEASE);
+}
+
+/**
+ * Add a dynamic stub. Calls to this function must be protected by the
+ * dynamic stub mutex.
  */
 static struct mapi_stub *
 stub_add_dynamic(const char *name)
@@ -110,11 +216,15 @@ stub_add_dynamic(const char *name)
    if (!stub->addr)
       return NULL;
 
-   stub->name = (const void *) name;
+   /* the caller's string might not outlive the stub */
+   stub->name = (const void *) strdup(name);
+   if (!stub->name)
+      return NULL;
    /* to be fixed later */
    stub->slot = -1;
 
    num_dynamic_stubs = idx + 1;
+   dynamic_hash_add(stub);
 
    return stub;
 }
@@ -122,56 +232,45 @@ stub_add_dynamic(const char *name)
 /**
  * Return the dynamic stub with the given name.  If no such stub exists and
  * generate is true, a new stub is generated.
+ *
+ * Looking up an existing stub doesn't take a lock. Only generating a new one
+ * does.
  */
 struct mapi_stub *
 stub_find_dynamic(const char *name, int generate)
 {
-   u_mutex_declare_static(dynamic_mutex);
-   struct mapi_stub *stub = NULL;
-   int count, i;
-   
-   u_mutex_lock(dynamic_mutex);
+   struct mapi_stub *stub;
 
-   if (generate)
-      assert(!stub_find_public(name));
+   stub = dynamic_hash_find(name);
+   if (stub || !generate)
+      return stub;
 
-   count = num_dynamic_stubs;
-   for (i = 0; i < count; i++) {
-      if (strcmp(name, (const char *) dynamic_stubs[i].name) == 0) {
-         stub = &dynamic_stubs[i];
-         break;
-      }
-   }
+   assert(!stub_find_public(name));
 
-   /* generate a dynamic stub */
-   if (generate && !stub)
-         stub = stub_add_dynamic(name);
+   u_mutex_lock(dynamic_mutex);
+
+   /* another thread might have generated it while we were waiting */
+   stub = dynamic_hash_find(name);
+   if (!stub)
+      stub = stub_add_dynamic(name);
 
    u_mutex_unlock(dynamic_mutex);
 
    return stub;
 }
 
-static const struct mapi_stub *
-search_table_by_slot(const struct mapi_stub *table, size_t num_entries,
-                     int slot)
-{
-   size_t i;
-   for (i = 0; i < num_entries; ++i) {
-      if (table[i].slot == slot)
-         return &table[i];
-   }
-   return NULL;
-}
-
 const struct mapi_stub *
 stub_find_by_slot(int slot)
 {
-   const struct mapi_stub *stub =
-      search_table_by_slot(public_stubs, ARRAY_SIZE(public_stubs), slot);
-   if (stub)
-      return stub;
-   return search_table_by_slot(dynamic_stubs, num_dynamic_stubs, slot);
+   if (slot < 0)
+      return NULL;
+   if (slot < MAPI_TABLE_NUM_STATIC)
+      return &public_stubs[public_stubs_by_slot[slot]];
+   if (slot < MAPI_TABLE_NUM_STATIC + MAPI_TABLE_NUM_DYNAMIC)
+      return __atomic_load_n(
+            &dynamic_stubs_by_slot[slot - MAPI_TABLE_NUM_STATIC],
+            __ATOMIC_ACQUIRE);
+   return NULL;
 }
 
 void
@@ -189,6 +288,11 @@ stub_fix_dynamic(struct mapi_stub *stub, const struct mapi_stub *alias)
 
    entry_patch(stub->addr, slot);
    stub->slot = slot;
+
+   if (slot >= MAPI_TABLE_NUM_STATIC &&
+       !dynamic_stubs_by_slot[slot - MAPI_TABLE_NUM_STATIC])
+      __atomic_store_n(&dynamic_stubs_by_slot[slot - MAPI_TABLE_NUM_STATIC],
+                       stub, __ATOMIC_RELEASE);
 }
 
 /**
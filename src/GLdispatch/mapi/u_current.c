@@ -257,6 +257,24 @@ u_current_set(const struct mapi_table *tbl)
 #endif
 }
 
+/**
+ * Replace the current dispatch table of this thread. Unlike u_current_set(),
+ * this skips the one-time initialization, so it's only valid on a thread which
+ * already has a table set with u_current_set(). The table must not be NULL.
+ */
+void
+u_current_swap(const struct mapi_table *tbl)
+{
+#if defined(GLX_USE_TLS)
+   u_current[U_CURRENT_TABLE] = (void *) tbl;
+#elif defined(THREADS)
+   u_tsd_set(&u_current_tsd[U_CURRENT_TABLE], (void *) tbl);
+   u_current[U_CURRENT_TABLE] = (ThreadSafe) ? NULL : (void *) tbl;
+#else
+   u_current[U_CURRENT_TABLE] = (void *) tbl;
+#endif
+}
+
 void
 u_current_set_index(void *p, int index)
 {
@@ -66,6 +66,9 @@ u_current_destroy(void);
 void
 u_current_set(const struct mapi_table *tbl);
 
+void
+u_current_swap(const struct mapi_table *tbl);
+
 void
 u_current_set_index(void *p, int index);
 
@@ -37,11 +37,24 @@
 #include "u_execmem.h"
 
 
+/*
+ * The first mapping is one page. When a mapping fills up, the next one is
+ * twice as big, up to EXEC_MAP_MAX_SIZE, so that a process which generates
+ * thousands of stubs only needs a handful of mappings.
+ */
 #define EXEC_MAP_SIZE (4*1024)
+#define EXEC_MAP_MAX_SIZE (64*1024)
+
+/*
+ * Every allocation is rounded up to this, so that each dynamic stub starts
+ * on the same alignment as the static stubs.
+ */
+#define EXEC_ALIGN 32
 
 u_mutex_declare_static(exec_mutex);
 
 static unsigned int head = 0;
+static unsigned int exec_size = 0;
 
 static unsigned char *exec_mem = (unsigned char *)0;
 
@@ -63,25 +76,27 @@ static unsigned char *exec_mem = (unsigned char *)0;
 
 /*
  * Dispatch stubs are of fixed size and never freed. Thus, we do not need to
- * overlay a heap, we just mmap a page and manage through an index.
+ * overlay a heap, we just mmap pages and manage them through an index. Once
+ * a mapping is full, we leave it alone and start a new one.
  */
 
-static int
-init_map(void)
+static void *
+new_map(unsigned int size)
 {
+   void *addr;
+
 #ifdef MESA_SELINUX
    if (is_selinux_enabled()) {
       if (!security_get_boolean_active("allow_execmem") ||
 	  !security_get_boolean_pending("allow_execmem"))
-         return 0;
+         return NULL;
    }
 #endif
 
-   if (!exec_mem)
-      exec_mem = mmap(NULL, EXEC_MAP_SIZE, PROT_EXEC | PROT_READ | PROT_WRITE,
-		      MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+   addr = mmap(NULL, size, PROT_EXEC | PROT_READ | PROT_WRITE,
+               MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
 
-   return (exec_mem != MAP_FAILED);
+   return (addr != MAP_FAILED) ? addr : NULL;
 }
 
 
@@ -94,12 +109,10 @@ init_map(void)
  * Avoid Data Execution Prevention.
  */
 
-static int
-init_map(void)
+static void *
+new_map(unsigned int size)
 {
-   exec_mem = VirtualAlloc(NULL, EXEC_MAP_SIZE, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
-
-   return (exec_mem != NULL);
+   return VirtualAlloc(NULL, size, MEM_COMMIT, PAGE_EXECUTE_READWRITE);
 }
 
 
@@ -107,12 +120,15 @@ init_map(void)
 
 #include <stdlib.h>
 
-static int
-init_map(void)
+static void *
+new_map(unsigned int size)
 {
-   exec_mem = malloc(EXEC_MAP_SIZE);
+   void *addr;
 
-   return (exec_mem != NULL);
+   if (posix_memalign(&addr, EXEC_ALIGN, size) != 0)
+      return NULL;
+
+   return addr;
 }
 
 
@@ -122,17 +138,32 @@ void *
 u_execmem_alloc(unsigned int size)
 {
    void *addr = NULL;
+   unsigned int map_size;
+   unsigned char *map;
 
-   u_mutex_lock(exec_mutex);
+   size = (size + EXEC_ALIGN - 1) & ~(EXEC_ALIGN - 1);
+   if (size == 0 || size > EXEC_MAP_MAX_SIZE)
+      return NULL;
 
-   if (!init_map())
-      goto bail;
+   u_mutex_lock(exec_mutex);
 
    /* free space check, assumes no integer overflow */
-   if (head + size > EXEC_MAP_SIZE)
-      goto bail;
+   if (!exec_mem || head + size > exec_size) {
+      map_size = (exec_size) ? exec_size * 2 : EXEC_MAP_SIZE;
+      if (map_size > EXEC_MAP_MAX_SIZE)
+         map_size = EXEC_MAP_MAX_SIZE;
+
+      map = new_map(map_size);
+      if (!map)
+         goto bail;
+
+      /* whatever is left of the old mapping is too small, and stays unused */
+      exec_mem = map;
+      exec_size = map_size;
+      head = 0;
+   }
 
-   /* allocation, assumes proper addr and size alignement */
+   /* allocation, the start of each mapping is at least EXEC_ALIGN aligned */
    addr = exec_mem + head;
    head += size;
 
@@ -141,5 +172,3 @@ bail:
 
    return addr;
 }
-
-
@@ -48,10 +48,13 @@ typedef struct GLVNDPthreadRealFuncsRec {
 
     /* Locking primitives */
     int (*mutex_lock)(pthread_mutex_t *mutex);
+    int (*mutex_trylock)(pthread_mutex_t *mutex);
     int (*mutex_unlock)(pthread_mutex_t *mutex);
     int (*rwlock_init)(pthread_rwlock_t *rwlock, const pthread_rwlockattr_t *attr);
     int (*rwlock_rdlock)(pthread_rwlock_t *rwlock);
     int (*rwlock_wrlock)(pthread_rwlock_t *rwlock);
+    int (*rwlock_tryrdlock)(pthread_rwlock_t *rwlock);
+    int (*rwlock_trywrlock)(pthread_rwlock_t *rwlock);
     int (*rwlock_unlock)(pthread_rwlock_t *rwlock);
 
     /* Other used functions */
@@ -119,6 +122,10 @@ static int st_mutex_lock(glvnd_mutex_t *mutex)
 {
     return 0;
 }
+static int st_mutex_trylock(glvnd_mutex_t *mutex)
+{
+    return 0;
+}
 static int st_mutex_unlock(glvnd_mutex_t *mutex)
 {
     return 0;
@@ -139,6 +146,16 @@ static int st_rwlock_wrlock(glvnd_rwlock_t *rwlock)
     return 0;
 }
 
+static int st_rwlock_tryrdlock(glvnd_rwlock_t *rwlock)
+{
+    return 0;
+}
+
+static int st_rwlock_trywrlock(glvnd_rwlock_t *rwlock)
+{
+    return 0;
+}
+
 static int st_rwlock_unlock(glvnd_rwlock_t *rwlock)
 {
     return 0;
@@ -192,6 +209,10 @@ static int mt_mutex_lock(glvnd_mutex_t *mutex)
 {
     return pthreadRealFuncs.mutex_lock(mutex);
 }
+static int mt_mutex_trylock(glvnd_mutex_t *mutex)
+{
+    return pthreadRealFuncs.mutex_trylock(mutex);
+}
 static int mt_mutex_unlock(glvnd_mutex_t *mutex)
 {
     return pthreadRealFuncs.mutex_unlock(mutex);
@@ -212,6 +233,16 @@ static int mt_rwlock_wrlock(glvnd_rwlock_t *rwlock)
     return pthreadRealFuncs.rwlock_wrlock(rwlock);
 }
 
+static int mt_rwlock_tryrdlock(glvnd_rwlock_t *rwlock)
+{
+    return pthreadRealFuncs.rwlock_tryrdlock(rwlock);
+}
+
+static int mt_rwlock_trywrlock(glvnd_rwlock_t *rwlock)
+{
+    return pthreadRealFuncs.rwlock_trywrlock(rwlock);
+}
+
 static int mt_rwlock_unlock(glvnd_rwlock_t *rwlock)
 {
     return pthreadRealFuncs.rwlock_unlock(rwlock);
@@ -235,6 +266,7 @@ int glvndSetupPthreads(void *dlhandle, GLVNDPthreadFuncs *funcs)
     GET_MT_FUNC(funcs, dlhandle, self);
     GET_MT_FUNC(funcs, dlhandle, equal);
     GET_MT_FUNC(funcs, dlhandle, mutex_lock);
+    GET_MT_FUNC(funcs, dlhandle, mutex_trylock);
     GET_MT_FUNC(funcs, dlhandle, mutex_unlock);
 
     // TODO: these can fall back on internal implementations
@@ -242,6 +274,8 @@ int glvndSetupPthreads(void *dlhandle, GLVNDPthreadFuncs *funcs)
     GET_MT_FUNC(funcs, dlhandle, rwlock_init);
     GET_MT_FUNC(funcs, dlhandle, rwlock_rdlock);
     GET_MT_FUNC(funcs, dlhandle, rwlock_wrlock);
+    GET_MT_FUNC(funcs, dlhandle, rwlock_tryrdlock);
+    GET_MT_FUNC(funcs, dlhandle, rwlock_trywrlock);
     GET_MT_FUNC(funcs, dlhandle, rwlock_unlock);
     GET_MT_FUNC(funcs, dlhandle, once);
 
@@ -259,10 +293,13 @@ fail:
     GET_ST_FUNC(funcs, self);
     GET_ST_FUNC(funcs, equal);
     GET_ST_FUNC(funcs, mutex_lock);
+    GET_ST_FUNC(funcs, mutex_trylock);
     GET_ST_FUNC(funcs, mutex_unlock);
     GET_ST_FUNC(funcs, rwlock_init);
     GET_ST_FUNC(funcs, rwlock_rdlock);
     GET_ST_FUNC(funcs, rwlock_wrlock);
+    GET_ST_FUNC(funcs, rwlock_tryrdlock);
+    GET_ST_FUNC(funcs, rwlock_trywrlock);
     GET_ST_FUNC(funcs, rwlock_unlock);
     GET_ST_FUNC(funcs, once);
 
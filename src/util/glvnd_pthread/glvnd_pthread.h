@@ -85,10 +85,13 @@ typedef struct GLVNDPthreadFuncsRec {
 
     /* Locking primitives */
     int (*mutex_lock)(glvnd_mutex_t *mutex);
+    int (*mutex_trylock)(glvnd_mutex_t *mutex);
     int (*mutex_unlock)(glvnd_mutex_t *mutex);
     int (*rwlock_init)(glvnd_rwlock_t *rwlock, const glvnd_rwlockattr_t *attr);
     int (*rwlock_rdlock)(glvnd_rwlock_t *rwlock);
     int (*rwlock_wrlock)(glvnd_rwlock_t *rwlock);
+    int (*rwlock_tryrdlock)(glvnd_rwlock_t *rwlock);
+    int (*rwlock_trywrlock)(glvnd_rwlock_t *rwlock);
     int (*rwlock_unlock)(glvnd_rwlock_t *rwlock);
 
     /* Other used functions */
@@ -32,6 +32,8 @@
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
+#include <stdint.h>
+#include <time.h>
 #include <GL/glx.h>
 #include <GL/glxint.h>
 
@@ -44,6 +46,12 @@
 
 static char *thisVendorName;
 static __GLXapiExports apiExports;
+static const __GLXapiImports dummyImports;
+
+/*
+ * Auxiliary dispatch table for GL_MC_AUX_DISPATCH, shared by every thread.
+ */
+static __GLXcoreDispatchTable *auxDispatch;
 
 /*
  * Dummy context structure.
@@ -54,16 +62,237 @@ typedef struct __GLXcontextRec {
     GLint endHit;
 } __GLXcontext;
 
-static XVisualInfo*  dummyChooseVisual          (Display *dpy,
-                                                 int screen,
-                                                 int *attrib_list)
+#define DUMMY_FUNC_NAME(name) #name,
+
+static const char *dummyFuncNames[DUMMY_FUNC_COUNT] = {
+    DUMMY_FUNCS(DUMMY_FUNC_NAME)
+};
+
+/*
+ * Number of calls to each entry point, and how long each one busy-waits for,
+ * in nanoseconds. The latencies are set in __glx_Main() and never change
+ * after that.
+ */
+static volatile GLuint64 callCounts[DUMMY_FUNC_COUNT];
+static uint64_t latencies[DUMMY_FUNC_COUNT];
+
+/*
+ * Set if the __GLX_DUMMY_STATS environment variable is set. The call counts
+ * are printed when the library is unloaded.
+ */
+static int printStats;
+
+/*
+ * The number of FBConfigs on each screen, from __GLX_DUMMY_FBCONFIGS.
+ */
+static int numFBConfigs;
+
+static uint64_t GetTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Called at the start of each entry point in DUMMY_FUNCS. This spins instead
+ * of sleeping, since a real vendor would be using the CPU.
+ */
+static void DummyCall(int func)
+{
+    uint64_t start;
+
+    __sync_fetch_and_add(&callCounts[func], 1);
+
+    if (latencies[func]) {
+        start = GetTime();
+        while (GetTime() - start < latencies[func]) {
+            // Spin
+        }
+    }
+}
+
+/*
+ * Parses a __GLX_DUMMY_LATENCY string. See GLX_dummy.h for the format.
+ */
+static void ParseLatencies(const char *str)
+{
+    const char *name, *end;
+    char *valueEnd;
+    unsigned long long value;
+    size_t len;
+    int i;
+
+    for (name = str; *name; name = (*end ? end + 1 : end)) {
+        end = name + strcspn(name, ",");
+        len = strcspn(name, "=,");
+        if (name[len] != '=') {
+            continue;
+        }
+        value = strtoull(name + len + 1, &valueEnd, 10);
+        if (valueEnd != end) {
+            continue;
+        }
+
+        if (len == 1 && name[0] == '*') {
+            for (i = 0; i < DUMMY_FUNC_COUNT; i++) {
+                latencies[i] = value;
+            }
+            continue;
+        }
+        for (i = 0; i < DUMMY_FUNC_COUNT; i++) {
+            if (strlen(dummyFuncNames[i]) == len &&
+                !strncmp(dummyFuncNames[i], name, len)) {
+                latencies[i] = value;
+                break;
+            }
+        }
+    }
+}
+
+static void LoadCostModel(const char *vendorName)
+{
+    const char *str;
+    char *varName;
+
+    str = getenv("__GLX_DUMMY_LATENCY");
+    if (str) {
+        ParseLatencies(str);
+    }
+
+    if (vendorName &&
+        asprintf(&varName, "__GLX_DUMMY_LATENCY_%s", vendorName) >= 0) {
+        str = getenv(varName);
+        if (str) {
+            ParseLatencies(str);
+        }
+        free(varName);
+    }
+
+    str = getenv("__GLX_DUMMY_FBCONFIGS");
+    if (str) {
+        numFBConfigs = atoi(str);
+        if (numFBConfigs < 0) {
+            numFBConfigs = 0;
+        }
+    }
+
+    printStats = (getenv("__GLX_DUMMY_STATS") != NULL);
+}
+
+static void __attribute__ ((destructor)) PrintDummyStats(void)
+{
+    int i;
+
+    if (!printStats) {
+        return;
+    }
+
+    fprintf(stderr, "GLX_dummy (%s) calls:\n",
+            thisVendorName ? thisVendorName : "unknown");
+    fprintf(stderr, "%12s %12s  %s\n", "calls", "latency_ns", "function");
+    for (i = 0; i < DUMMY_FUNC_COUNT; i++) {
+        if (callCounts[i]) {
+            fprintf(stderr, "%12llu %12llu  %s\n",
+                    (unsigned long long)callCounts[i],
+                    (unsigned long long)latencies[i], dummyFuncNames[i]);
+        }
+    }
+}
+
+/*
+ * Synthetic FBConfigs. Each screen gets its own array, so that libGLX can map
+ * each FBConfig back to a single screen.
+ */
+typedef struct DummyFBConfigRec {
+    int screen;
+    int id;
+} DummyFBConfig;
+
+static DummyFBConfig *fbconfigs[DUMMY_MAX_SCREENS];
+
+/*
+ * The next XID to hand out on each screen. See GLX_dummy.h.
+ */
+static volatile GLuint nextXIDs[DUMMY_MAX_SCREENS];
+
+static DummyFBConfig *GetScreenFBConfigs(int screen)
+{
+    DummyFBConfig *configs;
+    int i;
+
+    if (screen < 0 || screen >= DUMMY_MAX_SCREENS || numFBConfigs <= 0) {
+        return NULL;
+    }
+
+    configs = fbconfigs[screen];
+    if (!configs) {
+        configs = malloc(numFBConfigs * sizeof(DummyFBConfig));
+        if (!configs) {
+            return NULL;
+        }
+        for (i = 0; i < numFBConfigs; i++) {
+            configs[i].screen = screen;
+            configs[i].id = i + 1;
+        }
+        if (!__sync_bool_compare_and_swap(&fbconfigs[screen], NULL, configs)) {
+            // Another thread got here first.
+            free(configs);
+            configs = fbconfigs[screen];
+        }
+    }
+
+    return configs;
+}
+
+static GLXFBConfig *ListFBConfigs(int screen, int *nelements)
+{
+    DummyFBConfig *configs = GetScreenFBConfigs(screen);
+    GLXFBConfig *list;
+    int i;
+
+    *nelements = 0;
+    if (!configs) {
+        return NULL;
+    }
+
+    list = malloc(numFBConfigs * sizeof(GLXFBConfig));
+    if (!list) {
+        return NULL;
+    }
+    for (i = 0; i < numFBConfigs; i++) {
+        list[i] = (GLXFBConfig)&configs[i];
+    }
+
+    *nelements = numFBConfigs;
+    return list;
+}
+
+static int FBConfigScreen(GLXFBConfig config)
+{
+    return config ? ((DummyFBConfig *)config)->screen : 0;
+}
+
+static XID NewXID(int screen)
+{
+    GLuint serial;
+
+    if (screen < 0 || screen >= DUMMY_MAX_SCREENS) {
+        screen = 0;
+    }
+    serial = __sync_add_and_fetch(&nextXIDs[screen], 1);
+
+    return DUMMY_XID_BASE | (screen << DUMMY_XID_SCREEN_SHIFT) |
+        (serial & ((1 << DUMMY_XID_SCREEN_SHIFT) - 1));
+}
+
+static XVisualInfo *MatchVisual(Display *dpy, int screen)
 {
     XVisualInfo *ret_visual;
     XVisualInfo matched_visual;
 
-    // XXX Just get a visual which can be used to open a window.
-    // Ignore the attribs; we're not going to be doing
-    // any actual rendering in this test.
     if (XMatchVisualInfo(dpy, screen,
                          DefaultDepth(dpy, screen),
                          TrueColor,
@@ -77,12 +306,36 @@ static XVisualInfo*  dummyChooseVisual          (Display *dpy,
     return ret_visual;
 }
 
+static __GLXcontext *NewContext(void)
+{
+    __GLXcontext *context = malloc(sizeof(*context));
+
+    if (context) {
+        context->beginHit = 0;
+        context->vertex3fvHit = 0;
+        context->endHit = 0;
+    }
+    return context;
+}
+
+static XVisualInfo*  dummyChooseVisual          (Display *dpy,
+                                                 int screen,
+                                                 int *attrib_list)
+{
+    DummyCall(DUMMY_FUNC_glXChooseVisual);
+
+    // XXX Just get a visual which can be used to open a window.
+    // Ignore the attribs; we're not going to be doing
+    // any actual rendering in this test.
+    return MatchVisual(dpy, screen);
+}
+
 static void          dummyCopyContext           (Display *dpy,
                                                  GLXContext src,
                                                  GLXContext dst,
                                                  unsigned long mask)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXCopyContext);
 }
 
 static GLXContext    dummyCreateContext         (Display *dpy,
@@ -90,30 +343,32 @@ static GLXContext    dummyCreateContext         (Display *dpy,
                                                  GLXContext share_list,
                                                  Bool direct)
 {
-    __GLXcontext *context = malloc(sizeof(*context));
-    context->beginHit = 0;
-    context->vertex3fvHit = 0;
-    context->endHit = 0;
-    return context;
+    DummyCall(DUMMY_FUNC_glXCreateContext);
+
+    return NewContext();
 }
 
 static GLXPixmap     dummyCreateGLXPixmap       (Display *dpy,
                                                  XVisualInfo *vis,
                                                  Pixmap pixmap)
 {
-    return None;
+    DummyCall(DUMMY_FUNC_glXCreateGLXPixmap);
+
+    return NewXID(vis ? vis->screen : 0);
 }
 
 static void          dummyDestroyContext        (Display *dpy,
                                               GLXContext ctx)
 {
+    DummyCall(DUMMY_FUNC_glXDestroyContext);
+
     free(ctx);
 }
 
 static void          dummyDestroyGLXPixmap      (Display *dpy,
                                                  GLXPixmap pix)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXDestroyGLXPixmap);
 }
 
 static int           dummyGetConfig             (Display *dpy,
@@ -121,12 +376,16 @@ static int           dummyGetConfig             (Display *dpy,
                                                  int attrib,
                                                  int *value)
 {
+    DummyCall(DUMMY_FUNC_glXGetConfig);
+
     return 0;
 }
 
 static Bool          dummyIsDirect              (Display *dpy,
                                                  GLXContext ctx)
 {
+    DummyCall(DUMMY_FUNC_glXIsDirect);
+
     return False;
 }
 
@@ -134,6 +393,8 @@ static Bool          dummyMakeCurrent           (Display *dpy,
                                               GLXDrawable drawable,
                                               GLXContext ctx)
 {
+    DummyCall(DUMMY_FUNC_glXMakeCurrent);
+
     // This doesn't do anything, but fakes success
     return True;
 }
@@ -141,7 +402,7 @@ static Bool          dummyMakeCurrent           (Display *dpy,
 static void          dummySwapBuffers           (Display *dpy,
                                                  GLXDrawable drawable)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXSwapBuffers);
 }
 
 static void          dummyUseXFont              (Font font,
@@ -149,23 +410,25 @@ static void          dummyUseXFont              (Font font,
                                                  int count,
                                                  int list_base)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXUseXFont);
 }
 
 static void          dummyWaitGL                (void)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXWaitGL);
 }
 
 static void          dummyWaitX                 (void)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXWaitX);
 }
 
 static const char*   dummyQueryServerString     (Display *dpy,
                                                  int screen,
                                                  int name)
 {
+    DummyCall(DUMMY_FUNC_glXQueryServerString);
+
     return NULL;
 }
 
@@ -190,6 +453,8 @@ static const char*   dummyGetClientString     (Display *dpy,
     /* Use a reallly long extension string to test bounds-checking */
     static const char glxExtensions[] = LONG_EXT_STR;
 
+    DummyCall(DUMMY_FUNC_glXGetClientString);
+
     switch (name) {
     case GLX_VENDOR:
         return glxVendor;
@@ -205,6 +470,8 @@ static const char*   dummyGetClientString     (Display *dpy,
 static const char*   dummyQueryExtensionsString (Display *dpy,
                                                  int screen)
 {
+    DummyCall(DUMMY_FUNC_glXQueryExtensionsString);
+
     return NULL;
 }
 
@@ -213,7 +480,9 @@ static GLXFBConfig*  dummyChooseFBConfig        (Display *dpy,
                                               const int *attrib_list,
                                               int *nelements)
 {
-    return NULL;
+    DummyCall(DUMMY_FUNC_glXChooseFBConfig);
+
+    return ListFBConfigs(screen, nelements);
 }
 
 static GLXContext    dummyCreateNewContext      (Display *dpy,
@@ -222,14 +491,18 @@ static GLXContext    dummyCreateNewContext      (Display *dpy,
                                                  GLXContext share_list,
                                                  Bool direct)
 {
-    return NULL;
+    DummyCall(DUMMY_FUNC_glXCreateNewContext);
+
+    return NewContext();
 }
 
 static GLXPbuffer    dummyCreatePbuffer         (Display *dpy,
                                                  GLXFBConfig config,
                                                  const int *attrib_list)
 {
-    return None;
+    DummyCall(DUMMY_FUNC_glXCreatePbuffer);
+
+    return NewXID(FBConfigScreen(config));
 }
 
 static GLXPixmap     dummyCreatePixmap          (Display *dpy,
@@ -237,7 +510,9 @@ static GLXPixmap     dummyCreatePixmap          (Display *dpy,
                                                  Pixmap pixmap,
                                                  const int *attrib_list)
 {
-    return None;
+    DummyCall(DUMMY_FUNC_glXCreatePixmap);
+
+    return NewXID(FBConfigScreen(config));
 }
 
 static GLXWindow     dummyCreateWindow          (Display *dpy,
@@ -245,25 +520,27 @@ static GLXWindow     dummyCreateWindow          (Display *dpy,
                                                  Window win,
                                                  const int *attrib_list)
 {
-    return None;
+    DummyCall(DUMMY_FUNC_glXCreateWindow);
+
+    return NewXID(FBConfigScreen(config));
 }
 
 static void          dummyDestroyPbuffer        (Display *dpy,
                                                  GLXPbuffer pbuf)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXDestroyPbuffer);
 }
 
 static void          dummyDestroyPixmap         (Display *dpy,
                                                  GLXPixmap pixmap)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXDestroyPixmap);
 }
 
 static void          dummyDestroyWindow         (Display *dpy,
                                                  GLXWindow win)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXDestroyWindow);
 }
 
 static int           dummyGetFBConfigAttrib     (Display *dpy,
@@ -271,32 +548,58 @@ static int           dummyGetFBConfigAttrib     (Display *dpy,
                                                  int attribute,
                                                  int *value)
 {
-    return 0;
+    const DummyFBConfig *dummyConfig = (const DummyFBConfig *)config;
+
+    DummyCall(DUMMY_FUNC_glXGetFBConfigAttrib);
+
+    if (!dummyConfig) {
+        return GLX_BAD_ATTRIBUTE;
+    }
+
+    switch (attribute) {
+    case GLX_FBCONFIG_ID:
+        *value = dummyConfig->id;
+        break;
+    case GLX_SCREEN:
+        *value = dummyConfig->screen;
+        break;
+    default:
+        *value = 0;
+        break;
+    }
+
+    return Success;
 }
 
 static GLXFBConfig*  dummyGetFBConfigs          (Display *dpy,
                                                  int screen,
                                                  int *nelements)
 {
-    return NULL;
+    DummyCall(DUMMY_FUNC_glXGetFBConfigs);
+
+    return ListFBConfigs(screen, nelements);
 }
 
 static void          dummyGetSelectedEvent      (Display *dpy,
                                                  GLXDrawable draw,
                                                  unsigned long *event_mask)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXGetSelectedEvent);
 }
 
 static XVisualInfo*  dummyGetVisualFromFBConfig (Display *dpy,
                                                  GLXFBConfig config)
 {
-    return NULL;
+    DummyCall(DUMMY_FUNC_glXGetVisualFromFBConfig);
+
+    return MatchVisual(dpy, FBConfigScreen(config));
 }
 
 static Bool          dummyMakeContextCurrent    (Display *dpy, GLXDrawable draw,
                                               GLXDrawable read, GLXContext ctx)
 {
+    DummyCall(DUMMY_FUNC_glXMakeContextCurrent);
+
     // This doesn't do anything, but fakes success
     return True;
 }
@@ -306,6 +609,8 @@ static int           dummyQueryContext          (Display *dpy,
                                                  int attribute,
                                                  int *value)
 {
+    DummyCall(DUMMY_FUNC_glXQueryContext);
+
     return 0;
 }
 
@@ -314,14 +619,14 @@ static void          dummyQueryDrawable         (Display *dpy,
                                                  int attribute,
                                                  unsigned int *value)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXQueryDrawable);
 }
 
 static void          dummySelectEvent           (Display *dpy,
                                                  GLXDrawable draw,
                                                  unsigned long event_mask)
 {
-    // nop
+    DummyCall(DUMMY_FUNC_glXSelectEvent);
 }
 
 /*
@@ -333,6 +638,7 @@ static void dummy_glBegin (void)
     GLXContext ctx = apiExports.getCurrentContext();
     assert(ctx);
 
+    DummyCall(DUMMY_FUNC_glBegin);
     ctx->beginHit++;
 }
 
@@ -341,6 +647,7 @@ static void dummy_glVertex3fv(GLfloat *v)
     GLXContext ctx = apiExports.getCurrentContext();
     assert(ctx);
 
+    DummyCall(DUMMY_FUNC_glVertex3fv);
     ctx->vertex3fvHit++;
 }
 
@@ -349,6 +656,7 @@ static void dummy_glEnd (void)
     GLXContext ctx = apiExports.getCurrentContext();
     assert(ctx);
 
+    DummyCall(DUMMY_FUNC_glEnd);
     ctx->endHit++;
 }
 
@@ -375,6 +683,40 @@ static void dummy_glMakeCurrentTestResults(GLint req,
             *ret = thisVendorName ? strdup(thisVendorName) : NULL;
         }
         break;
+    case GL_MC_AUX_DISPATCH:
+        {
+            __GLXcoreDispatchTable *table = auxDispatch;
+
+            if (!table) {
+                // Any non-NULL data makes this an auxiliary table.
+                table = apiExports.createGLDispatch(&dummyImports.glxvc,
+                                                    &auxDispatch);
+                if (table &&
+                    !__sync_bool_compare_and_swap(&auxDispatch, NULL, table)) {
+                    // Another thread got here first.
+                    apiExports.destroyGLDispatch(table);
+                    table = auxDispatch;
+                }
+            }
+            if (table) {
+                apiExports.makeGLDispatchCurrent(table);
+            }
+            *ret = (void *)table;
+        }
+        break;
+    case GL_MC_CALL_COUNTS:
+        {
+            GLuint64 *data = (GLuint64 *)malloc(sizeof(callCounts));
+            int i;
+
+            if (data) {
+                for (i = 0; i < DUMMY_FUNC_COUNT; i++) {
+                    data[i] = callCounts[i];
+                }
+            }
+            *ret = (void *)data;
+        }
+        break;
     case GL_MC_LAST_REQ:
     default:
         *ret = NULL;
@@ -384,6 +726,8 @@ static void dummy_glMakeCurrentTestResults(GLint req,
 
 static void dummyExampleExtensionFunction(Display *dpy, int screen, int *retval)
 {
+    DummyCall(DUMMY_FUNC_glXExampleExtensionFunction);
+
     // Indicate that we've called the real function, and not a dispatch stub
     *retval = 1;
 }
@@ -456,9 +800,16 @@ static void dummyDestroyDispatchData(void *data)
     // nop
 }
 
+/*
+ * Any function whose name starts with glXExampleExtensionFunction gets the
+ * same dispatch function. That way, testglxgpabench can measure the vendor
+ * dispatch path of glXGetProcAddress with as many names as it needs.
+ */
 static void         *dummyGetDispatchAddress     (const GLubyte *procName)
 {
-    if (!strcmp((const char *)procName, "glXExampleExtensionFunction")) {
+    static const char prefix[] = "glXExampleExtensionFunction";
+
+    if (!strncmp((const char *)procName, prefix, sizeof(prefix) - 1)) {
         return dispatch_glXExampleExtensionFunction;
     }
     return NULL;
@@ -476,6 +827,8 @@ static GLboolean    dummyGetDispatchProto   (const GLubyte *procName,
                                           char ***function_names,
                                           char **parameter_signature)
 {
+    static const char prefix[] = "glDummyExtensionFunc";
+
     // We only export one extension function here
     // TODO: Maybe a good idea to test a bunch of different protos?
     if (!strcmp((const char *)procName, "glMakeCurrentTestResults")) {
@@ -486,9 +839,71 @@ static GLboolean    dummyGetDispatchProto   (const GLubyte *procName,
         return GL_TRUE;
     }
 
+    /*
+     * We also recognize any name starting with glDummyExtensionFunc, so that
+     * testglxgetprocaddress can check that each one gets its own stub. They
+     * all dispatch to the NOP stub.
+     */
+    if (!strncmp((const char *)procName, prefix, sizeof(prefix) - 1)) {
+        *function_names = malloc(2 * sizeof(char *));
+        (*function_names)[0] = strdup((const char *)procName);
+        (*function_names)[1] = NULL;
+        *parameter_signature = strdup("iii");
+        return GL_TRUE;
+    }
+
     return GL_FALSE;
 }
 
+/*
+ * Prebuilt top-level dispatch table, indexed by dispatch offset. This covers
+ * every GL function, the same as dummyGetProcAddress() would, so libGLX
+ * doesn't need to call back into us to build the table.
+ */
+static __GLXextFuncPtr *dummyStaticDispatch;
+static int dummyStaticDispatchCount;
+static GLint dummyDispatchTableSize;
+
+static const __GLXextFuncPtr *dummyGetStaticDispatch(void *data, int *count)
+{
+    GLint offset;
+    int i;
+
+    if (data) {
+        // Auxiliary tables can use the getProcAddress callback
+        return NULL;
+    }
+
+    if (!dummyStaticDispatch) {
+        if (dummyDispatchTableSize <= 0) {
+            return NULL;
+        }
+
+        dummyStaticDispatch = malloc(dummyDispatchTableSize *
+                                     sizeof(__GLXextFuncPtr));
+        if (!dummyStaticDispatch) {
+            return NULL;
+        }
+        dummyStaticDispatchCount = dummyDispatchTableSize;
+
+        for (i = 0; i < dummyStaticDispatchCount; i++) {
+            dummyStaticDispatch[i] = (__GLXextFuncPtr)dummyNopStub;
+        }
+
+        for (i = 0; i < ARRAY_LEN(procAddresses); i++) {
+            offset = apiExports.getGLDispatchOffset(
+                (const GLubyte *)procAddresses[i].name);
+            if (offset >= 0 && offset < dummyStaticDispatchCount) {
+                dummyStaticDispatch[offset] =
+                    (__GLXextFuncPtr)procAddresses[i].addr;
+            }
+        }
+    }
+
+    *count = dummyStaticDispatchCount;
+    return dummyStaticDispatch;
+}
+
 
 static const __GLXapiImports dummyImports =
 {
@@ -541,8 +956,11 @@ static const __GLXapiImports dummyImports =
 PUBLIC __GLX_MAIN_PROTO(version, exports, vendorName)
 {
     thisVendorName = strdup(vendorName);
+    LoadCostModel(vendorName);
     if (version <= GLX_VENDOR_ABI_VERSION) {
         memcpy(&apiExports, exports, sizeof(*exports));
+        dummyDispatchTableSize =
+            apiExports.setStaticGLDispatch(dummyGetStaticDispatch);
         return &dummyImports;
     } else {
         return NULL;
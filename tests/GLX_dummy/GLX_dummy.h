@@ -51,12 +51,102 @@ enum {
      */
     GL_MC_VENDOR_STRING,
 
+    /*
+     * Makes an auxiliary dispatch table current for the calling thread, until
+     * the next make current. The auxiliary table has the same functions as
+     * the top-level one, but is built with the vendor's getProcAddress
+     * callback. Returns the table, or NULL on failure.
+     */
+    GL_MC_AUX_DISPATCH,
+
+    /*
+     * Returns an array of DUMMY_FUNC_COUNT GLuint64 values containing the
+     * number of times each entry point in DUMMY_FUNCS was called, by any
+     * thread, in this vendor library.
+     */
+    GL_MC_CALL_COUNTS,
+
     /*
      * Last request. Always returns NULL.
      */
     GL_MC_LAST_REQ
 } GLmakeCurrentTestRequest;
 
+/*
+ * The entry points that GLX_dummy counts calls to. Each of these can also be
+ * made to busy-wait for some time, so that benchmarks can compare libglvnd's
+ * overhead with the work that a real vendor would do.
+ *
+ * The busy-wait times are set with the __GLX_DUMMY_LATENCY environment
+ * variable, which is a comma-separated list of name=nanoseconds pairs. A
+ * name of "*" sets the time for every entry point which isn't listed. For
+ * example:
+ *
+ *     __GLX_DUMMY_LATENCY=*=100,glXMakeCurrent=20000
+ *
+ * __GLX_DUMMY_LATENCY_<vendor name> does the same thing for one copy of the
+ * vendor library, and takes precedence over __GLX_DUMMY_LATENCY.
+ */
+#define DUMMY_FUNCS(X)                 \
+    X(glXChooseVisual)                 \
+    X(glXCopyContext)                  \
+    X(glXCreateContext)                \
+    X(glXCreateGLXPixmap)              \
+    X(glXDestroyContext)               \
+    X(glXDestroyGLXPixmap)             \
+    X(glXGetConfig)                    \
+    X(glXIsDirect)                     \
+    X(glXMakeCurrent)                  \
+    X(glXSwapBuffers)                  \
+    X(glXUseXFont)                     \
+    X(glXWaitGL)                       \
+    X(glXWaitX)                        \
+    X(glXQueryServerString)            \
+    X(glXGetClientString)              \
+    X(glXQueryExtensionsString)        \
+    X(glXChooseFBConfig)               \
+    X(glXCreateNewContext)             \
+    X(glXCreatePbuffer)                \
+    X(glXCreatePixmap)                 \
+    X(glXCreateWindow)                 \
+    X(glXDestroyPbuffer)               \
+    X(glXDestroyPixmap)                \
+    X(glXDestroyWindow)                \
+    X(glXGetFBConfigAttrib)            \
+    X(glXGetFBConfigs)                 \
+    X(glXGetSelectedEvent)             \
+    X(glXGetVisualFromFBConfig)        \
+    X(glXMakeContextCurrent)           \
+    X(glXQueryContext)                 \
+    X(glXQueryDrawable)                \
+    X(glXSelectEvent)                  \
+    X(glXExampleExtensionFunction)     \
+    X(glBegin)                         \
+    X(glVertex3fv)                     \
+    X(glEnd)
+
+#define DUMMY_FUNC_ENUM(name) DUMMY_FUNC_ ## name,
+
+enum {
+    DUMMY_FUNCS(DUMMY_FUNC_ENUM)
+    DUMMY_FUNC_COUNT
+};
+
+/*
+ * GLX_dummy only has FBConfigs if __GLX_DUMMY_FBCONFIGS is set to the number
+ * of FBConfigs to create for each screen. glXChooseFBConfig() ignores its
+ * attributes and returns all of them. glXGetFBConfigAttrib() only supports
+ * GLX_FBCONFIG_ID and GLX_SCREEN.
+ *
+ * The GLX drawables that GLX_dummy creates are never sent to the server, so
+ * it makes up a new XID for each one. The screen number is in bits 24-27 of
+ * the XID, so that different screens, and therefore different vendors, never
+ * hand out the same XID.
+ */
+#define DUMMY_XID_BASE 0x10000000
+#define DUMMY_XID_SCREEN_SHIFT 24
+#define DUMMY_MAX_SCREENS 16
+
 /*
  * glMakeCurrentTestResults(): perform queries on vendor library state.
  *
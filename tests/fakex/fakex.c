@@ -0,0 +1,709 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include <config.h>
+
+#include <X11/X.h>
+#include <X11/Xproto.h>
+#include <GL/glxproto.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <unistd.h>
+#include <errno.h>
+#include <time.h>
+
+#include "x11glvnd.h"
+#include "x11glvndproto.h"
+
+/*
+ * An in-process stand-in for an X server, so that the libGLX tests and
+ * benchmarks can run without a display.
+ *
+ * Preloading this library starts a server thread which listens on an
+ * abstract socket, and points DISPLAY at it. It implements the connection
+ * setup, the handful of core requests that Xlib and the tests make, the
+ * XGLVendor extension and the GLX QueryVersion request. Anything else gets a
+ * BadRequest error.
+ *
+ * It's configured with these environment variables:
+ *
+ *  - __GLX_FAKE_X_SCREENS: The number of screens. The default is 2.
+ *  - __GLX_FAKE_X_VENDORS: A comma-separated list of the vendor name for each
+ *    screen. If there are fewer names than screens, the last one is used for
+ *    the rest. The default is "dummy_0,dummy_1", like xorg.2screens.conf.
+ *  - __GLX_FAKE_X_LATENCY: A delay in nanoseconds before sending each reply
+ *    or error, to model the round trip to a remote display.
+ */
+
+#define FAKE_X_MAX_SCREENS 16
+#define FAKE_X_MAX_VENDOR_NAME 64
+
+// Major opcodes for the extensions we support.
+#define GLX_MAJOR_OPCODE 128
+#define XGLV_MAJOR_OPCODE 129
+
+// Each screen's root window, default colormap and visual.
+#define ROOT_WINDOW(screen) (0x100 + (screen))
+#define ROOT_COLORMAP(screen) (0x200 + (screen))
+#define ROOT_VISUAL(screen) (0x300 + (screen))
+
+// Each client gets its own range of resource IDs.
+#define CLIENT_RID_SHIFT 21
+#define CLIENT_RID_MASK ((1 << CLIENT_RID_SHIFT) - 1)
+
+static int numScreens = 2;
+static char vendorNames[FAKE_X_MAX_SCREENS][FAKE_X_MAX_VENDOR_NAME];
+static uint64_t replyLatency;
+
+static pthread_mutex_t resourceMutex = PTHREAD_MUTEX_INITIALIZER;
+static int nextClient = 1;
+
+/*
+ * The screen of each window, pixmap and colormap that a client has created,
+ * so that we can answer XGLVQueryXIDScreenMapping.
+ */
+typedef struct ResourceRec {
+    uint32_t xid;
+    int screen;
+} Resource;
+
+static Resource *resources;
+static int numResources;
+static int maxResources;
+
+typedef struct ClientRec {
+    int fd;
+    uint16_t sequence;
+} Client;
+
+static void AddResource(uint32_t xid, int screen)
+{
+    Resource *newResources;
+
+    pthread_mutex_lock(&resourceMutex);
+    if (numResources == maxResources) {
+        maxResources = maxResources ? maxResources * 2 : 64;
+        newResources = realloc(resources, maxResources * sizeof(Resource));
+        if (!newResources) {
+            pthread_mutex_unlock(&resourceMutex);
+            return;
+        }
+        resources = newResources;
+    }
+    resources[numResources].xid = xid;
+    resources[numResources].screen = screen;
+    numResources++;
+    pthread_mutex_unlock(&resourceMutex);
+}
+
+static void RemoveResource(uint32_t xid)
+{
+    int i;
+
+    pthread_mutex_lock(&resourceMutex);
+    for (i = 0; i < numResources; i++) {
+        if (resources[i].xid == xid) {
+            resources[i] = resources[--numResources];
+            break;
+        }
+    }
+    pthread_mutex_unlock(&resourceMutex);
+}
+
+static int LookupScreen(uint32_t xid)
+{
+    int screen = -1;
+    int i;
+
+    for (i = 0; i < numScreens; i++) {
+        if (xid == ROOT_WINDOW(i) || xid == ROOT_COLORMAP(i)) {
+            return i;
+        }
+    }
+
+    pthread_mutex_lock(&resourceMutex);
+    for (i = 0; i < numResources; i++) {
+        if (resources[i].xid == xid) {
+            screen = resources[i].screen;
+            break;
+        }
+    }
+    pthread_mutex_unlock(&resourceMutex);
+
+    return screen;
+}
+
+static int ReadAll(int fd, void *buf, size_t size)
+{
+    char *ptr = buf;
+    ssize_t ret;
+
+    while (size > 0) {
+        ret = read(fd, ptr, size);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return 0;
+        }
+        ptr += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+static int WriteAll(int fd, const void *buf, size_t size)
+{
+    const char *ptr = buf;
+    ssize_t ret;
+
+    while (size > 0) {
+        ret = write(fd, ptr, size);
+        if (ret < 0 && errno == EINTR) {
+            continue;
+        }
+        if (ret <= 0) {
+            return 0;
+        }
+        ptr += ret;
+        size -= ret;
+    }
+    return 1;
+}
+
+static void Delay(void)
+{
+    struct timespec ts;
+
+    if (replyLatency) {
+        ts.tv_sec = replyLatency / 1000000000ULL;
+        ts.tv_nsec = replyLatency % 1000000000ULL;
+        while (nanosleep(&ts, &ts) != 0 && errno == EINTR) {
+            // Keep sleeping for the rest of the time.
+        }
+    }
+}
+
+/*
+ * Sends a reply. The first 32 bytes of data are the reply header, which
+ * SendReply fills in, followed by extra bytes of data.
+ */
+static int SendReply(Client *client, void *data, size_t extra)
+{
+    xGenericReply *reply = data;
+
+    reply->type = X_Reply;
+    reply->sequenceNumber = client->sequence;
+    reply->length = (extra + 3) >> 2;
+
+    Delay();
+    return WriteAll(client->fd, data, sizeof(xReply) + (reply->length << 2));
+}
+
+static int SendError(Client *client, int code, int major, int minor,
+                     uint32_t resource)
+{
+    xError error;
+
+    memset(&error, 0, sizeof(error));
+    error.type = X_Error;
+    error.errorCode = code;
+    error.sequenceNumber = client->sequence;
+    error.resourceID = resource;
+    error.minorCode = minor;
+    error.majorCode = major;
+
+    Delay();
+    return WriteAll(client->fd, &error, sizeof(error));
+}
+
+static int SendSetup(Client *client, int clientIndex)
+{
+    static const char vendor[] = "libglvnd fake X server";
+    const size_t vendorLen = (sizeof(vendor) - 1 + 3) & ~3;
+    xConnSetupPrefix prefix;
+    xConnSetup *setup;
+    xPixmapFormat *format;
+    xWindowRoot *root;
+    xDepth *depth;
+    xVisualType *visual;
+    size_t size;
+    char *buf, *ptr;
+    int ret, i;
+
+    size = sizeof(xConnSetup) + vendorLen + 2 * sizeof(xPixmapFormat) +
+        numScreens * (sizeof(xWindowRoot) + sizeof(xDepth) +
+                      sizeof(xVisualType));
+    buf = calloc(1, size);
+    if (!buf) {
+        return 0;
+    }
+
+    memset(&prefix, 0, sizeof(prefix));
+    prefix.success = 1;
+    prefix.majorVersion = X_PROTOCOL;
+    prefix.minorVersion = X_PROTOCOL_REVISION;
+    prefix.length = size >> 2;
+
+    setup = (xConnSetup *)buf;
+    setup->release = 1;
+    setup->ridBase = clientIndex << CLIENT_RID_SHIFT;
+    setup->ridMask = CLIENT_RID_MASK;
+    setup->nbytesVendor = sizeof(vendor) - 1;
+    setup->maxRequestSize = 0xffff;
+    setup->numRoots = numScreens;
+    setup->numFormats = 2;
+    setup->imageByteOrder = LSBFirst;
+    setup->bitmapBitOrder = LSBFirst;
+    setup->bitmapScanlineUnit = 32;
+    setup->bitmapScanlinePad = 32;
+    setup->minKeyCode = 8;
+    setup->maxKeyCode = 255;
+    ptr = buf + sizeof(xConnSetup);
+    memcpy(ptr, vendor, sizeof(vendor) - 1);
+    ptr += vendorLen;
+
+    format = (xPixmapFormat *)ptr;
+    format[0].depth = 1;
+    format[0].bitsPerPixel = 1;
+    format[0].scanLinePad = 32;
+    format[1].depth = 24;
+    format[1].bitsPerPixel = 32;
+    format[1].scanLinePad = 32;
+    ptr += 2 * sizeof(xPixmapFormat);
+
+    for (i = 0; i < numScreens; i++) {
+        root = (xWindowRoot *)ptr;
+        root->windowId = ROOT_WINDOW(i);
+        root->defaultColormap = ROOT_COLORMAP(i);
+        root->whitePixel = 0xffffff;
+        root->blackPixel = 0;
+        root->pixWidth = 1920;
+        root->pixHeight = 1080;
+        root->mmWidth = 508;
+        root->mmHeight = 286;
+        root->minInstalledMaps = 1;
+        root->maxInstalledMaps = 1;
+        root->rootVisualID = ROOT_VISUAL(i);
+        root->backingStore = NotUseful;
+        root->rootDepth = 24;
+        root->nDepths = 1;
+        ptr += sizeof(xWindowRoot);
+
+        depth = (xDepth *)ptr;
+        depth->depth = 24;
+        depth->nVisuals = 1;
+        ptr += sizeof(xDepth);
+
+        visual = (xVisualType *)ptr;
+        visual->visualID = ROOT_VISUAL(i);
+        visual->class = TrueColor;
+        visual->bitsPerRGB = 8;
+        visual->colormapEntries = 256;
+        visual->redMask = 0xff0000;
+        visual->greenMask = 0x00ff00;
+        visual->blueMask = 0x0000ff;
+        ptr += sizeof(xVisualType);
+    }
+
+    ret = WriteAll(client->fd, &prefix, sizeof(prefix)) &&
+        WriteAll(client->fd, buf, size);
+    free(buf);
+
+    return ret;
+}
+
+static int HandleQueryExtension(Client *client, const char *req, size_t size)
+{
+    const xQueryExtensionReq *query = (const xQueryExtensionReq *)req;
+    const char *name = req + sizeof(xQueryExtensionReq);
+    xQueryExtensionReply reply;
+
+    memset(&reply, 0, sizeof(reply));
+    if (sizeof(xQueryExtensionReq) + query->nbytes <= size) {
+        if (query->nbytes == strlen(GLX_EXTENSION_NAME) &&
+            !memcmp(name, GLX_EXTENSION_NAME, query->nbytes)) {
+            reply.present = xTrue;
+            reply.major_opcode = GLX_MAJOR_OPCODE;
+        } else if (query->nbytes == strlen(XGLV_EXTENSION_NAME) &&
+                   !memcmp(name, XGLV_EXTENSION_NAME, query->nbytes)) {
+            reply.present = xTrue;
+            reply.major_opcode = XGLV_MAJOR_OPCODE;
+        }
+    }
+
+    return SendReply(client, &reply, 0);
+}
+
+static int HandleGLX(Client *client, const char *req, size_t size)
+{
+    const xGLXSingleReq *glxReq = (const xGLXSingleReq *)req;
+    xGLXQueryVersionReply reply;
+
+    switch (glxReq->glxCode) {
+    case X_GLXQueryVersion:
+        memset(&reply, 0, sizeof(reply));
+        reply.majorVersion = 1;
+        reply.minorVersion = 4;
+        return SendReply(client, &reply, 0);
+    case X_GLXClientInfo:
+        return 1;
+    default:
+        return SendError(client, BadRequest, GLX_MAJOR_OPCODE,
+                         glxReq->glxCode, 0);
+    }
+}
+
+static int HandleXGLV(Client *client, const char *req, size_t size)
+{
+    const xglvQueryXIDScreenMappingReq *xidReq =
+        (const xglvQueryXIDScreenMappingReq *)req;
+    const xglvQueryScreenVendorMappingReq *screenReq =
+        (const xglvQueryScreenVendorMappingReq *)req;
+    xglvQueryXIDScreenMappingReply xidReply;
+    xglvQueryScreenVendorMappingReply screenReply;
+    char buf[sizeof(xReply) + FAKE_X_MAX_VENDOR_NAME];
+    size_t n;
+
+    switch (xidReq->glvndReqType) {
+    case X_glvQueryXIDScreenMapping:
+        memset(&xidReply, 0, sizeof(xidReply));
+        xidReply.screen = LookupScreen(xidReq->xid);
+        return SendReply(client, &xidReply, 0);
+    case X_glvQueryScreenVendorMapping:
+        if (screenReq->screen < 0 || screenReq->screen >= numScreens) {
+            return SendError(client, BadValue, XGLV_MAJOR_OPCODE,
+                             X_glvQueryScreenVendorMapping, 0);
+        }
+        /*
+         * The reply struct is bigger than the 32 bytes that go over the
+         * wire, so copy the header and the name into one buffer.
+         */
+        memset(&screenReply, 0, sizeof(screenReply));
+        memset(buf, 0, sizeof(buf));
+        n = strlen(vendorNames[screenReq->screen]) + 1;
+        screenReply.n = n;
+        memcpy(buf, &screenReply, sizeof(xReply));
+        memcpy(buf + sizeof(xReply), vendorNames[screenReq->screen], n);
+        return SendReply(client, buf, n);
+    default:
+        return SendError(client, BadRequest, XGLV_MAJOR_OPCODE,
+                         xidReq->glvndReqType, 0);
+    }
+}
+
+/*
+ * Handles one request. Returns zero if the connection should be closed.
+ */
+static int HandleRequest(Client *client, const char *req, size_t size)
+{
+    const xReq *header = (const xReq *)req;
+    union {
+        xGenericReply generic;
+        xGetInputFocusReply focus;
+        xInternAtomReply atom;
+    } reply;
+    static uint32_t nextAtom = 0x1000;
+    int screen;
+
+    memset(&reply, 0, sizeof(reply));
+
+    switch (header->reqType) {
+    case X_CreateWindow:
+        {
+            const xCreateWindowReq *cw = (const xCreateWindowReq *)req;
+            screen = LookupScreen(cw->parent);
+            if (screen < 0) {
+                return SendError(client, BadWindow, header->reqType, 0,
+                                 cw->parent);
+            }
+            AddResource(cw->wid, screen);
+        }
+        return 1;
+    case X_CreatePixmap:
+        {
+            const xCreatePixmapReq *cp = (const xCreatePixmapReq *)req;
+            screen = LookupScreen(cp->drawable);
+            if (screen < 0) {
+                return SendError(client, BadDrawable, header->reqType, 0,
+                                 cp->drawable);
+            }
+            AddResource(cp->pid, screen);
+        }
+        return 1;
+    case X_CreateColormap:
+        {
+            const xCreateColormapReq *cc = (const xCreateColormapReq *)req;
+            screen = LookupScreen(cc->window);
+            if (screen < 0) {
+                return SendError(client, BadWindow, header->reqType, 0,
+                                 cc->window);
+            }
+            AddResource(cc->mid, screen);
+        }
+        return 1;
+    case X_DestroyWindow:
+    case X_FreePixmap:
+    case X_FreeColormap:
+        RemoveResource(((const xResourceReq *)req)->id);
+        return 1;
+    case X_ChangeWindowAttributes:
+    case X_MapWindow:
+    case X_UnmapWindow:
+    case X_ConfigureWindow:
+    case X_ChangeProperty:
+    case X_DeleteProperty:
+    case X_CreateGC:
+    case X_ChangeGC:
+    case X_FreeGC:
+    case X_NoOperation:
+        return 1;
+    case X_GetInputFocus:
+        reply.focus.focus = None;
+        reply.focus.revertTo = RevertToNone;
+        return SendReply(client, &reply, 0);
+    case X_GetProperty:
+        // No properties on anything.
+        return SendReply(client, &reply, 0);
+    case X_InternAtom:
+        if (!((const xInternAtomReq *)req)->onlyIfExists) {
+            reply.atom.atom = __sync_fetch_and_add(&nextAtom, 1);
+        }
+        return SendReply(client, &reply, 0);
+    case X_ListExtensions:
+        return SendReply(client, &reply, 0);
+    case X_QueryExtension:
+        return HandleQueryExtension(client, req, size);
+    case GLX_MAJOR_OPCODE:
+        return HandleGLX(client, req, size);
+    case XGLV_MAJOR_OPCODE:
+        return HandleXGLV(client, req, size);
+    default:
+        return SendError(client, BadRequest, header->reqType, 0, 0);
+    }
+}
+
+static void *ClientThread(void *arg)
+{
+    Client client;
+    xConnClientPrefix prefix;
+    size_t authSize, size, maxSize = 0;
+    char *req = NULL;
+    char *newReq;
+    xReq header;
+    int clientIndex;
+
+    client.fd = (int)(intptr_t)arg;
+    client.sequence = 0;
+
+    if (!ReadAll(client.fd, &prefix, sizeof(prefix))) {
+        goto done;
+    }
+
+    // Only clients with the same byte order as us are supported.
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    if (prefix.byteOrder != 'B') {
+#else
+    if (prefix.byteOrder != 'l') {
+#endif
+        goto done;
+    }
+
+    // Skip the authorization data. We don't check it.
+    authSize = ((prefix.nbytesAuthProto + 3) & ~3) +
+        ((prefix.nbytesAuthString + 3) & ~3);
+    while (authSize > 0) {
+        char skip[64];
+        size = authSize < sizeof(skip) ? authSize : sizeof(skip);
+        if (!ReadAll(client.fd, skip, size)) {
+            goto done;
+        }
+        authSize -= size;
+    }
+
+    pthread_mutex_lock(&resourceMutex);
+    clientIndex = nextClient++;
+    pthread_mutex_unlock(&resourceMutex);
+
+    if (!SendSetup(&client, clientIndex)) {
+        goto done;
+    }
+
+    while (ReadAll(client.fd, &header, sizeof(header))) {
+        size = header.length << 2;
+        if (size < sizeof(header)) {
+            // BIG-REQUESTS isn't supported, so this is a broken request.
+            break;
+        }
+        if (size > maxSize) {
+            newReq = realloc(req, size);
+            if (!newReq) {
+                break;
+            }
+            req = newReq;
+            maxSize = size;
+        }
+        memcpy(req, &header, sizeof(header));
+        if (!ReadAll(client.fd, req + sizeof(header), size - sizeof(header))) {
+            break;
+        }
+
+        client.sequence++;
+        if (!HandleRequest(&client, req, size)) {
+            break;
+        }
+    }
+
+done:
+    free(req);
+    close(client.fd);
+    return NULL;
+}
+
+static void *ServerThread(void *arg)
+{
+    int listenFd = (int)(intptr_t)arg;
+    pthread_t thread;
+    int fd;
+
+    for (;;) {
+        fd = accept(listenFd, NULL, NULL);
+        if (fd < 0) {
+            if (errno == EINTR) {
+                continue;
+            }
+            break;
+        }
+        if (pthread_create(&thread, NULL, ClientThread,
+                           (void *)(intptr_t)fd) != 0) {
+            close(fd);
+            continue;
+        }
+        pthread_detach(thread);
+    }
+
+    return NULL;
+}
+
+static void ParseConfig(void)
+{
+    const char *str, *end;
+    size_t len;
+    int i;
+
+    str = getenv("__GLX_FAKE_X_SCREENS");
+    if (str) {
+        numScreens = atoi(str);
+        if (numScreens < 1) {
+            numScreens = 1;
+        } else if (numScreens > FAKE_X_MAX_SCREENS) {
+            numScreens = FAKE_X_MAX_SCREENS;
+        }
+    }
+
+    str = getenv("__GLX_FAKE_X_VENDORS");
+    if (!str) {
+        str = "dummy_0,dummy_1";
+    }
+    for (i = 0; i < FAKE_X_MAX_SCREENS; i++) {
+        if (*str) {
+            end = str + strcspn(str, ",");
+            len = end - str;
+            if (len >= FAKE_X_MAX_VENDOR_NAME) {
+                len = FAKE_X_MAX_VENDOR_NAME - 1;
+            }
+            memcpy(vendorNames[i], str, len);
+            vendorNames[i][len] = '\0';
+            str = *end ? end + 1 : end;
+        } else if (i > 0) {
+            strcpy(vendorNames[i], vendorNames[i - 1]);
+        }
+    }
+
+    str = getenv("__GLX_FAKE_X_LATENCY");
+    if (str) {
+        replyLatency = strtoull(str, NULL, 10);
+    }
+}
+
+static void __attribute__ ((constructor)) FakeXInit(void)
+{
+    struct sockaddr_un addr;
+    socklen_t addrLen;
+    pthread_t thread;
+    char display[16];
+    int fd, num;
+
+    ParseConfig();
+
+    fd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "fakex: socket() failed: %s\n", strerror(errno));
+        return;
+    }
+
+    /*
+     * Find an unused display number. The socket is in the abstract namespace,
+     * which libxcb tries before the filesystem, so nothing is left behind.
+     */
+    for (num = 64; num < 1024; num++) {
+        memset(&addr, 0, sizeof(addr));
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path + 1, sizeof(addr.sun_path) - 1,
+                 "/tmp/.X11-unix/X%d", num);
+        addrLen = offsetof(struct sockaddr_un, sun_path) + 1 +
+            strlen(addr.sun_path + 1);
+        if (bind(fd, (struct sockaddr *)&addr, addrLen) == 0) {
+            break;
+        }
+    }
+
+    if (num >= 1024 || listen(fd, 64) != 0) {
+        fprintf(stderr, "fakex: Failed to find a free display\n");
+        close(fd);
+        return;
+    }
+
+    if (pthread_create(&thread, NULL, ServerThread, (void *)(intptr_t)fd)
+        != 0) {
+        fprintf(stderr, "fakex: Failed to start the server thread\n");
+        close(fd);
+        return;
+    }
+    pthread_detach(thread);
+
+    snprintf(display, sizeof(display), ":%d", num);
+    setenv("DISPLAY", display, 1);
+}
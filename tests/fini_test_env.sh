@@ -1,5 +1,9 @@
 #!/bin/sh
 
+if [ -n "$FAKE_X_PRELOAD" ]; then
+    exit 0
+fi
+
 if [ -n "$SKIP_ENV_INIT" ]; then
     echo "Test environment cleanup skipped"
     exit 77
@@ -2,6 +2,11 @@
 
 echo -n "Initializing test environment... "
 
+if [ -n "$FAKE_X_PRELOAD" ]; then
+    echo "using the in-process X stand-in"
+    exit 0
+fi
+
 if [ -n "$SKIP_ENV_INIT" ]; then
     echo "skipped"
     exit 77
@@ -32,6 +32,7 @@
 #include <stdio.h>
 #include <string.h>
 #include <assert.h>
+#include <time.h>
 
 GLboolean testUtilsCreateWindow(Display *dpy,
                                 struct window_info *wi,
@@ -101,3 +102,12 @@ void testUtilsDestroyWindow(Display *dpy,
     XFree(wi->visinfo);
 }
 
+
+uint64_t testUtilsGetTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
@@ -34,6 +34,7 @@
 #include <GL/glx.h>
 #include <pthread.h>
 #include <stdio.h>
+#include <stdint.h>
 
 #define printError(...) fprintf(stderr, __VA_ARGS__)
 
@@ -50,4 +51,10 @@ GLboolean testUtilsCreateWindow(Display *dpy,
 void testUtilsDestroyWindow(Display *dpy,
                             struct window_info *wi);
 
+/*!
+ * Returns a monotonic timestamp in nanoseconds. This is used by the tests
+ * which can also report performance numbers.
+ */
+uint64_t testUtilsGetTime(void);
+
 #endif // __TEST_UTILS_H__
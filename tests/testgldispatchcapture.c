@@ -0,0 +1,462 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <dlfcn.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#include "GLdispatch.h"
+#include "GLcapture.h"
+#include "glvnd_pthread.h"
+
+#define printError(...) fprintf(stderr, __VA_ARGS__)
+
+/*
+ * Checks the capture dispatch mode. This starts a capture, makes a fixed
+ * sequence of calls on several threads, and then reads back the capture file
+ * to make sure that every call was recorded with the right arguments, and
+ * that the calls still reached the vendor.
+ *
+ * If the file is too small to hold every call, then this checks that each
+ * thread recorded the start of its sequence, and that the header counts the
+ * rest as dropped.
+ *
+ * The capture file is left behind so that testgldispatchcapture.sh can check
+ * it with the decoder.
+ */
+
+typedef struct TestOptionsRec {
+    int iterations;
+    int threads;
+    const char *filename;
+    size_t size;
+} TestOptions;
+
+static TestOptions t;
+static GLVNDPthreadFuncs pImp;
+static __GLdispatchTable *table;
+
+static void (*pBegin)(GLenum);
+static void (*pColor3f)(GLfloat, GLfloat, GLfloat);
+static void (*pVertex3d)(GLdouble, GLdouble, GLdouble);
+static GLboolean (*pIsEnabled)(GLenum);
+static void (*pCaptureTest)(GLint);
+
+static int numCalls;
+
+static void capBegin(GLenum mode)
+{
+    __sync_fetch_and_add(&numCalls, 1);
+}
+
+static void capColor3f(GLfloat r, GLfloat g, GLfloat b)
+{
+    __sync_fetch_and_add(&numCalls, 1);
+}
+
+static void capVertex3d(GLdouble x, GLdouble y, GLdouble z)
+{
+    __sync_fetch_and_add(&numCalls, 1);
+}
+
+static GLboolean capIsEnabled(GLenum cap)
+{
+    __sync_fetch_and_add(&numCalls, 1);
+    return (cap == GL_DEPTH_TEST) ? GL_TRUE : GL_FALSE;
+}
+
+static void capCaptureTest(GLint value)
+{
+    __sync_fetch_and_add(&numCalls, 1);
+}
+
+static void *CapGetProcAddress(const GLubyte *procName, void *vendorData)
+{
+    if (!strcmp((const char *)procName, "glBegin")) {
+        return capBegin;
+    } else if (!strcmp((const char *)procName, "glColor3f")) {
+        return capColor3f;
+    } else if (!strcmp((const char *)procName, "glVertex3d")) {
+        return capVertex3d;
+    } else if (!strcmp((const char *)procName, "glIsEnabled")) {
+        return capIsEnabled;
+    } else if (!strcmp((const char *)procName, "glCaptureTestNV")) {
+        return capCaptureTest;
+    }
+    return NULL;
+}
+
+static GLboolean CapGetDispatchProto(const GLubyte *procName,
+                                     char ***function_names,
+                                     char **parameter_signature)
+{
+    if (strcmp((const char *)procName, "glCaptureTestNV")) {
+        return GL_FALSE;
+    }
+
+    *function_names = malloc(2 * sizeof(char *));
+    (*function_names)[0] = strdup("glCaptureTestNV");
+    (*function_names)[1] = NULL;
+    *parameter_signature = strdup("i");
+    return GL_TRUE;
+}
+
+static void CapDestroyVendorData(void *vendorData)
+{
+}
+
+static void print_help(void)
+{
+    const char *help_string =
+        "Options: \n"
+        " -h, --help              Print this help message.\n"
+        " -i, --iterations=<N>    Make each sequence of calls N times.\n"
+        " -t, --threads=<N>       Make the calls on N threads.\n"
+        " -o, --output=<file>     Write the capture to file.\n"
+        " -s, --size=<N>          Limit the capture file to N kilobytes.\n";
+    printf("%s", help_string);
+}
+
+static void init_options(int argc, char **argv, TestOptions *t)
+{
+    int c;
+
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "iterations", required_argument, NULL, 'i' },
+        { "threads", required_argument, NULL, 't' },
+        { "output", required_argument, NULL, 'o' },
+        { "size", required_argument, NULL, 's' },
+        { NULL, no_argument, NULL, 0 }
+    };
+
+    // Initialize defaults
+    t->iterations = 1000;
+    t->threads = 2;
+    t->filename = "testgldispatchcapture.bin";
+    t->size = 0;
+
+    do {
+        c = getopt_long(argc, argv, "hi:t:o:s:", long_options, NULL);
+        switch (c) {
+        case -1:
+        default:
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+            break;
+        case 'i':
+            t->iterations = atoi(optarg);
+            if (t->iterations <= 0) {
+                printError("Invalid iteration count %d\n", t->iterations);
+                exit(1);
+            }
+            break;
+        case 't':
+            t->threads = atoi(optarg);
+            if (t->threads <= 0) {
+                printError("Invalid thread count %d\n", t->threads);
+                exit(1);
+            }
+            break;
+        case 'o':
+            t->filename = optarg;
+            break;
+        case 's':
+            if (atoi(optarg) <= 0) {
+                printError("Invalid size %s\n", optarg);
+                exit(1);
+            }
+            t->size = (size_t)atoi(optarg) * 1024;
+            break;
+        }
+    } while (c != -1);
+}
+
+static void *CaptureThread(void *arg)
+{
+    __GLdispatchAPIState apiState;
+    intptr_t ret = 0;
+    int i;
+
+    memset(&apiState, 0, sizeof(apiState));
+    apiState.tag = GLDISPATCH_API_GLX;
+    apiState.dispatch = table;
+    apiState.context = &apiState;
+    __glDispatchMakeCurrent(&apiState);
+
+    for (i = 0; i < t.iterations; i++) {
+        pBegin(GL_TRIANGLES);
+        pColor3f(0.25f, 0.5f, 0.75f);
+        pVertex3d(1.0, -2.0, 3.5);
+        if (!pIsEnabled(GL_DEPTH_TEST)) {
+            printError("glIsEnabled returned the wrong value!\n");
+            ret = 1;
+        }
+        pCaptureTest(-i);
+    }
+
+    __glDispatchLoseCurrent();
+
+    return (void *)ret;
+}
+
+/*
+ * The sequence of calls that each thread makes, and the arguments that each
+ * call should be recorded with. The last call is through a dynamic stub, so
+ * it's recorded without any arguments.
+ */
+typedef struct ExpectedCallRec {
+    const char *name;
+    int numArgs;
+    uint64_t args[3];
+} ExpectedCall;
+
+static GLboolean CheckRecord(const uint64_t *rec, const ExpectedCall *call,
+                             int iteration)
+{
+    GLint offset = __glDispatchGetOffset(call->name);
+    int i;
+
+    if ((uint32_t)rec[0] != (uint32_t)(offset + 1) ||
+        (int)(rec[0] >> 32) != call->numArgs) {
+        printError("Expected a record for %s, got slot %d with %d args\n",
+                   call->name, (int)(uint32_t)rec[0] - 1,
+                   (int)(rec[0] >> 32));
+        return GL_FALSE;
+    }
+    for (i = 0; i < call->numArgs; i++) {
+        if (rec[2 + i] != call->args[i]) {
+            printError("Wrong argument %d for %s in iteration %d: "
+                       "0x%llx, expected 0x%llx\n", i, call->name, iteration,
+                       (unsigned long long)rec[2 + i],
+                       (unsigned long long)call->args[i]);
+            return GL_FALSE;
+        }
+    }
+    return GL_TRUE;
+}
+
+static GLboolean CheckCapture(void)
+{
+    union { float f; uint32_t u; } f[3] = { { 0.25f }, { 0.5f }, { 0.75f } };
+    union { double d; uint64_t u; } d[3] = { { 1.0 }, { -2.0 }, { 3.5 } };
+    ExpectedCall calls[] = {
+        { "glBegin", 1, { GL_TRIANGLES } },
+        { "glColor3f", 3, { f[0].u, f[1].u, f[2].u } },
+        { "glVertex3d", 3, { d[0].u, d[1].u, d[2].u } },
+        { "glIsEnabled", 1, { GL_DEPTH_TEST } },
+        { "glCaptureTestNV", 0, { 0 } },
+    };
+    const int numExpected = sizeof(calls) / sizeof(calls[0]);
+    const __GLcaptureHeader *header;
+    const uint64_t *words, *end;
+    uint64_t offset, lastTicks, total;
+    int *counts;
+    struct stat st;
+    char *data;
+    uint32_t thread;
+    GLboolean ret = GL_FALSE;
+    int fd, i;
+
+    fd = open(t.filename, O_RDONLY);
+    if (fd < 0 || fstat(fd, &st) != 0) {
+        printError("Can't open %s\n", t.filename);
+        return GL_FALSE;
+    }
+    data = mmap(NULL, st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    if (data == MAP_FAILED) {
+        printError("Can't map %s\n", t.filename);
+        return GL_FALSE;
+    }
+
+    header = (const __GLcaptureHeader *)data;
+    if (header->magic != GL_CAPTURE_MAGIC ||
+        header->version != GL_CAPTURE_VERSION ||
+        header->size > (uint64_t)st.st_size) {
+        printError("Invalid capture file header\n");
+        goto done;
+    }
+    // A thread only gets an ID once it has a chunk, so with a small file,
+    // some threads might not have recorded anything.
+    if (header->numThreads > (uint32_t)t.threads ||
+        (t.size == 0 && (header->numThreads != (uint32_t)t.threads ||
+                         header->numDropped))) {
+        printError("Expected %d threads and no dropped calls, got %u and "
+                   "%llu\n", t.threads, header->numThreads,
+                   (unsigned long long)header->numDropped);
+        goto done;
+    }
+
+    // Count the calls for each thread, and make sure each thread's calls
+    // are in order.
+    counts = calloc(t.threads + 1, sizeof(int));
+    for (offset = GL_CAPTURE_HEADER_SIZE;
+         offset + header->chunkSize <= header->size;
+         offset += header->chunkSize) {
+        words = (const uint64_t *)(data + offset);
+        end = words + (header->chunkSize / sizeof(uint64_t));
+        if ((uint32_t)words[0] == GL_CAPTURE_NAMES_MAGIC) {
+            offset += ((words[0] >> 32) - 1) * header->chunkSize;
+            continue;
+        } else if ((uint32_t)words[0] != GL_CAPTURE_CHUNK_MAGIC) {
+            printError("Bad chunk header at offset %llu\n",
+                       (unsigned long long)offset);
+            goto done_counts;
+        }
+        thread = (uint32_t)(words[0] >> 32);
+        if (thread == 0 || thread > (uint32_t)t.threads) {
+            printError("Bad thread ID %u\n", thread);
+            goto done_counts;
+        }
+
+        lastTicks = 0;
+        for (words++; words < end && words[0] != 0;
+             words += 2 + (words[0] >> 32)) {
+            i = counts[thread] % numExpected;
+            if (!CheckRecord(words, &calls[i], counts[thread] / numExpected)) {
+                goto done_counts;
+            }
+            if (words[1] < lastTicks) {
+                printError("Timestamps went backwards\n");
+                goto done_counts;
+            }
+            lastTicks = words[1];
+            counts[thread]++;
+        }
+    }
+
+    // Every call that wasn't recorded should be counted as dropped.
+    total = header->numDropped;
+    for (i = 1; i <= t.threads; i++) {
+        if (t.size == 0 && counts[i] != t.iterations * numExpected) {
+            printError("Thread %d recorded %d calls, expected %d\n",
+                       i, counts[i], t.iterations * numExpected);
+            goto done_counts;
+        }
+        total += counts[i];
+    }
+    if (total != (uint64_t)t.threads * t.iterations * numExpected) {
+        printError("Recorded and dropped %llu calls, expected %d\n",
+                   (unsigned long long)total,
+                   t.threads * t.iterations * numExpected);
+        goto done_counts;
+    }
+    printf("recorded=%llu dropped=%llu\n",
+           (unsigned long long)(total - header->numDropped),
+           (unsigned long long)header->numDropped);
+    ret = GL_TRUE;
+
+done_counts:
+    free(counts);
+done:
+    munmap(data, st.st_size);
+    return ret;
+}
+
+int main(int argc, char **argv)
+{
+    glvnd_thread_t *threads;
+    void *threadRet;
+    GLboolean failed = GL_FALSE;
+    int i;
+
+    init_options(argc, argv, &t);
+
+    glvndSetupPthreads(RTLD_DEFAULT, &pImp);
+    __glDispatchInit(&pImp);
+
+    if (!__glDispatchStartCapture(t.filename, t.size)) {
+        printf("Capturing isn't supported on this platform\n");
+        return 77;
+    }
+
+    pBegin = (void (*)(GLenum))__glDispatchGetProcAddress("glBegin");
+    pColor3f = (void (*)(GLfloat, GLfloat, GLfloat))
+        __glDispatchGetProcAddress("glColor3f");
+    pVertex3d = (void (*)(GLdouble, GLdouble, GLdouble))
+        __glDispatchGetProcAddress("glVertex3d");
+    pIsEnabled = (GLboolean (*)(GLenum))
+        __glDispatchGetProcAddress("glIsEnabled");
+    pCaptureTest = (void (*)(GLint))
+        __glDispatchGetProcAddress("glCaptureTestNV");
+    if (!pBegin || !pColor3f || !pVertex3d || !pIsEnabled || !pCaptureTest) {
+        printError("Failed to get the dispatch stubs!\n");
+        return 1;
+    }
+
+    table = __glDispatchCreateTable(CapGetProcAddress,
+                                    CapGetDispatchProto,
+                                    CapDestroyVendorData,
+                                    NULL);
+    if (!table) {
+        printError("Failed to create a dispatch table!\n");
+        return 1;
+    }
+
+    threads = malloc(t.threads * sizeof(glvnd_thread_t));
+    for (i = 0; i < t.threads; i++) {
+        if (pImp.create(&threads[i], NULL, CaptureThread, NULL) != 0) {
+            printError("Failed to create a thread!\n");
+            return 1;
+        }
+    }
+    for (i = 0; i < t.threads; i++) {
+        if (pImp.join(threads[i], &threadRet) != 0 || threadRet) {
+            failed = GL_TRUE;
+        }
+    }
+    free(threads);
+    if (failed) {
+        return 1;
+    }
+
+    if (numCalls != t.threads * t.iterations * 5) {
+        printError("The vendor got %d calls, expected %d\n",
+                   numCalls, t.threads * t.iterations * 5);
+        return 1;
+    }
+
+    if (!__glDispatchFlushCapture() || !CheckCapture()) {
+        return 1;
+    }
+
+    __glDispatchDestroyTable(table);
+
+    return 0;
+}
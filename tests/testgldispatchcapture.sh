@@ -0,0 +1,30 @@
+#!/bin/bash
+
+# Capture calls from several threads, and make sure that they're all recorded
+# with the right arguments.
+./testgldispatchcapture -i 1000 -t 4 -o capture.bin
+RET=$?
+if [ $RET -ne 0 ]; then
+    rm -f capture.bin
+    exit $RET
+fi
+
+# Make sure the decoder can read the finished file.
+DECODE=$TOP_BUILDDIR/src/GLdispatch/glcapturedecode
+
+$DECODE -c capture.bin > capture.txt || exit 1
+grep -q "4000 glColor3f$" capture.txt || exit 1
+grep -q "4000 glCaptureTestNV$" capture.txt || exit 1
+
+$DECODE -s capture.bin > capture.txt || exit 1
+grep -q "glColor3f(0.25, 0.5, 0.75)$" capture.txt || exit 1
+grep -q "glVertex3d(1, -2, 3.5)$" capture.txt || exit 1
+
+rm -f capture.bin capture.txt
+
+# Capture more calls than fit in the file, and make sure the ones that don't
+# fit are counted as dropped.
+./testgldispatchcapture -i 100000 -t 4 -s 256 -o capture.bin
+RET=$?
+rm -f capture.bin
+exit $RET
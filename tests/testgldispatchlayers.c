@@ -0,0 +1,382 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <dlfcn.h>
+
+#include "GLdispatch.h"
+#include "glvnd_pthread.h"
+
+#define printError(...) fprintf(stderr, __VA_ARGS__)
+
+/*
+ * Tests interposer layers added with __glDispatchAddLayer().
+ *
+ * This adds three layers. The first one wraps glBegin, the second one skips
+ * every table, and the third one wraps glBegin and glColor3f. It checks that
+ * calls go through each layer that overrides them and then to the vendor,
+ * that every other function goes straight to the vendor, that changes to the
+ * vendor's table show up through the layers, and that the layer tables are
+ * destroyed with the vendor's table.
+ */
+
+enum {
+    LAYER_OUTER,
+    LAYER_SKIPPED,
+    LAYER_INNER,
+    LAYER_COUNT
+};
+
+static GLVNDPthreadFuncs pImp;
+
+static GLint beginOffset;
+static GLint color3fOffset;
+static GLint endOffset;
+
+static int vendorBeginCount;
+static int vendorBegin2Count;
+static int vendorColor3fCount;
+static int vendorEndCount;
+static int vendorEnd2Count;
+static int layerBeginCount[LAYER_COUNT];
+static int layerColor3fCount;
+static int layerCreateCount[LAYER_COUNT];
+static int layerDestroyCount;
+static int layerIndex[LAYER_COUNT];
+
+static void vendorBegin(GLenum mode)
+{
+    vendorBeginCount++;
+}
+
+static void vendorBegin2(GLenum mode)
+{
+    vendorBegin2Count++;
+}
+
+static void vendorColor3f(GLfloat r, GLfloat g, GLfloat b)
+{
+    vendorColor3fCount++;
+}
+
+static void vendorEnd(void)
+{
+    vendorEndCount++;
+}
+
+static void vendorEnd2(void)
+{
+    vendorEnd2Count++;
+}
+
+static void *VendorGetProcAddress(const GLubyte *procName, void *vendorData)
+{
+    if (!strcmp((const char *)procName, "glBegin")) {
+        return vendorBegin;
+    } else if (!strcmp((const char *)procName, "glColor3f")) {
+        return vendorColor3f;
+    } else if (!strcmp((const char *)procName, "glEnd")) {
+        return vendorEnd;
+    }
+    return NULL;
+}
+
+static GLboolean VendorGetDispatchProto(const GLubyte *procName,
+                                        char ***function_names,
+                                        char **parameter_signature)
+{
+    return GL_FALSE;
+}
+
+static void VendorDestroyVendorData(void *vendorData)
+{
+}
+
+static void outerBegin(GLenum mode)
+{
+    const __GLdispatchProc *next =
+        __glDispatchGetLayerNext(layerIndex[LAYER_OUTER]);
+
+    layerBeginCount[LAYER_OUTER]++;
+    ((void (*)(GLenum))next[beginOffset])(mode);
+}
+
+static void innerBegin(GLenum mode)
+{
+    const __GLdispatchProc *next =
+        __glDispatchGetLayerNext(layerIndex[LAYER_INNER]);
+
+    layerBeginCount[LAYER_INNER]++;
+    ((void (*)(GLenum))next[beginOffset])(mode);
+}
+
+static void innerColor3f(GLfloat r, GLfloat g, GLfloat b)
+{
+    const __GLdispatchProc *next =
+        __glDispatchGetLayerNext(layerIndex[LAYER_INNER]);
+
+    layerColor3fCount++;
+    ((void (*)(GLfloat, GLfloat, GLfloat))next[color3fOffset])(r, g, b);
+}
+
+static __GLdispatchTable *OuterCreateTable(__GLdispatchTable *next,
+                                           void *layerData)
+{
+    __GLdispatchProc proc = (__GLdispatchProc)outerBegin;
+
+    layerCreateCount[LAYER_OUTER]++;
+    return __glDispatchCreateOverlayTable(next, &beginOffset, &proc, 1);
+}
+
+static __GLdispatchTable *SkippedCreateTable(__GLdispatchTable *next,
+                                             void *layerData)
+{
+    layerCreateCount[LAYER_SKIPPED]++;
+    return NULL;
+}
+
+static __GLdispatchTable *InnerCreateTable(__GLdispatchTable *next,
+                                           void *layerData)
+{
+    GLint offsets[2] = { beginOffset, color3fOffset };
+    __GLdispatchProc procs[2] = {
+        (__GLdispatchProc)innerBegin,
+        (__GLdispatchProc)innerColor3f
+    };
+
+    layerCreateCount[LAYER_INNER]++;
+    return __glDispatchCreateOverlayTable(next, offsets, procs, 2);
+}
+
+static void InnerDestroyTable(__GLdispatchTable *table, void *layerData)
+{
+    layerDestroyCount++;
+    __glDispatchDestroyTable(table);
+}
+
+static GLboolean OuterInit(int version, int index, __GLdispatchLayer *layer)
+{
+    layerIndex[LAYER_OUTER] = index;
+    layer->createTable = OuterCreateTable;
+    return GL_TRUE;
+}
+
+static GLboolean SkippedInit(int version, int index, __GLdispatchLayer *layer)
+{
+    layerIndex[LAYER_SKIPPED] = index;
+    layer->createTable = SkippedCreateTable;
+    return GL_TRUE;
+}
+
+static GLboolean InnerInit(int version, int index, __GLdispatchLayer *layer)
+{
+    layerIndex[LAYER_INNER] = index;
+    layer->createTable = InnerCreateTable;
+    layer->destroyTable = InnerDestroyTable;
+    return GL_TRUE;
+}
+
+static GLboolean FailInit(int version, int index, __GLdispatchLayer *layer)
+{
+    return GL_FALSE;
+}
+
+static int CheckCounts(const char *what, int expectVendorBegin,
+                       int expectOuterBegin, int expectInnerBegin)
+{
+    if ((vendorBeginCount + vendorBegin2Count != expectVendorBegin) ||
+        (layerBeginCount[LAYER_OUTER] != expectOuterBegin) ||
+        (layerBeginCount[LAYER_INNER] != expectInnerBegin)) {
+        printError("%s: glBegin reached the vendor %d times, the outer layer "
+                   "%d times, and the inner layer %d times. Expected %d, %d, "
+                   "and %d.\n", what,
+                   vendorBeginCount + vendorBegin2Count,
+                   layerBeginCount[LAYER_OUTER],
+                   layerBeginCount[LAYER_INNER],
+                   expectVendorBegin, expectOuterBegin, expectInnerBegin);
+        return 0;
+    }
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    __GLdispatchTable *vendorTable, *vendorTable2;
+    __GLdispatchAPIState apiState;
+    const __GLdispatchProc *next;
+    void (*pBegin)(GLenum);
+    void (*pColor3f)(GLfloat, GLfloat, GLfloat);
+    void (*pEnd)(void);
+    __GLdispatchProc proc;
+    int i;
+
+    // Layers can't be used with lazy dispatch.
+    unsetenv("__GL_LAZY_DISPATCH");
+
+    glvndSetupPthreads(RTLD_DEFAULT, &pImp);
+    __glDispatchInit(&pImp);
+
+    pBegin = (void (*)(GLenum))__glDispatchGetProcAddress("glBegin");
+    pColor3f = (void (*)(GLfloat, GLfloat, GLfloat))
+        __glDispatchGetProcAddress("glColor3f");
+    pEnd = (void (*)(void))__glDispatchGetProcAddress("glEnd");
+    beginOffset = __glDispatchGetOffset("glBegin");
+    color3fOffset = __glDispatchGetOffset("glColor3f");
+    endOffset = __glDispatchGetOffset("glEnd");
+    if (!pBegin || !pColor3f || !pEnd || (beginOffset < 0) ||
+        (color3fOffset < 0) || (endOffset < 0)) {
+        printError("Failed to get the dispatch stubs!\n");
+        return 1;
+    }
+
+    if (__glDispatchAddLayer(FailInit)) {
+        printError("Added a layer whose init function failed!\n");
+        return 1;
+    }
+    if (!__glDispatchAddLayer(OuterInit) ||
+        !__glDispatchAddLayer(SkippedInit) ||
+        !__glDispatchAddLayer(InnerInit)) {
+        printError("Failed to add the layers!\n");
+        return 1;
+    }
+    if ((layerIndex[LAYER_SKIPPED] != layerIndex[LAYER_OUTER] + 1) ||
+        (layerIndex[LAYER_INNER] != layerIndex[LAYER_OUTER] + 2)) {
+        printError("The layers were given the wrong indices!\n");
+        return 1;
+    }
+
+    vendorTable = __glDispatchCreateTable(VendorGetProcAddress,
+                                          VendorGetDispatchProto,
+                                          VendorDestroyVendorData,
+                                          NULL);
+    vendorTable2 = __glDispatchCreateTable(VendorGetProcAddress,
+                                           VendorGetDispatchProto,
+                                           VendorDestroyVendorData,
+                                           NULL);
+    if (!vendorTable || !vendorTable2) {
+        printError("Failed to create the dispatch tables!\n");
+        return 1;
+    }
+
+    memset(&apiState, 0, sizeof(apiState));
+    apiState.tag = GLDISPATCH_API_GLX;
+    apiState.dispatch = vendorTable;
+    apiState.context = &apiState;
+    __glDispatchMakeCurrent(&apiState);
+
+    for (i = 0; i < LAYER_COUNT; i++) {
+        if (layerCreateCount[i] != 1) {
+            printError("Layer %d was asked to create %d tables!\n", i,
+                       layerCreateCount[i]);
+            return 1;
+        }
+    }
+
+    // glBegin goes through both layers that override it.
+    pBegin(GL_TRIANGLES);
+    if (!CheckCounts("make current", 1, 1, 1)) {
+        return 1;
+    }
+
+    // glColor3f only goes through the inner layer, and glEnd goes straight to
+    // the vendor.
+    pColor3f(0.0f, 0.0f, 0.0f);
+    pEnd();
+    if ((layerColor3fCount != 1) || (vendorColor3fCount != 1) ||
+        (vendorEndCount != 1)) {
+        printError("glColor3f or glEnd didn't reach the vendor!\n");
+        return 1;
+    }
+
+    // The skipped layer's next table is the inner layer's, and the tables
+    // only differ from the vendor's in the functions they override.
+    next = __glDispatchGetLayerNext(layerIndex[LAYER_OUTER]);
+    if ((next != __glDispatchGetLayerNext(layerIndex[LAYER_SKIPPED])) ||
+        (next[beginOffset] != (__GLdispatchProc)innerBegin) ||
+        (next[endOffset] != (__GLdispatchProc)vendorEnd)) {
+        printError("The outer layer has the wrong next table!\n");
+        return 1;
+    }
+    next = __glDispatchGetLayerNext(layerIndex[LAYER_INNER]);
+    if ((next[beginOffset] != (__GLdispatchProc)vendorBegin) ||
+        (next[color3fOffset] != (__GLdispatchProc)vendorColor3f)) {
+        printError("The inner layer has the wrong next table!\n");
+        return 1;
+    }
+
+    // Changing the vendor's table should update the layer tables, without
+    // disturbing the functions that they override.
+    proc = (__GLdispatchProc)vendorEnd2;
+    __glDispatchSetEntry(vendorTable, endOffset, proc);
+    proc = (__GLdispatchProc)vendorBegin2;
+    __glDispatchSetEntry(vendorTable, beginOffset, proc);
+    pEnd();
+    pBegin(GL_TRIANGLES);
+    if ((vendorEnd2Count != 1) || (vendorBegin2Count != 1) ||
+        !CheckCounts("set entry", 2, 2, 2)) {
+        printError("The layers didn't pick up a change to the vendor's "
+                   "table!\n");
+        return 1;
+    }
+
+    // Swapping to another validated table installs that table's chain.
+    if (!__glDispatchValidateTable(vendorTable) ||
+        !__glDispatchValidateTable(vendorTable2)) {
+        printError("Failed to validate the tables!\n");
+        return 1;
+    }
+    __glDispatchSwapTable(vendorTable2);
+    pBegin(GL_TRIANGLES);
+    if ((vendorBeginCount != 2) || !CheckCounts("swap", 3, 3, 3)) {
+        return 1;
+    }
+    __glDispatchSwapTable(vendorTable);
+    pBegin(GL_TRIANGLES);
+    if ((vendorBegin2Count != 2) || !CheckCounts("swap back", 4, 4, 4)) {
+        return 1;
+    }
+
+    __glDispatchLoseCurrent();
+    __glDispatchInvalidateTable(vendorTable);
+    __glDispatchInvalidateTable(vendorTable2);
+
+    // Destroying a vendor table destroys its layer tables.
+    __glDispatchDestroyTable(vendorTable);
+    __glDispatchDestroyTable(vendorTable2);
+    if (layerDestroyCount != 2) {
+        printError("The inner layer destroyed %d tables, expected 2!\n",
+                   layerDestroyCount);
+        return 1;
+    }
+
+    return 0;
+}
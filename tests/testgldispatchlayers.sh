@@ -0,0 +1,5 @@
+#!/bin/bash
+
+# Check that calls go through the interposer layers that override them, and
+# straight to the vendor otherwise.
+./testgldispatchlayers
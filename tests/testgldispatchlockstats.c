@@ -0,0 +1,274 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <dlfcn.h>
+
+#include "GLdispatch.h"
+#include "glvnd_pthread.h"
+
+#define printError(...) fprintf(stderr, __VA_ARGS__)
+
+/*
+ * Checks the lock statistics from __glDispatchGetLockStats(). Several threads
+ * hammer on the dispatch lock by looking up functions, and then we make sure
+ * that the dispatch lock's statistics add up.
+ *
+ * If __GL_LOCK_STATS isn't set, then this checks that nothing is recorded.
+ */
+
+#define MAX_LOCK_STATS 16
+
+typedef struct TestOptionsRec {
+    int iterations;
+    int threads;
+} TestOptions;
+
+static GLVNDPthreadFuncs pImp;
+
+static void print_help(void)
+{
+    const char *help_string =
+        "Options: \n"
+        " -h, --help              Print this help message.\n"
+        " -i, --iterations=<N>    Look up a function N times in each thread.\n"
+        " -t, --threads=<N>       Run with N threads.\n";
+    printf("%s", help_string);
+}
+
+static void init_options(int argc, char **argv, TestOptions *t)
+{
+    int c;
+
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "iterations", required_argument, NULL, 'i' },
+        { "threads", required_argument, NULL, 't' },
+        { NULL, no_argument, NULL, 0 }
+    };
+
+    // Initialize defaults
+    t->iterations = 10000;
+    t->threads = 4;
+
+    do {
+        c = getopt_long(argc, argv, "hi:t:", long_options, NULL);
+        switch (c) {
+        case -1:
+        default:
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+            break;
+        case 'i':
+            t->iterations = atoi(optarg);
+            if (t->iterations <= 0) {
+                printError("Invalid iteration count %d\n", t->iterations);
+                exit(1);
+            }
+            break;
+        case 't':
+            t->threads = atoi(optarg);
+            if (t->threads <= 0) {
+                printError("Invalid thread count %d\n", t->threads);
+                exit(1);
+            }
+            break;
+        }
+    } while (c != -1);
+}
+
+static void *LookupThread(void *arg)
+{
+    TestOptions *t = (TestOptions *)arg;
+    int i;
+
+    for (i = 0; i < t->iterations; i++) {
+        if (!__glDispatchGetProcAddress("glBegin")) {
+            return (void *)1;
+        }
+    }
+
+    return NULL;
+}
+
+static uint64_t SumHistogram(const uint64_t *histogram)
+{
+    uint64_t sum = 0;
+    int i;
+
+    for (i = 0; i < GLVND_LOCK_STATS_NUM_BUCKETS; i++) {
+        sum += histogram[i];
+    }
+    return sum;
+}
+
+/*
+ * Registers and unregisters a lock several times, the way a library that's
+ * loaded and unloaded repeatedly would, and makes sure that its statistics
+ * are kept in a single entry.
+ */
+static int CheckRetiredStats(void)
+{
+    GLVNDlockStats lockStats;
+    GLVNDlockStats stats[MAX_LOCK_STATS];
+    int found = 0;
+    int count;
+    int i;
+
+    for (i = 0; i < 3; i++) {
+        memset(&lockStats, 0, sizeof(lockStats));
+        lockStats.name = "testgldispatchlockstats";
+        lockStats.numAcquires = 1;
+        lockStats.waitHistogram[0] = 1;
+        __glDispatchRegisterLockStats(&lockStats);
+        __glDispatchUnregisterLockStats(&lockStats);
+    }
+
+    count = __glDispatchGetLockStats(stats, MAX_LOCK_STATS);
+    for (i = 0; i < count && i < MAX_LOCK_STATS; i++) {
+        if (!strcmp(stats[i].name, "testgldispatchlockstats")) {
+            if (stats[i].numAcquires != 3 ||
+                    stats[i].waitHistogram[0] != 3) {
+                printError("Retired lock has %llu acquires, expected 3\n",
+                           (unsigned long long)stats[i].numAcquires);
+                return 0;
+            }
+            found++;
+        }
+    }
+    if (found != 1) {
+        printError("Found %d entries for the retired lock\n", found);
+        return 0;
+    }
+
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    TestOptions t;
+    glvnd_thread_t *threads;
+    GLVNDlockStats stats[MAX_LOCK_STATS];
+    GLVNDlockStats *dispatchStats = NULL;
+    void *ret;
+    int count;
+    int i;
+
+    init_options(argc, argv, &t);
+
+    glvndSetupPthreads(RTLD_DEFAULT, &pImp);
+    __glDispatchInit(&pImp);
+
+    threads = malloc(t.threads * sizeof(glvnd_thread_t));
+    if (!threads) {
+        printError("Out of memory!\n");
+        return 1;
+    }
+
+    for (i = 0; i < t.threads; i++) {
+        if (pImp.create(&threads[i], NULL, LookupThread, &t)) {
+            printError("Failed to create thread %d\n", i);
+            return 1;
+        }
+    }
+    for (i = 0; i < t.threads; i++) {
+        pImp.join(threads[i], &ret);
+        if (ret) {
+            printError("Failed to look up glBegin in thread %d\n", i);
+            return 1;
+        }
+    }
+    free(threads);
+
+    count = __glDispatchGetLockStats(stats, MAX_LOCK_STATS);
+
+    if (!__glDispatchLockStatsEnabled()) {
+        if (count != 0) {
+            printError("Got %d lock stats without __GL_LOCK_STATS\n", count);
+            return 1;
+        }
+        printf("Lock statistics are disabled\n");
+        return 0;
+    }
+
+    for (i = 0; i < count && i < MAX_LOCK_STATS; i++) {
+        if (!strcmp(stats[i].name, "dispatch")) {
+            dispatchStats = &stats[i];
+        }
+    }
+    if (!dispatchStats) {
+        printError("The dispatch lock isn't registered\n");
+        return 1;
+    }
+
+    if (dispatchStats->numAcquires < (uint64_t)t.threads * t.iterations) {
+        printError("Only %llu dispatch lock acquires recorded\n",
+                   (unsigned long long)dispatchStats->numAcquires);
+        return 1;
+    }
+    if (dispatchStats->numContended > dispatchStats->numAcquires) {
+        printError("More contended acquires than acquires\n");
+        return 1;
+    }
+    if (SumHistogram(dispatchStats->waitHistogram) !=
+            dispatchStats->numAcquires) {
+        printError("Wait histogram doesn't match the acquire count\n");
+        return 1;
+    }
+
+    // The snapshot was taken while holding the dispatch lock, so that last
+    // hold hasn't been counted yet.
+    if (dispatchStats->numHolds != dispatchStats->numAcquires - 1) {
+        printError("Recorded %llu holds for %llu acquires\n",
+                   (unsigned long long)dispatchStats->numHolds,
+                   (unsigned long long)dispatchStats->numAcquires);
+        return 1;
+    }
+    if (SumHistogram(dispatchStats->holdHistogram) !=
+            dispatchStats->numHolds) {
+        printError("Hold histogram doesn't match the hold count\n");
+        return 1;
+    }
+
+    printf("dispatch lock: %llu acquires, %llu contended\n",
+           (unsigned long long)dispatchStats->numAcquires,
+           (unsigned long long)dispatchStats->numContended);
+
+    if (!CheckRetiredStats()) {
+        return 1;
+    }
+
+    return 0;
+}
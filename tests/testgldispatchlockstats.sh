@@ -0,0 +1,6 @@
+#!/bin/bash
+
+# Check that lock statistics are only recorded if __GL_LOCK_STATS is set, and
+# that the dispatch lock's statistics are consistent.
+./testgldispatchlockstats -t 4 -i 10000 || exit 1
+__GL_LOCK_STATS=1 ./testgldispatchlockstats -t 4 -i 10000
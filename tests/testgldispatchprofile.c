@@ -0,0 +1,251 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <dlfcn.h>
+
+#include "GLdispatch.h"
+#include "glvnd_pthread.h"
+
+#define printError(...) fprintf(stderr, __VA_ARGS__)
+
+/*
+ * Checks the profiling dispatch mode. This enables profiling with every call
+ * timed, and then makes sure that calls still reach the vendor with the right
+ * arguments and return values, including after a table swap, and that the
+ * profiling counts match.
+ */
+
+typedef struct TestOptionsRec {
+    int iterations;
+} TestOptions;
+
+static GLVNDPthreadFuncs pImp;
+
+static int beginCount[2];
+static int colorCount;
+static GLboolean colorArgsOk = GL_TRUE;
+
+static void profBegin0(GLenum mode)
+{
+    beginCount[0]++;
+}
+
+static void profBegin1(GLenum mode)
+{
+    beginCount[1]++;
+}
+
+static void profColor3f(GLfloat r, GLfloat g, GLfloat b)
+{
+    colorCount++;
+    if (r != 0.25f || g != 0.5f || b != 0.75f) {
+        colorArgsOk = GL_FALSE;
+    }
+}
+
+static GLboolean profIsEnabled(GLenum cap)
+{
+    return (cap == GL_DEPTH_TEST) ? GL_TRUE : GL_FALSE;
+}
+
+static void *ProfGetProcAddress(const GLubyte *procName, void *vendorData)
+{
+    if (!strcmp((const char *)procName, "glBegin")) {
+        return vendorData ? profBegin1 : profBegin0;
+    } else if (!strcmp((const char *)procName, "glColor3f")) {
+        return profColor3f;
+    } else if (!strcmp((const char *)procName, "glIsEnabled")) {
+        return profIsEnabled;
+    }
+    return NULL;
+}
+
+static GLboolean ProfGetDispatchProto(const GLubyte *procName,
+                                      char ***function_names,
+                                      char **parameter_signature)
+{
+    return GL_FALSE;
+}
+
+static void ProfDestroyVendorData(void *vendorData)
+{
+}
+
+static void print_help(void)
+{
+    const char *help_string =
+        "Options: \n"
+        " -h, --help              Print this help message.\n"
+        " -i, --iterations=<N>    Call each function N times.\n";
+    printf("%s", help_string);
+}
+
+static void init_options(int argc, char **argv, TestOptions *t)
+{
+    int c;
+
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "iterations", required_argument, NULL, 'i' },
+        { NULL, no_argument, NULL, 0 }
+    };
+
+    // Initialize defaults
+    t->iterations = 1000;
+
+    do {
+        c = getopt_long(argc, argv, "hi:", long_options, NULL);
+        switch (c) {
+        case -1:
+        default:
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+            break;
+        case 'i':
+            t->iterations = atoi(optarg);
+            if (t->iterations <= 0) {
+                printError("Invalid iteration count %d\n", t->iterations);
+                exit(1);
+            }
+            break;
+        }
+    } while (c != -1);
+}
+
+static GLboolean CheckProfileCount(const char *procName, uint64_t expected)
+{
+    __GLdispatchProfileStats stats;
+
+    if (!__glDispatchGetProfileStats(__glDispatchGetOffset(procName),
+                                     &stats)) {
+        printError("No profile stats for %s\n", procName);
+        return GL_FALSE;
+    }
+    if ((stats.numCalls != expected) || (stats.numSamples != expected)) {
+        printError("Expected %llu calls to %s, got %llu (%llu sampled)\n",
+                   (unsigned long long)expected, procName,
+                   (unsigned long long)stats.numCalls,
+                   (unsigned long long)stats.numSamples);
+        return GL_FALSE;
+    }
+    return GL_TRUE;
+}
+
+int main(int argc, char **argv)
+{
+    TestOptions t;
+    __GLdispatchTable *tables[2];
+    __GLdispatchAPIState apiState;
+    void (*pBegin)(GLenum);
+    void (*pColor3f)(GLfloat, GLfloat, GLfloat);
+    GLboolean (*pIsEnabled)(GLenum);
+    int i;
+
+    init_options(argc, argv, &t);
+
+    glvndSetupPthreads(RTLD_DEFAULT, &pImp);
+    __glDispatchInit(&pImp);
+
+    if (!__glDispatchEnableProfiling(1)) {
+        printf("Profiling isn't supported on this platform\n");
+        return 0;
+    }
+
+    pBegin = (void (*)(GLenum))__glDispatchGetProcAddress("glBegin");
+    pColor3f = (void (*)(GLfloat, GLfloat, GLfloat))
+        __glDispatchGetProcAddress("glColor3f");
+    pIsEnabled = (GLboolean (*)(GLenum))
+        __glDispatchGetProcAddress("glIsEnabled");
+    if (!pBegin || !pColor3f || !pIsEnabled) {
+        printError("Failed to get the dispatch stubs!\n");
+        return 1;
+    }
+
+    for (i = 0; i < 2; i++) {
+        tables[i] = __glDispatchCreateTable(ProfGetProcAddress,
+                                            ProfGetDispatchProto,
+                                            ProfDestroyVendorData,
+                                            i ? &tables[i] : NULL);
+        if (!tables[i] || !__glDispatchValidateTable(tables[i])) {
+            printError("Failed to create a dispatch table!\n");
+            return 1;
+        }
+    }
+
+    memset(&apiState, 0, sizeof(apiState));
+    apiState.tag = GLDISPATCH_API_GLX;
+    apiState.dispatch = tables[0];
+    apiState.context = &apiState;
+    __glDispatchMakeCurrent(&apiState);
+
+    for (i = 0; i < t.iterations; i++) {
+        pBegin(GL_TRIANGLES);
+        pColor3f(0.25f, 0.5f, 0.75f);
+        if (!pIsEnabled(GL_DEPTH_TEST) || pIsEnabled(GL_BLEND)) {
+            printError("glIsEnabled returned the wrong value!\n");
+            return 1;
+        }
+    }
+
+    // Calls should go to the new table after a swap.
+    __glDispatchSwapTable(tables[1]);
+    for (i = 0; i < t.iterations; i++) {
+        pBegin(GL_TRIANGLES);
+    }
+
+    __glDispatchLoseCurrent();
+
+    if ((beginCount[0] != t.iterations) || (beginCount[1] != t.iterations)) {
+        printError("glBegin was called %d and %d times, expected %d\n",
+                   beginCount[0], beginCount[1], t.iterations);
+        return 1;
+    }
+    if ((colorCount != t.iterations) || !colorArgsOk) {
+        printError("glColor3f didn't get the right arguments!\n");
+        return 1;
+    }
+
+    if (!CheckProfileCount("glBegin", 2 * t.iterations) ||
+        !CheckProfileCount("glColor3f", t.iterations) ||
+        !CheckProfileCount("glIsEnabled", 2 * t.iterations)) {
+        return 1;
+    }
+
+    __glDispatchDestroyTable(tables[1]);
+    __glDispatchDestroyTable(tables[0]);
+
+    return 0;
+}
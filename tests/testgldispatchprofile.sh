@@ -0,0 +1,8 @@
+#!/bin/bash
+
+# Make sure that calls through the profiling dispatch table are counted and
+# still reach the vendor correctly.
+./testgldispatchprofile -i 1000 || exit 1
+
+# The profiling table should also work with lazily-built tables.
+__GL_LAZY_DISPATCH=1 ./testgldispatchprofile -i 1000
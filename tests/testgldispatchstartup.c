@@ -0,0 +1,448 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "GLdispatch.h"
+#include "glvnd_pthread.h"
+#include "utils_misc.h"
+
+#define printError(...) fprintf(stderr, __VA_ARGS__)
+
+/*
+ * Compares how long it takes GLdispatch to build a vendor's dispatch table
+ * at the first make current when the vendor provides a prebuilt table with
+ * the getStaticDispatch callback, versus looking up each function with the
+ * getProcAddress callback.
+ *
+ * The getProcAddress callback here does a binary search over a sorted list of
+ * names, which is about as cheap as a real vendor's lookup is likely to be, so
+ * the difference should be a lower bound on what a vendor would save.
+ *
+ * It also reports how long it takes to create an overlay table which replaces
+ * a few entries of an existing table, and checks that __glDispatchGetStats()
+ * reports the first table correctly.
+ */
+
+typedef struct TestOptionsRec {
+    int iterations;
+} TestOptions;
+
+static GLVNDPthreadFuncs pImp;
+
+// The names GLdispatch asked for while building a table, sorted
+static char **procNames;
+static int numProcNames;
+static int maxProcNames;
+
+// A complete table for the static dispatch callback, indexed by offset
+static __GLdispatchProc *staticProcs;
+static int numStaticProcs;
+
+static int beginCount;
+static int overlayBeginCount;
+
+static void benchBegin(GLenum mode)
+{
+    beginCount++;
+}
+
+static void benchOverlayBegin(GLenum mode)
+{
+    beginCount++;
+    overlayBeginCount++;
+}
+
+// The entries to replace in each overlay table
+static const char *overlayProcNames[] = {
+    "glBegin",
+    "glEnd",
+    "glVertex2f",
+    "glVertex3f",
+    "glVertex3fv",
+    "glColor3f",
+    "glColor4f",
+    "glNormal3f",
+};
+
+static void benchNop(void)
+{
+}
+
+static __GLdispatchProc LookupProc(const char *procName)
+{
+    if (!strcmp(procName, "glBegin")) {
+        return (__GLdispatchProc)benchBegin;
+    }
+    return benchNop;
+}
+
+static void *RecordProcAddress(const GLubyte *procName, void *vendorData)
+{
+    char **names;
+
+    if (numProcNames == maxProcNames) {
+        maxProcNames = maxProcNames ? maxProcNames * 2 : 1024;
+        names = realloc(procNames, maxProcNames * sizeof(char *));
+        if (!names) {
+            return NULL;
+        }
+        procNames = names;
+    }
+    procNames[numProcNames++] = strdup((const char *)procName);
+
+    return LookupProc((const char *)procName);
+}
+
+static int CompareNames(const void *a, const void *b)
+{
+    return strcmp(*(const char * const *)a, *(const char * const *)b);
+}
+
+static void *BenchGetProcAddress(const GLubyte *procName, void *vendorData)
+{
+    char **found = bsearch(&procName, procNames, numProcNames,
+                           sizeof(char *), CompareNames);
+
+    return found ? LookupProc(*found) : NULL;
+}
+
+static GLboolean BenchGetDispatchProto(const GLubyte *procName,
+                                       char ***function_names,
+                                       char **parameter_signature)
+{
+    return GL_FALSE;
+}
+
+static void BenchDestroyVendorData(void *vendorData)
+{
+}
+
+static const __GLdispatchProc *BenchGetStaticDispatch(void *vendorData,
+                                                      int *count)
+{
+    *count = numStaticProcs;
+    return staticProcs;
+}
+
+/*
+ * Checks the statistics for a table which has been made current once, and
+ * which the vendor provided every function for.
+ */
+static GLboolean CheckTableStats(__GLdispatchTable *dispatch)
+{
+    __GLdispatchTableStats *stats;
+    int count, i;
+    GLboolean ret = GL_FALSE;
+
+    count = __glDispatchGetStats(NULL, 0);
+    stats = malloc(count * sizeof(*stats));
+    if (!stats || (__glDispatchGetStats(stats, count) != count)) {
+        printError("Failed to get the dispatch table stats\n");
+        goto done;
+    }
+
+    for (i = 0; i < count; i++) {
+        if (stats[i].table == dispatch) {
+            break;
+        }
+    }
+    if (i == count) {
+        printError("The dispatch table isn't in the stats\n");
+        goto done;
+    }
+
+    if ((stats[i].numResolved != numProcNames) || (stats[i].numNoop != 0)) {
+        printError("Expected %d resolved functions, got %d (%d no-ops)\n",
+                   numProcNames, stats[i].numResolved, stats[i].numNoop);
+        goto done;
+    }
+    if ((stats[i].numMakeCurrent != 1) ||
+        (stats[i].peakCurrentThreads != 1)) {
+        printError("Expected 1 make current on 1 thread, got %lu on %d\n",
+                   stats[i].numMakeCurrent, stats[i].peakCurrentThreads);
+        goto done;
+    }
+    if ((stats[i].buildTime == 0) || (stats[i].numFixups == 0)) {
+        printError("The table build and fixup weren't recorded\n");
+        goto done;
+    }
+    ret = GL_TRUE;
+
+done:
+    free(stats);
+    return ret;
+}
+
+static uint64_t GetTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+/*
+ * Makes a table current, which is when GLdispatch builds it, and checks that
+ * glBegin dispatches to the right function.
+ */
+static GLboolean BuildTable(__GLdispatchTable *dispatch,
+                            void (*pBegin)(GLenum))
+{
+    __GLdispatchAPIState apiState;
+
+    memset(&apiState, 0, sizeof(apiState));
+    apiState.tag = GLDISPATCH_API_GLX;
+    apiState.dispatch = dispatch;
+    apiState.context = &apiState;
+
+    __glDispatchMakeCurrent(&apiState);
+
+    beginCount = 0;
+    pBegin(GL_TRIANGLES);
+
+    __glDispatchLoseCurrent();
+
+    return (beginCount == 1);
+}
+
+/*
+ * Builds t->iterations tables using the given callbacks, and returns the
+ * average time per table in nanoseconds, or 0 on failure.
+ */
+static uint64_t TimeTables(const TestOptions *t,
+                           __GLgetProcAddressCallback getProcAddress,
+                           __GLgetStaticDispatchCallback getStaticDispatch,
+                           void (*pBegin)(GLenum))
+{
+    __GLdispatchTable *dispatch;
+    uint64_t start, total = 0;
+    int i;
+
+    for (i = 0; i < t->iterations; i++) {
+        dispatch = __glDispatchCreateTableWithStaticDispatch(getProcAddress,
+                                                             BenchGetDispatchProto,
+                                                             BenchDestroyVendorData,
+                                                             NULL,
+                                                             getStaticDispatch);
+        if (!dispatch) {
+            printError("Failed to create a dispatch table!\n");
+            return 0;
+        }
+
+        start = GetTime();
+        if (!BuildTable(dispatch, pBegin)) {
+            printError("glBegin didn't dispatch to the vendor!\n");
+            return 0;
+        }
+        total += GetTime() - start;
+
+        __glDispatchDestroyTable(dispatch);
+    }
+
+    return total / t->iterations;
+}
+
+/*
+ * Creates t->iterations overlay tables on top of a base table, and returns the
+ * average time per table in nanoseconds, or 0 on failure. Unlike a regular
+ * table, an overlay is built when it's created, so this times the creation.
+ */
+static uint64_t TimeOverlays(const TestOptions *t, void (*pBegin)(GLenum))
+{
+    GLint offsets[ARRAY_LEN(overlayProcNames)];
+    __GLdispatchProc procs[ARRAY_LEN(overlayProcNames)];
+    const int count = ARRAY_LEN(overlayProcNames);
+    __GLdispatchTable *base, *dispatch;
+    uint64_t start, total = 0;
+    int i;
+
+    for (i = 0; i < count; i++) {
+        offsets[i] = __glDispatchGetOffset(overlayProcNames[i]);
+        procs[i] = (i == 0) ? (__GLdispatchProc)benchOverlayBegin : benchNop;
+    }
+
+    base = __glDispatchCreateTable(BenchGetProcAddress,
+                                   BenchGetDispatchProto,
+                                   BenchDestroyVendorData,
+                                   NULL);
+    if (!base || !BuildTable(base, pBegin)) {
+        printError("Failed to build the base table!\n");
+        return 0;
+    }
+
+    for (i = 0; i < t->iterations; i++) {
+        start = GetTime();
+        dispatch = __glDispatchCreateOverlayTable(base, offsets, procs, count);
+        total += GetTime() - start;
+
+        if (!dispatch) {
+            printError("Failed to create an overlay table!\n");
+            return 0;
+        }
+
+        overlayBeginCount = 0;
+        if (!BuildTable(dispatch, pBegin) || (overlayBeginCount != 1)) {
+            printError("glBegin didn't dispatch to the overlay!\n");
+            return 0;
+        }
+
+        __glDispatchDestroyTable(dispatch);
+    }
+
+    __glDispatchDestroyTable(base);
+
+    return total / t->iterations;
+}
+
+static void print_help(void)
+{
+    const char *help_string =
+        "Options: \n"
+        " -h, --help              Print this help message.\n"
+        " -i, --iterations=<N>    Build N tables with each method.\n";
+    printf("%s", help_string);
+}
+
+static void init_options(int argc, char **argv, TestOptions *t)
+{
+    int c;
+
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "iterations", required_argument, NULL, 'i' },
+        { NULL, no_argument, NULL, 0 }
+    };
+
+    // Initialize defaults
+    t->iterations = 100;
+
+    do {
+        c = getopt_long(argc, argv, "hi:", long_options, NULL);
+        switch (c) {
+        case -1:
+        default:
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+            break;
+        case 'i':
+            t->iterations = atoi(optarg);
+            if (t->iterations <= 0) {
+                printError("Invalid iteration count %d\n", t->iterations);
+                exit(1);
+            }
+            break;
+        }
+    } while (c != -1);
+}
+
+int main(int argc, char **argv)
+{
+    TestOptions t;
+    __GLdispatchTable *dispatch;
+    void (*pBegin)(GLenum);
+    uint64_t callbackTime, staticTime, overlayTime;
+    GLint offset;
+    int i;
+
+    init_options(argc, argv, &t);
+
+    glvndSetupPthreads(RTLD_DEFAULT, &pImp);
+    __glDispatchInit(&pImp);
+
+    pBegin = (void (*)(GLenum))__glDispatchGetProcAddress("glBegin");
+    if (!pBegin) {
+        printError("Failed to get a stub for glBegin!\n");
+        return 1;
+    }
+
+    /*
+     * Build one table to find out which functions GLdispatch looks up, and
+     * use that to set up the name list for the getProcAddress callback and
+     * the prebuilt table for the getStaticDispatch callback.
+     */
+    dispatch = __glDispatchCreateTable(RecordProcAddress,
+                                       BenchGetDispatchProto,
+                                       BenchDestroyVendorData,
+                                       NULL);
+    if (!dispatch || !BuildTable(dispatch, pBegin)) {
+        printError("Failed to build the initial dispatch table!\n");
+        return 1;
+    }
+    if (!CheckTableStats(dispatch)) {
+        return 1;
+    }
+    __glDispatchDestroyTable(dispatch);
+
+    qsort(procNames, numProcNames, sizeof(char *), CompareNames);
+
+    for (i = 0; i < numProcNames; i++) {
+        offset = __glDispatchGetOffset(procNames[i]);
+        if (offset >= numStaticProcs) {
+            numStaticProcs = offset + 1;
+        }
+    }
+    staticProcs = calloc(numStaticProcs, sizeof(__GLdispatchProc));
+    if (!staticProcs) {
+        printError("Out of memory!\n");
+        return 1;
+    }
+    for (i = 0; i < numProcNames; i++) {
+        offset = __glDispatchGetOffset(procNames[i]);
+        if (offset >= 0) {
+            staticProcs[offset] = LookupProc(procNames[i]);
+        }
+    }
+
+    callbackTime = TimeTables(&t, BenchGetProcAddress, NULL, pBegin);
+    staticTime = TimeTables(&t, BenchGetProcAddress, BenchGetStaticDispatch,
+                            pBegin);
+    overlayTime = TimeOverlays(&t, pBegin);
+    if (!callbackTime || !staticTime || !overlayTime) {
+        return 1;
+    }
+
+    printf("%d functions, %d tables\n", numProcNames, t.iterations);
+    printf("getProcAddress:    %.1f us per table\n", callbackTime / 1000.0);
+    printf("getStaticDispatch: %.1f us per table\n", staticTime / 1000.0);
+    printf("speedup: %.1fx\n", (double)callbackTime / (double)staticTime);
+    printf("overlay:           %.1f us per table\n", overlayTime / 1000.0);
+
+    return 0;
+}
@@ -0,0 +1,8 @@
+#!/bin/bash
+
+# Compare the cost of building a dispatch table from a vendor's prebuilt
+# table against looking up each function by name.
+./testgldispatchstartup -i 100 || exit 1
+
+# Tables built with lazy dispatch only look up the functions that are called.
+__GL_LAZY_DISPATCH=1 ./testgldispatchstartup -i 100
@@ -0,0 +1,240 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include <GL/gl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <getopt.h>
+#include <dlfcn.h>
+#include <time.h>
+#include <stdint.h>
+
+#include "GLdispatch.h"
+#include "glvnd_pthread.h"
+
+#define printError(...) fprintf(stderr, __VA_ARGS__)
+
+/*
+ * Measures how many times per second a vendor can switch between two
+ * dispatch tables while its context is current, using
+ * __glDispatchSwapTable() and using a full __glDispatchMakeCurrent().
+ *
+ * This also checks that switching tables with __glDispatchMakeCurrent() by
+ * changing the API state's dispatch table, which is what libGLX's
+ * makeGLDispatchCurrent export does, keeps the reference counts right, and
+ * that __glDispatchSetEntries() updates a table that's already current.
+ */
+
+typedef struct TestOptionsRec {
+    int iterations;
+} TestOptions;
+
+static GLVNDPthreadFuncs pImp;
+
+static int beginCount[2];
+
+static void benchBegin0(GLenum mode)
+{
+    beginCount[0]++;
+}
+
+static void benchBegin1(GLenum mode)
+{
+    beginCount[1]++;
+}
+
+static void *BenchGetProcAddress(const GLubyte *procName, void *vendorData)
+{
+    if (!strcmp((const char *)procName, "glBegin")) {
+        return benchBegin0;
+    }
+    return NULL;
+}
+
+static GLboolean BenchGetDispatchProto(const GLubyte *procName,
+                                       char ***function_names,
+                                       char **parameter_signature)
+{
+    return GL_FALSE;
+}
+
+static void BenchDestroyVendorData(void *vendorData)
+{
+}
+
+static uint64_t GetTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static void print_help(void)
+{
+    const char *help_string =
+        "Options: \n"
+        " -h, --help              Print this help message.\n"
+        " -i, --iterations=<N>    Switch tables N times with each method.\n";
+    printf("%s", help_string);
+}
+
+static void init_options(int argc, char **argv, TestOptions *t)
+{
+    int c;
+
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h' },
+        { "iterations", required_argument, NULL, 'i' },
+        { NULL, no_argument, NULL, 0 }
+    };
+
+    // Initialize defaults
+    t->iterations = 1000000;
+
+    do {
+        c = getopt_long(argc, argv, "hi:", long_options, NULL);
+        switch (c) {
+        case -1:
+        default:
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+            break;
+        case 'i':
+            t->iterations = atoi(optarg);
+            if (t->iterations <= 0) {
+                printError("Invalid iteration count %d\n", t->iterations);
+                exit(1);
+            }
+            break;
+        }
+    } while (c != -1);
+}
+
+int main(int argc, char **argv)
+{
+    TestOptions t;
+    __GLdispatchTable *tables[2];
+    __GLdispatchAPIState apiState;
+    void (*pBegin)(GLenum);
+    GLint offset;
+    __GLdispatchProc proc = (__GLdispatchProc)benchBegin1;
+    uint64_t start, swapTime, makeCurrentTime;
+    int i;
+
+    init_options(argc, argv, &t);
+
+    glvndSetupPthreads(RTLD_DEFAULT, &pImp);
+    __glDispatchInit(&pImp);
+
+    pBegin = (void (*)(GLenum))__glDispatchGetProcAddress("glBegin");
+    offset = __glDispatchGetOffset("glBegin");
+    if (!pBegin || (offset < 0)) {
+        printError("Failed to get a stub for glBegin!\n");
+        return 1;
+    }
+
+    // The second table only differs from the first one in glBegin.
+    tables[0] = __glDispatchCreateTable(BenchGetProcAddress,
+                                        BenchGetDispatchProto,
+                                        BenchDestroyVendorData,
+                                        NULL);
+    if (!tables[0] || !__glDispatchValidateTable(tables[0])) {
+        printError("Failed to create a dispatch table!\n");
+        return 1;
+    }
+    tables[1] = __glDispatchCreateOverlayTable(tables[0], &offset, &proc, 1);
+    if (!tables[1] || !__glDispatchValidateTable(tables[1])) {
+        printError("Failed to create an overlay table!\n");
+        return 1;
+    }
+
+    memset(&apiState, 0, sizeof(apiState));
+    apiState.tag = GLDISPATCH_API_GLX;
+    apiState.dispatch = tables[0];
+    apiState.context = &apiState;
+    __glDispatchMakeCurrent(&apiState);
+
+    start = GetTime();
+    for (i = 0; i < t.iterations; i++) {
+        __glDispatchSwapTable(tables[i & 1]);
+        pBegin(GL_TRIANGLES);
+    }
+    swapTime = GetTime() - start;
+
+    if ((beginCount[0] != (t.iterations + 1) / 2) ||
+        (beginCount[1] != t.iterations / 2)) {
+        printError("glBegin dispatched to the wrong table after a swap!\n");
+        return 1;
+    }
+
+    beginCount[0] = beginCount[1] = 0;
+    start = GetTime();
+    for (i = 0; i < t.iterations; i++) {
+        apiState.dispatch = tables[i & 1];
+        __glDispatchMakeCurrent(&apiState);
+        pBegin(GL_TRIANGLES);
+    }
+    makeCurrentTime = GetTime() - start;
+
+    if ((beginCount[0] != (t.iterations + 1) / 2) ||
+        (beginCount[1] != t.iterations / 2)) {
+        printError("glBegin dispatched to the wrong table after a make "
+                   "current!\n");
+        return 1;
+    }
+
+    // Replace glBegin in the current table, and make sure that it takes
+    // effect without another make current.
+    __glDispatchSwapTable(tables[0]);
+    __glDispatchSetEntries(tables[0], &offset, &proc, 1);
+    beginCount[0] = beginCount[1] = 0;
+    pBegin(GL_TRIANGLES);
+    if ((beginCount[0] != 0) || (beginCount[1] != 1)) {
+        printError("glBegin was not updated by __glDispatchSetEntries!\n");
+        return 1;
+    }
+
+    __glDispatchLoseCurrent();
+
+    // Both tables should be safe to destroy now.
+    __glDispatchDestroyTable(tables[1]);
+    __glDispatchDestroyTable(tables[0]);
+
+    printf("swap:         %.0f switches/sec\n",
+           t.iterations * 1e9 / (double)(swapTime ? swapTime : 1));
+    printf("make current: %.0f switches/sec\n",
+           t.iterations * 1e9 / (double)(makeCurrentTime ? makeCurrentTime : 1));
+
+    return 0;
+}
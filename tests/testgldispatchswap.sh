@@ -0,0 +1,5 @@
+#!/bin/bash
+
+# Compare switching between two validated dispatch tables with a swap against
+# a full make current.
+./testgldispatchswap -i 1000000
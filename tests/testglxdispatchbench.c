@@ -0,0 +1,354 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include <X11/Xlib.h>
+#include <GL/glx.h>
+#include <GL/gl.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <errno.h>
+
+#include "test_utils.h"
+#include "glvnd_pthread.h"
+
+// For glMakeCurrentTestResults()
+#include "GLX_dummy/GLX_dummy.h"
+
+/*
+ * Measures the cost of a GL call through libglvnd, using GLX_dummy as the
+ * vendor library. Each case is run with one thread and then with several
+ * threads, and the results are printed one per line as whitespace-separated
+ * key=value pairs, so that runs from before and after a dispatch change can
+ * be compared with a script.
+ *
+ * The cases are:
+ *  - static:  glBegin() through libOpenGL's exported static stub.
+ *  - dynamic: glMakeCurrentTestResults() through a dynamic stub from
+ *             glXGetProcAddress().
+ *  - noop:    glBegin() with no context current, which goes to the no-op
+ *             table.
+ *  - aux:     glBegin() through an auxiliary vendor dispatch table.
+ *
+ * On x86, each result also includes the average number of TSC cycles per
+ * call. The shell script runs the benchmark again with
+ * __GL_DIRECT_TLS_STUBS=0, so that the static and dynamic cases can be
+ * compared between the two kinds of x86-64 dispatch stubs.
+ */
+
+enum {
+    BENCH_STATIC,
+    BENCH_DYNAMIC,
+    BENCH_NOOP,
+    BENCH_AUX,
+    BENCH_COUNT
+};
+
+static const char *benchNames[BENCH_COUNT] = {
+    "static",
+    "dynamic",
+    "noop",
+    "aux"
+};
+
+typedef struct TestOptionsRec {
+    int iterations;
+    int threads;
+} TestOptions;
+
+typedef struct BenchThreadArgsRec {
+    const TestOptions *t;
+    int bench;
+
+    // Time in nanoseconds spent in the timed loop
+    uint64_t elapsed;
+
+    // TSC cycles spent in the timed loop, or 0 if there's no TSC
+    uint64_t ticks;
+} BenchThreadArgs;
+
+static GLVNDPthreadFuncs pImp;
+
+static void print_help(void)
+{
+    const char *help_string =
+        "Options: \n"
+        " -h, --help              Print this help message.\n"
+        " -i<N>, --iterations=<N> Make N calls in each thread for each case.\n"
+        " -t<N>, --threads=<N>    Run each case with 1 thread and with N\n"
+        "                         threads.\n";
+    printf("%s", help_string);
+}
+
+static void init_options(int argc, char **argv, TestOptions *t)
+{
+    int c;
+
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h'},
+        { "iterations", required_argument, NULL, 'i'},
+        { "threads", required_argument, NULL, 't'},
+        { NULL, no_argument, NULL, 0 }
+    };
+
+    // Initialize defaults
+    t->iterations = 10000000;
+    t->threads = 4;
+
+    do {
+        c = getopt_long(argc, argv, "hi:t:", long_options, NULL);
+        switch (c) {
+        case -1:
+        default:
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+            break;
+        case 'i':
+            t->iterations = atoi(optarg);
+            if (t->iterations < 1) {
+                printError("1 or more iterations required!\n");
+                print_help();
+                exit(1);
+            }
+            break;
+        case 't':
+            t->threads = atoi(optarg);
+            if (t->threads < 1) {
+                printError("1 or more threads required!\n");
+                print_help();
+                exit(1);
+            }
+            break;
+        }
+    } while (c != -1);
+}
+
+static inline uint64_t GetTicks(void)
+{
+#if defined(__i386__) || defined(__x86_64__)
+    return __builtin_ia32_rdtsc();
+#else
+    return 0;
+#endif
+}
+
+static void *BenchThread(void *arg)
+{
+    BenchThreadArgs *args = (BenchThreadArgs *)arg;
+    const TestOptions *t = args->t;
+    PFNGLMAKECURRENTTESTRESULTSPROC pMakeCurrentTestResults;
+    struct window_info wi;
+    GLXContext ctx = NULL;
+    Display *dpy;
+    GLboolean saw = GL_FALSE;
+    void *result = NULL;
+    intptr_t ret = GL_FALSE;
+    uint64_t start, startTicks;
+    int i;
+
+    memset(&wi, 0, sizeof(wi));
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        printError("No display! Please re-test with a running X server\n"
+                   "and the DISPLAY environment variable set appropriately.\n");
+        return (void *)ret;
+    }
+
+    pMakeCurrentTestResults = (PFNGLMAKECURRENTTESTRESULTSPROC)
+        glXGetProcAddress((GLubyte *)"glMakeCurrentTestResults");
+    if (!pMakeCurrentTestResults) {
+        printError("Failed to get glMakeCurrentTestResults() function!\n");
+        goto fail;
+    }
+
+    if (!testUtilsCreateWindow(dpy, &wi, 0)) {
+        printError("Failed to create window!\n");
+        goto fail;
+    }
+
+    ctx = glXCreateContext(dpy, wi.visinfo, NULL, GL_TRUE);
+    if (!ctx) {
+        printError("Failed to create a context!\n");
+        goto fail;
+    }
+
+    if (args->bench != BENCH_NOOP) {
+        if (!glXMakeContextCurrent(dpy, wi.win, wi.win, ctx)) {
+            printError("Failed to make current!\n");
+            goto fail;
+        }
+    }
+
+    if (args->bench == BENCH_AUX) {
+        pMakeCurrentTestResults(GL_MC_AUX_DISPATCH, &saw, &result);
+        if (!saw || !result) {
+            printError("Failed to make an auxiliary dispatch table current!\n");
+            goto fail;
+        }
+    }
+
+    switch (args->bench) {
+    case BENCH_STATIC:
+    case BENCH_NOOP:
+    case BENCH_AUX:
+        start = testUtilsGetTime();
+        startTicks = GetTicks();
+        for (i = 0; i < t->iterations; i++) {
+            glBegin(GL_TRIANGLES);
+        }
+        args->ticks = GetTicks() - startTicks;
+        args->elapsed = testUtilsGetTime() - start;
+        break;
+    case BENCH_DYNAMIC:
+        start = testUtilsGetTime();
+        startTicks = GetTicks();
+        for (i = 0; i < t->iterations; i++) {
+            pMakeCurrentTestResults(GL_MC_LAST_REQ, &saw, &result);
+        }
+        args->ticks = GetTicks() - startTicks;
+        args->elapsed = testUtilsGetTime() - start;
+        break;
+    }
+
+    if (args->bench != BENCH_NOOP) {
+        if (!glXMakeContextCurrent(dpy, None, None, NULL)) {
+            printError("Failed to lose current!\n");
+            goto fail;
+        }
+    }
+
+    ret = GL_TRUE;
+
+fail:
+    if (ctx) {
+        glXDestroyContext(dpy, ctx);
+    }
+    testUtilsDestroyWindow(dpy, &wi);
+    XCloseDisplay(dpy);
+
+    return (void *)ret;
+}
+
+/*
+ * Runs one case with the given number of threads, and prints the result.
+ */
+static int RunBench(const TestOptions *t, int bench, int numThreads)
+{
+    BenchThreadArgs *args;
+    glvnd_thread_t *threads;
+    double nsPerCall = 0.0;
+    double cyclesPerCall = 0.0;
+    double callsPerSec = 0.0;
+    void *ret;
+    int failed = 0;
+    int i;
+
+    args = calloc(numThreads, sizeof(BenchThreadArgs));
+    threads = malloc(numThreads * sizeof(glvnd_thread_t));
+    if (!args || !threads) {
+        printError("Out of memory!\n");
+        exit(1);
+    }
+
+    for (i = 0; i < numThreads; i++) {
+        args[i].t = t;
+        args[i].bench = bench;
+        if (pImp.create(&threads[i], NULL, BenchThread, (void *)&args[i])
+            != 0) {
+            printError("Error in pthread_create(): %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+
+    for (i = 0; i < numThreads; i++) {
+        if (pImp.join(threads[i], &ret) != 0) {
+            printError("Error in pthread_join(): %s\n", strerror(errno));
+            exit(1);
+        }
+        if (!ret) {
+            failed = 1;
+        }
+    }
+
+    if (!failed) {
+        for (i = 0; i < numThreads; i++) {
+            uint64_t elapsed = args[i].elapsed ? args[i].elapsed : 1;
+
+            nsPerCall += (double)elapsed / t->iterations;
+            cyclesPerCall += (double)args[i].ticks / t->iterations;
+            callsPerSec += t->iterations * 1e9 / (double)elapsed;
+        }
+        nsPerCall /= numThreads;
+        cyclesPerCall /= numThreads;
+
+        printf("bench=%s threads=%d iterations=%d ns_per_call=%.3f ",
+               benchNames[bench], numThreads, t->iterations, nsPerCall);
+        if (cyclesPerCall > 0.0) {
+            printf("cycles_per_call=%.1f ", cyclesPerCall);
+        } else {
+            printf("cycles_per_call=- ");
+        }
+        printf("calls_per_sec=%.0f\n", callsPerSec);
+    }
+
+    free(args);
+    free(threads);
+
+    return !failed;
+}
+
+int main(int argc, char **argv)
+{
+    TestOptions t;
+    int bench;
+
+    init_options(argc, argv, &t);
+
+    XInitThreads();
+
+    if (!glvndSetupPthreads(RTLD_DEFAULT, &pImp)) {
+        exit(1);
+    }
+
+    for (bench = 0; bench < BENCH_COUNT; bench++) {
+        if (!RunBench(&t, bench, 1)) {
+            return 1;
+        }
+        if ((t.threads > 1) && !RunBench(&t, bench, t.threads)) {
+            return 1;
+        }
+    }
+
+    return 0;
+}
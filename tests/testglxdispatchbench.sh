@@ -0,0 +1,21 @@
+#!/bin/bash
+
+export __GLX_VENDOR_LIBRARY_NAME=dummy
+export LD_LIBRARY_PATH=$LD_LIBRARY_PATH:$TOP_BUILDDIR/tests/GLX_dummy/.libs
+
+# We require pthreads be loaded before libGLX for correctness
+export LD_PRELOAD="${LD_PRELOAD:+$LD_PRELOAD }libpthread.so.0 $FAKE_X_PRELOAD"
+
+# Measure the cost of a GL call through each kind of dispatch stub and table,
+# with one thread and with several threads.
+./testglxdispatchbench -t 4 -i 1000000 || exit 1
+
+# Run it again with the x86-64 dispatch stubs which load the whole TLS offset
+# of the current table from an immediate, instead of using a direct
+# %fs-relative load. Other architectures ignore this.
+__GL_DIRECT_TLS_STUBS=0 ./testglxdispatchbench -t 4 -i 1000000 || exit 1
+
+# Run it again with GLX_dummy's glBegin() busy-waiting for 50ns, to compare
+# the dispatch overhead with some vendor work.
+__GLX_DUMMY_LATENCY=glBegin=50 __GLX_DUMMY_STATS=1 \
+    ./testglxdispatchbench -t 4 -i 100000 || exit 1
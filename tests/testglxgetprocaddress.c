@@ -54,6 +54,8 @@
     }                                                           \
 } while (0)
 
+#define NUM_MANY_BOGUS_FUNCS 1000
+
 PROC_DEFINES(void *, glXGetProcAddress, (GLubyte *procName));
 PROC_DEFINES(void, glXWaitGL, (void));
 PROC_DEFINES(void, glVertex3fv, (GLfloat *v));
@@ -66,6 +68,8 @@ PROC_DEFINES(void, OogaBooga, (int a, int b, int c));
 int main(int argc, char **argv)
 {
     int retval = 0;
+    void *lastProc = NULL;
+    int i;
     /*
      * Try GetProcAddress on different classes of API functions, and bogus
      * functions. The API library should return entry point addresses for
@@ -105,14 +109,42 @@ int main(int argc, char **argv)
     /*
      * These are bogus functions, but will get a valid entry point since they
      * are prefixed with "gl". The first GetProcAddress() will early out since
-     * there should be a cached copy from the explicit call made above, but
-     * the second one will go through glapi's dynamic stub generation path.
+     * there should be a cached copy from the explicit call made above. No
+     * vendor recognizes the others, so rather than generating a dynamic stub
+     * for each one, libGLdispatch hands out the same no-op for all of them.
      *
      * Again, calling these functions should be a no-op.
      */
     CHECK_PROC(glBogusFunc1, (0, 0, 0));
     CHECK_PROC(glBogusFunc2, (1, 1, 1));
 
+    if ((void *)p_glBogusFunc2 !=
+        (void *)glXGetProcAddress((GLubyte *)"glBogusFunc3")) {
+        printf("Unrecognized functions didn't share a no-op!\n");
+        goto fail;
+    }
+
+    /*
+     * Generate enough dynamic stubs to fill several pages of executable
+     * memory, and more than the 256 that libGLdispatch used to be limited to.
+     * libGLX_dummy recognizes these names, so each one should get its own
+     * entry point, and calling it should still be a no-op.
+     */
+    printf("checking %d more dummy functions\n", NUM_MANY_BOGUS_FUNCS);
+    for (i = 0; i < NUM_MANY_BOGUS_FUNCS; i++) {
+        char name[32];
+
+        snprintf(name, sizeof(name), "glDummyExtensionFunc%d", i);
+        p_glBogusFunc1 = (PTR_glBogusFunc1)
+            glXGetProcAddress((GLubyte *)name);
+        if (!p_glBogusFunc1 || (void *)p_glBogusFunc1 == lastProc) {
+            printf("failed to get %s!\n", name);
+            goto fail;
+        }
+        (*p_glBogusFunc1)(i, i, i);
+        lastProc = (void *)p_glBogusFunc1;
+    }
+
     /*
      * This will return NULL since OogaBooga is not prefixed with "gl".
      */
@@ -0,0 +1,492 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include <X11/Xlib.h>
+#include <GL/glx.h>
+#include <GL/gl.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "test_utils.h"
+#include "glvnd_pthread.h"
+
+/*
+ * Measures the latency of glXGetProcAddress() for each of the ways that it
+ * can find a function:
+ *
+ *  - cache:   a function exported by libGLX, found in libGLX's own hash.
+ *  - vendor:  a GLX extension function, with a dispatch function from
+ *             __glXGetGLXDispatchAddress(). GLX_dummy provides a dispatcher
+ *             for any name starting with "glXExampleExtensionFunction".
+ *  - static:  a core GL function with a static stub in libGLdispatch.
+ *  - dynamic: an unknown GL function, which asks each vendor for its
+ *             prototype. No vendor recognizes it, so it gets libGLdispatch's
+ *             shared no-op rather than a dynamic stub.
+ *
+ * The cold latency is the first lookup of each name, which takes that path.
+ * Every later lookup of the same name is a hit in libGLX's cache, except for
+ * the dynamic path, which libGLX doesn't cache, and which hits libGLdispatch's
+ * negative cache instead. The warm latency is the time to look up the same
+ * set of names again.
+ *
+ * Before measuring, the test makes a context current on each of the -t
+ * threads, which then wait until the test is finished, and looks up -n
+ * extra extension functions that no vendor recognizes. The results are printed one
+ * per line as whitespace-separated key=value pairs.
+ */
+
+/*
+ * libGLdispatch has a fixed number of dynamic dispatch slots, so the extra
+ * extension functions and the dynamic samples have to fit in that.
+ */
+#define MAX_DYNAMIC_FUNCS 4000
+
+enum {
+    PATH_CACHE,
+    PATH_VENDOR,
+    PATH_STATIC,
+    PATH_DYNAMIC,
+    PATH_COUNT
+};
+
+static const char *pathNames[PATH_COUNT] = {
+    "cache",
+    "vendor",
+    "static",
+    "dynamic"
+};
+
+static const char *cacheFuncs[] = {
+    "glXChooseVisual", "glXCopyContext", "glXCreateContext",
+    "glXCreateGLXPixmap", "glXDestroyContext", "glXDestroyGLXPixmap",
+    "glXGetConfig", "glXGetCurrentContext", "glXGetCurrentDrawable",
+    "glXIsDirect", "glXMakeCurrent", "glXQueryExtension",
+    "glXQueryVersion", "glXSwapBuffers", "glXUseXFont", "glXWaitGL",
+    "glXWaitX", "glXGetClientString", "glXQueryServerString",
+    "glXQueryExtensionsString", "glXChooseFBConfig", "glXCreateNewContext",
+    "glXCreatePbuffer", "glXCreatePixmap", "glXCreateWindow",
+    "glXDestroyPbuffer", "glXDestroyPixmap", "glXDestroyWindow",
+    "glXGetFBConfigAttrib", "glXGetFBConfigs", "glXGetSelectedEvent",
+    "glXGetVisualFromFBConfig", "glXMakeContextCurrent",
+    "glXQueryContext", "glXQueryDrawable", "glXSelectEvent",
+    "glXGetCurrentReadDrawable", "glXGetCurrentDisplay",
+};
+
+static const char *staticFuncs[] = {
+    "glAccum", "glAlphaFunc", "glBitmap", "glBlendFunc", "glCallList",
+    "glCallLists", "glClear", "glClearAccum", "glClearColor",
+    "glClearDepth", "glClearIndex", "glClearStencil", "glClipPlane",
+    "glColor3f", "glColor4f", "glColorMask", "glColorMaterial",
+    "glCopyPixels", "glCullFace", "glDeleteLists", "glDepthFunc",
+    "glDepthMask", "glDepthRange", "glDisable", "glDrawBuffer",
+    "glDrawPixels", "glEdgeFlag", "glEnable", "glEndList", "glEvalCoord1f",
+    "glFeedbackBuffer", "glFinish", "glFlush", "glFogf", "glFrontFace",
+    "glFrustum", "glGenLists", "glGetBooleanv", "glGetError",
+    "glGetFloatv", "glGetIntegerv", "glGetString", "glHint", "glIndexf",
+    "glInitNames", "glIsEnabled", "glIsList", "glLightf", "glLineStipple",
+    "glLineWidth", "glListBase", "glLoadIdentity", "glLoadMatrixf",
+    "glLoadName", "glLogicOp", "glMaterialf", "glMatrixMode",
+    "glMultMatrixf", "glNewList", "glNormal3f", "glOrtho", "glPassThrough",
+    "glPixelStoref", "glPointSize", "glPolygonMode", "glPopAttrib",
+    "glPopMatrix", "glPushAttrib", "glPushMatrix", "glRasterPos2f",
+    "glReadBuffer", "glReadPixels", "glRectf", "glRenderMode", "glRotatef",
+    "glScalef", "glScissor", "glSelectBuffer", "glShadeModel",
+    "glStencilFunc", "glStencilMask", "glStencilOp", "glTexCoord2f",
+    "glTexEnvf", "glTexGenf", "glTexImage2D", "glTexParameterf",
+    "glTranslatef", "glVertex2f", "glViewport",
+};
+
+#define ARRAY_LEN(_arr) (sizeof(_arr) / sizeof(_arr[0]))
+
+typedef struct TestOptionsRec {
+    int registered;
+    int samples;
+    int rounds;
+    int threads;
+} TestOptions;
+
+typedef struct CurrentThreadArgsRec {
+    // Set once this thread has made its context current, or failed to.
+    volatile int ready;
+    int failed;
+} CurrentThreadArgs;
+
+static GLVNDPthreadFuncs pImp;
+
+/*
+ * Held by the main thread while it measures. The current threads block on it
+ * so that their contexts stay current.
+ */
+static glvnd_mutex_t parkMutex = GLVND_MUTEX_INITIALIZER;
+
+static void print_help(void)
+{
+    const char *help_string =
+        "Options: \n"
+        " -h, --help              Print this help message.\n"
+        " -n<N>, --registered=<N> Register N extension functions with\n"
+        "                         dynamic stubs before measuring.\n"
+        " -s<N>, --samples=<N>    Measure N names for the vendor and\n"
+        "                         dynamic paths.\n"
+        " -r<N>, --rounds=<N>     Look up each name N more times to\n"
+        "                         measure the warm latency.\n"
+        " -t<N>, --threads=<N>    Keep a context current on N other\n"
+        "                         threads while measuring.\n";
+    printf("%s", help_string);
+}
+
+static int ParseCount(const char *arg, int min, const char *what)
+{
+    int value = atoi(arg);
+
+    if (value < min) {
+        printError("%d or more %s required!\n", min, what);
+        print_help();
+        exit(1);
+    }
+    return value;
+}
+
+static void init_options(int argc, char **argv, TestOptions *t)
+{
+    int c;
+
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h'},
+        { "registered", required_argument, NULL, 'n'},
+        { "samples", required_argument, NULL, 's'},
+        { "rounds", required_argument, NULL, 'r'},
+        { "threads", required_argument, NULL, 't'},
+        { NULL, no_argument, NULL, 0 }
+    };
+
+    // Initialize defaults
+    t->registered = 0;
+    t->samples = 32;
+    t->rounds = 10000;
+    t->threads = 0;
+
+    do {
+        c = getopt_long(argc, argv, "hn:s:r:t:", long_options, NULL);
+        switch (c) {
+        case -1:
+        default:
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+            break;
+        case 'n':
+            t->registered = ParseCount(optarg, 0, "registered functions");
+            break;
+        case 's':
+            t->samples = ParseCount(optarg, 1, "samples");
+            break;
+        case 'r':
+            t->rounds = ParseCount(optarg, 1, "rounds");
+            break;
+        case 't':
+            t->threads = ParseCount(optarg, 0, "threads");
+            break;
+        }
+    } while (c != -1);
+
+    if (t->registered + t->samples > MAX_DYNAMIC_FUNCS) {
+        printError("At most %d registered functions and samples are "
+                   "supported!\n", MAX_DYNAMIC_FUNCS);
+        exit(1);
+    }
+}
+
+static void *CurrentThread(void *arg)
+{
+    CurrentThreadArgs *args = (CurrentThreadArgs *)arg;
+    struct window_info wi;
+    GLXContext ctx = NULL;
+    Display *dpy;
+    intptr_t ret = GL_FALSE;
+
+    memset(&wi, 0, sizeof(wi));
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        printError("No display! Please re-test with a running X server\n"
+                   "and the DISPLAY environment variable set appropriately.\n");
+        args->failed = 1;
+        args->ready = 1;
+        return (void *)ret;
+    }
+
+    if (!testUtilsCreateWindow(dpy, &wi, 0)) {
+        printError("Failed to create window!\n");
+        goto fail;
+    }
+
+    ctx = glXCreateContext(dpy, wi.visinfo, NULL, GL_TRUE);
+    if (!ctx) {
+        printError("Failed to create a context!\n");
+        goto fail;
+    }
+
+    if (!glXMakeContextCurrent(dpy, wi.win, wi.win, ctx)) {
+        printError("Failed to make current!\n");
+        goto fail;
+    }
+
+    // Wait for the main thread to finish measuring.
+    args->ready = 1;
+    pImp.mutex_lock(&parkMutex);
+    pImp.mutex_unlock(&parkMutex);
+
+    if (!glXMakeContextCurrent(dpy, None, None, NULL)) {
+        printError("Failed to lose current!\n");
+        goto fail;
+    }
+
+    ret = GL_TRUE;
+
+fail:
+    if (!ret) {
+        args->failed = 1;
+        args->ready = 1;
+    }
+    if (ctx) {
+        glXDestroyContext(dpy, ctx);
+    }
+    testUtilsDestroyWindow(dpy, &wi);
+    XCloseDisplay(dpy);
+
+    return (void *)ret;
+}
+
+static int CompareTimes(const void *a, const void *b)
+{
+    uint64_t ta = *(const uint64_t *)a;
+    uint64_t tb = *(const uint64_t *)b;
+
+    return (ta > tb) - (ta < tb);
+}
+
+/*
+ * Looks up each name once to measure the cold latency, and then rounds more
+ * times to measure the warm latency, and prints the results.
+ */
+static int MeasurePath(const TestOptions *t, int path,
+                       const char **names, int count)
+{
+    uint64_t *times;
+    uint64_t start, total = 0;
+    double warm;
+    int i, j;
+
+    times = malloc(count * sizeof(uint64_t));
+    if (!times) {
+        printError("Out of memory!\n");
+        exit(1);
+    }
+
+    for (i = 0; i < count; i++) {
+        start = testUtilsGetTime();
+        if (!glXGetProcAddress((const GLubyte *)names[i])) {
+            printError("Failed to look up %s!\n", names[i]);
+            free(times);
+            return 0;
+        }
+        times[i] = testUtilsGetTime() - start;
+        total += times[i];
+    }
+
+    start = testUtilsGetTime();
+    for (j = 0; j < t->rounds; j++) {
+        for (i = 0; i < count; i++) {
+            glXGetProcAddress((const GLubyte *)names[i]);
+        }
+    }
+    warm = (double)(testUtilsGetTime() - start) /
+        ((double)t->rounds * count);
+
+    qsort(times, count, sizeof(uint64_t), CompareTimes);
+
+    printf("path=%s registered=%d threads=%d names=%d cold_mean_ns=%.0f "
+           "cold_p50_ns=%llu cold_max_ns=%llu warm_ns=%.1f\n",
+           pathNames[path], t->registered, t->threads, count,
+           (double)total / count, (unsigned long long)times[count / 2],
+           (unsigned long long)times[count - 1], warm);
+
+    free(times);
+    return 1;
+}
+
+static char **MakeNames(const char *format, int count)
+{
+    char **names = malloc(count * sizeof(char *));
+    int i;
+
+    if (!names) {
+        printError("Out of memory!\n");
+        exit(1);
+    }
+
+    for (i = 0; i < count; i++) {
+        names[i] = malloc(64);
+        if (!names[i]) {
+            printError("Out of memory!\n");
+            exit(1);
+        }
+        snprintf(names[i], 64, format, i);
+    }
+
+    return names;
+}
+
+static void FreeNames(char **names, int count)
+{
+    int i;
+
+    for (i = 0; i < count; i++) {
+        free(names[i]);
+    }
+    free(names);
+}
+
+int main(int argc, char **argv)
+{
+    TestOptions t;
+    CurrentThreadArgs *args = NULL;
+    glvnd_thread_t *threads = NULL;
+    struct window_info wi;
+    Display *dpy;
+    char **vendorNames, **dynamicNames, **registeredNames;
+    void *ret;
+    int failed = 0;
+    int i;
+
+    init_options(argc, argv, &t);
+
+    XInitThreads();
+
+    if (!glvndSetupPthreads(RTLD_DEFAULT, &pImp)) {
+        exit(1);
+    }
+
+    memset(&wi, 0, sizeof(wi));
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        printError("No display! Please re-test with a running X server\n"
+                   "and the DISPLAY environment variable set appropriately.\n");
+        exit(1);
+    }
+
+    /*
+     * The vendor path only looks at vendors which are already loaded, so
+     * load one before measuring anything. This doesn't call
+     * glXGetProcAddress(), so the cache is still cold.
+     */
+    if (!testUtilsCreateWindow(dpy, &wi, 0)) {
+        printError("Failed to create window!\n");
+        exit(1);
+    }
+
+    pImp.mutex_lock(&parkMutex);
+    if (t.threads > 0) {
+        args = calloc(t.threads, sizeof(CurrentThreadArgs));
+        threads = malloc(t.threads * sizeof(glvnd_thread_t));
+        if (!args || !threads) {
+            printError("Out of memory!\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < t.threads; i++) {
+        if (pImp.create(&threads[i], NULL, CurrentThread, (void *)&args[i])
+            != 0) {
+            printError("Error in pthread_create(): %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    for (i = 0; i < t.threads; i++) {
+        while (!args[i].ready) {
+            usleep(1000);
+        }
+        failed |= args[i].failed;
+    }
+
+    vendorNames = MakeNames("glXExampleExtensionFunction%dGPABENCH",
+                            t.samples);
+    dynamicNames = MakeNames("glGPABenchDynamic%dEXT", t.samples);
+    registeredNames = MakeNames("glGPABenchRegistered%dEXT", t.registered);
+
+    if (!failed) {
+        // The first lookup also sets up libGLX's cache.
+        failed = !MeasurePath(&t, PATH_CACHE, cacheFuncs,
+                              ARRAY_LEN(cacheFuncs));
+    }
+
+    for (i = 0; !failed && i < t.registered; i++) {
+        if (!glXGetProcAddress((const GLubyte *)registeredNames[i])) {
+            printError("Failed to look up %s!\n", registeredNames[i]);
+            failed = 1;
+        }
+    }
+
+    if (!failed) {
+        failed = !MeasurePath(&t, PATH_VENDOR,
+                              (const char **)vendorNames, t.samples) ||
+            !MeasurePath(&t, PATH_STATIC, staticFuncs,
+                         ARRAY_LEN(staticFuncs)) ||
+            !MeasurePath(&t, PATH_DYNAMIC,
+                         (const char **)dynamicNames, t.samples);
+    }
+
+    pImp.mutex_unlock(&parkMutex);
+    for (i = 0; i < t.threads; i++) {
+        if (pImp.join(threads[i], &ret) != 0) {
+            printError("Error in pthread_join(): %s\n", strerror(errno));
+            exit(1);
+        }
+        if (!ret) {
+            failed = 1;
+        }
+    }
+
+    FreeNames(vendorNames, t.samples);
+    FreeNames(dynamicNames, t.samples);
+    FreeNames(registeredNames, t.registered);
+    free(args);
+    free(threads);
+    testUtilsDestroyWindow(dpy, &wi);
+    XCloseDisplay(dpy);
+
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,15 @@
+#!/bin/bash
+
+export __GLX_VENDOR_LIBRARY_NAME=dummy
+export LD_LIBRARY_PATH=$LD_LIBRARY_PATH:$TOP_BUILDDIR/tests/GLX_dummy/.libs
+
+# We require pthreads be loaded before libGLX for correctness
+export LD_PRELOAD="${LD_PRELOAD:+$LD_PRELOAD }libpthread.so.0 $FAKE_X_PRELOAD"
+
+# Measure the cold and warm latency of each glXGetProcAddress path. Each run
+# is a new process, since a name only takes the cold path once.
+for threads in 0 4; do
+    for registered in 0 192 2000; do
+        ./testglxgpabench -t $threads -n $registered -s 32 -r 1000 || exit 1
+    done
+done
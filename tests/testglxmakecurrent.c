@@ -46,12 +46,50 @@
 // For glMakeCurrentTestResults()
 #include "GLX_dummy/GLX_dummy.h"
 
+/*
+ * The make current patterns for --benchmark.
+ */
+enum {
+    // Make one context current and then lose current, over and over.
+    BENCH_SAME,
+
+    // Switch between K contexts on the same window without losing current.
+    BENCH_ROUND_ROBIN,
+
+    // Switch between a context on screen 0 and a context on screen 1, which
+    // must belong to different vendor libraries.
+    BENCH_VENDORS,
+
+    BENCH_COUNT
+};
+
+static const char *benchPatternNames[BENCH_COUNT] = {
+    "same",
+    "roundrobin",
+    "vendors"
+};
+
 typedef struct TestOptionsRec {
     int iterations;
     int threads;
     GLboolean late;
+    GLboolean benchmark;
+    int pattern;
+    int contexts;
+    GLboolean useMakeCurrent;
 } TestOptions;
 
+typedef struct MakeCurrentThreadArgsRec {
+    const TestOptions *t;
+
+    // Time in nanoseconds spent in the make current loop, for --benchmark
+    uint64_t elapsed;
+
+    // The time in nanoseconds of each make current call, for --benchmark
+    uint64_t *latencies;
+    int numLatencies;
+} MakeCurrentThreadArgs;
+
 static void print_help(void)
 {
     const char *help_string =
@@ -59,7 +97,15 @@ static void print_help(void)
         " -h, --help              Print this help message.\n"
         " -i<N>, --iterations=<N> Run N make current iterations in each thread \n"
         " -t<N>, --threads=<N>    Run with N threads.\n"
-        " -l, --late              Call GetProcAddress() after MakeCurrent()\n";
+        " -l, --late              Call GetProcAddress() after MakeCurrent()\n"
+        " -b, --benchmark         Only time the make current calls, and report\n"
+        "                         the make current throughput of each thread\n"
+        "                         and the latency percentiles.\n"
+        " -p<P>, --pattern=<P>    Make current pattern for --benchmark: \"same\"\n"
+        "                         (the default), \"roundrobin\", or \"vendors\".\n"
+        " -k<K>, --contexts=<K>   Number of contexts for the roundrobin pattern.\n"
+        " -g, --glxmakecurrent    Use glXMakeCurrent() instead of\n"
+        "                         glXMakeContextCurrent() for --benchmark.\n";
     printf("%s", help_string);
 }
 
@@ -72,6 +118,10 @@ void init_options(int argc, char **argv, TestOptions *t)
         { "iterations", required_argument, NULL, 'i'},
         { "threads", required_argument, NULL, 't'},
         { "late", no_argument, NULL, 'l' },
+        { "benchmark", no_argument, NULL, 'b' },
+        { "pattern", required_argument, NULL, 'p' },
+        { "contexts", required_argument, NULL, 'k' },
+        { "glxmakecurrent", no_argument, NULL, 'g' },
         { NULL, no_argument, NULL, 0 }
     };
 
@@ -79,9 +129,13 @@ void init_options(int argc, char **argv, TestOptions *t)
     t->iterations = 1;
     t->threads = 1;
     t->late = GL_FALSE;
+    t->benchmark = GL_FALSE;
+    t->pattern = BENCH_SAME;
+    t->contexts = 4;
+    t->useMakeCurrent = GL_FALSE;
 
     do {
-        c = getopt_long(argc, argv, "hi:t:l", long_options, NULL);
+        c = getopt_long(argc, argv, "hi:t:lbp:k:g", long_options, NULL);
         switch (c) {
         case -1:
         default:
@@ -109,6 +163,32 @@ void init_options(int argc, char **argv, TestOptions *t)
         case 'l':
             t->late = GL_TRUE;
             break;
+        case 'b':
+            t->benchmark = GL_TRUE;
+            break;
+        case 'p':
+            for (t->pattern = 0; t->pattern < BENCH_COUNT; t->pattern++) {
+                if (!strcmp(optarg, benchPatternNames[t->pattern])) {
+                    break;
+                }
+            }
+            if (t->pattern == BENCH_COUNT) {
+                printError("Unknown pattern \"%s\"!\n", optarg);
+                print_help();
+                exit(1);
+            }
+            break;
+        case 'k':
+            t->contexts = atoi(optarg);
+            if (t->contexts < 1) {
+                printError("1 or more contexts required!\n");
+                print_help();
+                exit(1);
+            }
+            break;
+        case 'g':
+            t->useMakeCurrent = GL_TRUE;
+            break;
         }
     } while (c != -1);
 
@@ -128,6 +208,172 @@ static PFNGLMAKECURRENTTESTRESULTSPROC GetMakeCurrentTestResults(void)
     return proc;
 }
 
+/*
+ * Makes a context current with glXMakeContextCurrent() or glXMakeCurrent(),
+ * and records how long it took.
+ */
+static Bool TimedMakeCurrent(const TestOptions *t, Display *dpy,
+                             GLXDrawable draw, GLXContext ctx,
+                             uint64_t *latency)
+{
+    uint64_t start = testUtilsGetTime();
+    Bool ret;
+
+    if (t->useMakeCurrent) {
+        ret = glXMakeCurrent(dpy, draw, ctx);
+    } else {
+        ret = glXMakeContextCurrent(dpy, draw, draw, ctx);
+    }
+    *latency = testUtilsGetTime() - start;
+
+    return ret;
+}
+
+/*
+ * Returns the name of the vendor that owns a context.
+ */
+static char *GetContextVendor(Display *dpy, struct window_info *wi,
+                              GLXContext ctx)
+{
+    PFNGLMAKECURRENTTESTRESULTSPROC pMakeCurrentTestResults =
+        GetMakeCurrentTestResults();
+    GLboolean saw = GL_FALSE;
+    void *ret = NULL;
+
+    if (!pMakeCurrentTestResults ||
+        !glXMakeContextCurrent(dpy, wi->win, wi->win, ctx)) {
+        return NULL;
+    }
+    pMakeCurrentTestResults(GL_MC_VENDOR_STRING, &saw, &ret);
+    glXMakeContextCurrent(dpy, None, None, NULL);
+
+    return saw ? (char *)ret : NULL;
+}
+
+/*
+ * The make current loop for --benchmark. This times each make current call
+ * for the selected pattern.
+ */
+static intptr_t BenchmarkThread(Display *dpy, MakeCurrentThreadArgs *args)
+{
+    const TestOptions *t = args->t;
+    struct window_info wi[2];
+    GLXContext *ctxs = NULL;
+    int numWindows = 1;
+    int numContexts = 1;
+    char *vendors[2] = { NULL, NULL };
+    uint64_t *latencies;
+    uint64_t start;
+    intptr_t ret = GL_FALSE;
+    int i, n;
+
+    memset(wi, 0, sizeof(wi));
+
+    if (t->pattern == BENCH_ROUND_ROBIN) {
+        numContexts = t->contexts;
+    } else if (t->pattern == BENCH_VENDORS) {
+        if (ScreenCount(dpy) < 2) {
+            printError("The vendors pattern requires an X server with two "
+                       "screens!\n");
+            return GL_FALSE;
+        }
+        numWindows = numContexts = 2;
+    }
+
+    // The same pattern does a make current and a lose current for each
+    // iteration.
+    args->numLatencies = t->iterations *
+        (t->pattern == BENCH_SAME ? 2 : 1);
+    args->latencies = malloc(args->numLatencies * sizeof(uint64_t));
+    ctxs = calloc(numContexts, sizeof(GLXContext));
+    if (!args->latencies || !ctxs) {
+        printError("Out of memory!\n");
+        goto fail;
+    }
+    latencies = args->latencies;
+
+    for (i = 0; i < numWindows; i++) {
+        if (!testUtilsCreateWindow(dpy, &wi[i], i)) {
+            printError("Failed to create window!\n");
+            goto fail;
+        }
+    }
+    for (i = 0; i < numContexts; i++) {
+        ctxs[i] = glXCreateContext(dpy, wi[i % numWindows].visinfo, NULL,
+                                   GL_TRUE);
+        if (!ctxs[i]) {
+            printError("Failed to create a context!\n");
+            goto fail;
+        }
+    }
+
+    if (t->pattern == BENCH_VENDORS) {
+        // Make sure that we're really switching between vendors.
+        for (i = 0; i < 2; i++) {
+            vendors[i] = GetContextVendor(dpy, &wi[i], ctxs[i]);
+            if (!vendors[i]) {
+                printError("Failed to get the vendor for screen %d!\n", i);
+                goto fail;
+            }
+        }
+        if (!strcmp(vendors[0], vendors[1])) {
+            printError("Both screens use vendor \"%s\"!\n", vendors[0]);
+            goto fail;
+        }
+    }
+
+    start = testUtilsGetTime();
+    switch (t->pattern) {
+    case BENCH_SAME:
+        for (i = 0, n = 0; i < t->iterations; i++) {
+            if (!TimedMakeCurrent(t, dpy, wi[0].win, ctxs[0],
+                                  &latencies[n++])) {
+                printError("Failed to make current!\n");
+                goto fail;
+            }
+            if (!TimedMakeCurrent(t, dpy, None, NULL, &latencies[n++])) {
+                printError("Failed to lose current!\n");
+                goto fail;
+            }
+        }
+        break;
+    case BENCH_ROUND_ROBIN:
+    case BENCH_VENDORS:
+        for (i = 0; i < t->iterations; i++) {
+            if (!TimedMakeCurrent(t, dpy, wi[i % numWindows].win,
+                                  ctxs[i % numContexts], &latencies[i])) {
+                printError("Failed to make current!\n");
+                goto fail;
+            }
+        }
+        if (!glXMakeContextCurrent(dpy, None, None, NULL)) {
+            printError("Failed to lose current!\n");
+            goto fail;
+        }
+        break;
+    }
+    args->elapsed = testUtilsGetTime() - start;
+
+    ret = GL_TRUE;
+
+fail:
+    if (ctxs) {
+        for (i = 0; i < numContexts; i++) {
+            if (ctxs[i]) {
+                glXDestroyContext(dpy, ctxs[i]);
+            }
+        }
+        free(ctxs);
+    }
+    for (i = 0; i < numWindows; i++) {
+        testUtilsDestroyWindow(dpy, &wi[i]);
+    }
+    free(vendors[0]);
+    free(vendors[1]);
+
+    return ret;
+}
+
 void *MakeCurrentThread(void *arg)
 {
     struct window_info wi;
@@ -145,7 +391,8 @@ void *MakeCurrentThread(void *arg)
     GLint *vendorCounts;
     int i;
     intptr_t ret = GL_FALSE;
-    const TestOptions *t = (const TestOptions *)arg;
+    MakeCurrentThreadArgs *args = (MakeCurrentThreadArgs *)arg;
+    const TestOptions *t = args->t;
     Display *dpy;
 
     dpy = XOpenDisplay(NULL);
@@ -157,6 +404,10 @@ void *MakeCurrentThread(void *arg)
 
     memset(&wi, 0, sizeof(wi));
 
+    if (t->benchmark) {
+        return (void *)BenchmarkThread(dpy, args);
+    }
+
     // Test the robustness of GetProcAddress() by calling this separately for
     // each thread.
     if (!t->late) {
@@ -276,6 +527,59 @@ fail:
 
 GLVNDPthreadFuncs pImp;
 
+static int CompareLatencies(const void *a, const void *b)
+{
+    uint64_t la = *(const uint64_t *)a;
+    uint64_t lb = *(const uint64_t *)b;
+
+    return (la > lb) - (la < lb);
+}
+
+static void PrintBenchmarkResults(const TestOptions *t,
+                                  const MakeCurrentThreadArgs *args)
+{
+    const double calls = args[0].numLatencies;
+    double rate, total = 0.0;
+    uint64_t *latencies;
+    int count = 0;
+    int i;
+
+    for (i = 0; i < t->threads; i++) {
+        rate = calls * 1e9 / (double)(args[i].elapsed ? args[i].elapsed : 1);
+        printf("thread %d: %.0f make current calls/sec\n", i, rate);
+        total += rate;
+    }
+
+    printf("%d threads: %.0f make current calls/sec total, "
+           "%.0f calls/sec per thread\n",
+           t->threads, total, total / t->threads);
+
+    // Compute the latency percentiles across every thread's calls.
+    latencies = malloc(t->threads * args[0].numLatencies * sizeof(uint64_t));
+    if (!latencies) {
+        return;
+    }
+    for (i = 0; i < t->threads; i++) {
+        memcpy(&latencies[count], args[i].latencies,
+               args[i].numLatencies * sizeof(uint64_t));
+        count += args[i].numLatencies;
+    }
+    qsort(latencies, count, sizeof(uint64_t), CompareLatencies);
+
+    printf("pattern=%s threads=%d contexts=%d calls=%d ops_per_sec=%.0f "
+           "p50_ns=%llu p99_ns=%llu p999_ns=%llu max_ns=%llu\n",
+           benchPatternNames[t->pattern], t->threads,
+           t->pattern == BENCH_ROUND_ROBIN ? t->contexts :
+           (t->pattern == BENCH_VENDORS ? 2 : 1),
+           count, total,
+           (unsigned long long)latencies[(uint64_t)(count - 1) * 50 / 100],
+           (unsigned long long)latencies[(uint64_t)(count - 1) * 99 / 100],
+           (unsigned long long)latencies[(uint64_t)(count - 1) * 999 / 1000],
+           (unsigned long long)latencies[count - 1]);
+
+    free(latencies);
+}
+
 int main(int argc, char **argv)
 {
     /*
@@ -283,13 +587,26 @@ int main(int argc, char **argv)
      * while the context is current.
      */
     TestOptions t;
+    MakeCurrentThreadArgs *args;
     int i;
     void *ret;
 
     init_options(argc, argv, &t);
 
+    args = calloc(t.threads, sizeof(MakeCurrentThreadArgs));
+    if (!args) {
+        printError("Out of memory!\n");
+        exit(1);
+    }
+    for (i = 0; i < t.threads; i++) {
+        args[i].t = &t;
+    }
+
     if (t.threads == 1) {
-        ret = MakeCurrentThread((void *)&t);
+        ret = MakeCurrentThread((void *)&args[0]);
+        if (ret && t.benchmark) {
+            PrintBenchmarkResults(&t, args);
+        }
         return ret ? 0 : 1;
     } else {
         glvnd_thread_t *threads = malloc(t.threads * sizeof(glvnd_thread_t));
@@ -302,7 +619,8 @@ int main(int argc, char **argv)
         }
 
         for (i = 0; i < t.threads; i++) {
-            if (pImp.create(&threads[i], NULL, MakeCurrentThread, (void *)&t)
+            if (pImp.create(&threads[i], NULL, MakeCurrentThread,
+                            (void *)&args[i])
                 != 0) {
                 printError("Error in pthread_create(): %s\n", strerror(errno));
                 exit(1);
@@ -318,6 +636,10 @@ int main(int argc, char **argv)
                 all_ret = 1;
             }
         }
+
+        if (!all_ret && t.benchmark) {
+            PrintBenchmarkResults(&t, args);
+        }
         return all_ret;
     }
 }
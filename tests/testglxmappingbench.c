@@ -0,0 +1,559 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#include <X11/Xlib.h>
+#include <GL/glx.h>
+#include <GL/gl.h>
+#include <dlfcn.h>
+#include <stdio.h>
+#include <string.h>
+#include <getopt.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <unistd.h>
+
+#include "test_utils.h"
+#include "glvnd_pthread.h"
+
+/*
+ * Measures how libGLX's object-to-screen mappings scale with the number of
+ * objects in them, and with other threads using them at the same time.
+ *
+ * libGLX keeps a hash for each kind of object, each behind a single rwlock:
+ *
+ *  - fbconfig: GLXFBConfig to screen. glXGetFBConfigs() inserts, and
+ *              glXGetFBConfigAttrib() looks up. libGLX never removes these.
+ *  - context:  GLXContext to screen. glXCreateNewContext() inserts,
+ *              glXQueryContext() looks up, and glXDestroyContext() removes.
+ *  - drawable: XID to screen. glXCreatePixmap() inserts, glXQueryDrawable()
+ *              looks up, and glXDestroyPixmap() removes.
+ *
+ * Every one of those calls also looks up the vendor for the screen, so the
+ * Display+screen to vendor hash is part of every number.
+ *
+ * GLX_dummy makes up FBConfigs, contexts and GLX drawables without talking to
+ * the server, so the tables can be filled to any size. The number of
+ * FBConfigs on each screen comes from __GLX_DUMMY_FBCONFIGS.
+ *
+ * While the main thread measures, each of the -t worker threads loops over
+ * glXMakeCurrent(), glXSwapBuffers() and losing current on its own window.
+ * Making current looks up the context and adds the drawables, and swapping
+ * looks up the drawable, so the workers contend for the same locks.
+ *
+ * Lookups and removals are done in a shuffled order, so that they don't
+ * follow the order the objects were created in. The results are printed one
+ * per line as whitespace-separated key=value pairs, with times in
+ * nanoseconds per object. worker_iters is the number of iterations that the
+ * workers finished while that table was measured, and worker_iter_ns is the
+ * mean time for one of them.
+ */
+
+typedef struct TestOptionsRec {
+    int drawables;
+    int contexts;
+    int rounds;
+    int threads;
+} TestOptions;
+
+typedef struct WorkerArgsRec {
+    // Set once this thread has made its context current, or failed to.
+    volatile int ready;
+    int failed;
+    volatile unsigned long iterations;
+} WorkerArgs;
+
+typedef struct PhaseTimesRec {
+    double insert;
+    double lookup;
+    double remove;
+} PhaseTimes;
+
+static GLVNDPthreadFuncs pImp;
+
+static volatile int stopWorkers;
+static WorkerArgs *workerArgs;
+
+static void print_help(void)
+{
+    const char *help_string =
+        "Options: \n"
+        " -h, --help              Print this help message.\n"
+        " -d<N>, --drawables=<N>  Create N GLX pixmaps.\n"
+        " -c<N>, --contexts=<N>   Create N contexts.\n"
+        " -r<N>, --rounds=<N>     Look up each object N times.\n"
+        " -t<N>, --threads=<N>    Make current and swap on N other\n"
+        "                         threads while measuring.\n";
+    printf("%s", help_string);
+}
+
+static int ParseCount(const char *arg, int min, const char *what)
+{
+    int value = atoi(arg);
+
+    if (value < min) {
+        printError("%d or more %s required!\n", min, what);
+        print_help();
+        exit(1);
+    }
+    return value;
+}
+
+static void init_options(int argc, char **argv, TestOptions *t)
+{
+    int c;
+
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h'},
+        { "drawables", required_argument, NULL, 'd'},
+        { "contexts", required_argument, NULL, 'c'},
+        { "rounds", required_argument, NULL, 'r'},
+        { "threads", required_argument, NULL, 't'},
+        { NULL, no_argument, NULL, 0 }
+    };
+
+    // Initialize defaults
+    t->drawables = 10000;
+    t->contexts = 1000;
+    t->rounds = 10;
+    t->threads = 0;
+
+    do {
+        c = getopt_long(argc, argv, "hd:c:r:t:", long_options, NULL);
+        switch (c) {
+        case -1:
+        default:
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+            break;
+        case 'd':
+            t->drawables = ParseCount(optarg, 1, "drawables");
+            break;
+        case 'c':
+            t->contexts = ParseCount(optarg, 1, "contexts");
+            break;
+        case 'r':
+            t->rounds = ParseCount(optarg, 1, "rounds");
+            break;
+        case 't':
+            t->threads = ParseCount(optarg, 0, "threads");
+            break;
+        }
+    } while (c != -1);
+}
+
+static void *WorkerThread(void *arg)
+{
+    WorkerArgs *args = (WorkerArgs *)arg;
+    struct window_info wi;
+    GLXContext ctx = NULL;
+    Display *dpy;
+    intptr_t ret = GL_FALSE;
+
+    memset(&wi, 0, sizeof(wi));
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        printError("No display! Please re-test with a running X server\n"
+                   "and the DISPLAY environment variable set appropriately.\n");
+        args->failed = 1;
+        args->ready = 1;
+        return (void *)ret;
+    }
+
+    if (!testUtilsCreateWindow(dpy, &wi, 0)) {
+        printError("Failed to create window!\n");
+        goto fail;
+    }
+
+    ctx = glXCreateContext(dpy, wi.visinfo, NULL, GL_TRUE);
+    if (!ctx) {
+        printError("Failed to create a context!\n");
+        goto fail;
+    }
+
+    args->ready = 1;
+    while (!stopWorkers) {
+        if (!glXMakeCurrent(dpy, wi.win, ctx)) {
+            printError("Failed to make current!\n");
+            goto fail;
+        }
+        glXSwapBuffers(dpy, wi.win);
+        if (!glXMakeCurrent(dpy, None, NULL)) {
+            printError("Failed to lose current!\n");
+            goto fail;
+        }
+        args->iterations++;
+    }
+
+    ret = GL_TRUE;
+
+fail:
+    if (!ret) {
+        args->failed = 1;
+        args->ready = 1;
+    }
+    if (ctx) {
+        glXDestroyContext(dpy, ctx);
+    }
+    testUtilsDestroyWindow(dpy, &wi);
+    XCloseDisplay(dpy);
+
+    return (void *)ret;
+}
+
+static unsigned long WorkerIterations(const TestOptions *t)
+{
+    unsigned long total = 0;
+    int i;
+
+    for (i = 0; i < t->threads; i++) {
+        total += workerArgs[i].iterations;
+    }
+    return total;
+}
+
+/*
+ * Returns a random permutation of [0, count). This uses its own generator so
+ * that every run shuffles the same way.
+ */
+static int *ShuffledOrder(int count)
+{
+    int *order = malloc(count * sizeof(int));
+    unsigned int seed = 1;
+    int i;
+
+    if (!order) {
+        printError("Out of memory!\n");
+        exit(1);
+    }
+
+    for (i = 0; i < count; i++) {
+        order[i] = i;
+    }
+    for (i = count - 1; i > 0; i--) {
+        int j, tmp;
+
+        seed = seed * 1103515245 + 12345;
+        j = (seed >> 8) % (i + 1);
+        tmp = order[i];
+        order[i] = order[j];
+        order[j] = tmp;
+    }
+
+    return order;
+}
+
+static double PerObject(uint64_t elapsed, long count)
+{
+    return count > 0 ? (double)elapsed / count : 0.0;
+}
+
+static void PrintPhase(const TestOptions *t, const char *table, int entries,
+                       const PhaseTimes *times, uint64_t elapsed,
+                       unsigned long iterations)
+{
+    printf("table=%s entries=%d threads=%d insert_ns=%.1f lookup_ns=%.1f ",
+           table, entries, t->threads, times->insert, times->lookup);
+    if (times->remove >= 0.0) {
+        printf("delete_ns=%.1f ", times->remove);
+    } else {
+        printf("delete_ns=- ");
+    }
+    if (iterations > 0) {
+        printf("worker_iters=%lu worker_iter_ns=%.1f\n", iterations,
+               PerObject(elapsed * t->threads, iterations));
+    } else {
+        printf("worker_iters=0 worker_iter_ns=-\n");
+    }
+}
+
+/*
+ * Gets the FBConfigs for every screen, which adds them all to libGLX's
+ * FBConfig hash, and then looks each one up t->rounds times.
+ */
+static GLXFBConfig *MeasureFBConfigs(const TestOptions *t, Display *dpy,
+                                     int *count)
+{
+    GLXFBConfig *configs = NULL;
+    PhaseTimes times;
+    uint64_t start, phaseStart;
+    unsigned long iterations;
+    int screen, total = 0;
+    int *order;
+    int i, j, value;
+
+    iterations = WorkerIterations(t);
+    phaseStart = testUtilsGetTime();
+
+    start = testUtilsGetTime();
+    for (screen = 0; screen < ScreenCount(dpy); screen++) {
+        GLXFBConfig *screenConfigs;
+        int num = 0;
+
+        screenConfigs = glXGetFBConfigs(dpy, screen, &num);
+        if (!screenConfigs || num <= 0) {
+            printError("No FBConfigs on screen %d! Set "
+                       "__GLX_DUMMY_FBCONFIGS.\n", screen);
+            free(configs);
+            return NULL;
+        }
+
+        configs = realloc(configs, (total + num) * sizeof(GLXFBConfig));
+        if (!configs) {
+            printError("Out of memory!\n");
+            exit(1);
+        }
+        memcpy(&configs[total], screenConfigs, num * sizeof(GLXFBConfig));
+        total += num;
+        XFree(screenConfigs);
+    }
+    times.insert = PerObject(testUtilsGetTime() - start, total);
+
+    order = ShuffledOrder(total);
+    start = testUtilsGetTime();
+    for (j = 0; j < t->rounds; j++) {
+        for (i = 0; i < total; i++) {
+            glXGetFBConfigAttrib(dpy, configs[order[i]], GLX_FBCONFIG_ID,
+                                 &value);
+        }
+    }
+    times.lookup = PerObject(testUtilsGetTime() - start,
+                             (long)total * t->rounds);
+    times.remove = -1.0;
+    free(order);
+
+    PrintPhase(t, "fbconfig", total, &times,
+               testUtilsGetTime() - phaseStart,
+               WorkerIterations(t) - iterations);
+
+    *count = total;
+    return configs;
+}
+
+static int MeasureContexts(const TestOptions *t, Display *dpy,
+                           const GLXFBConfig *configs, int numConfigs)
+{
+    GLXContext *contexts;
+    PhaseTimes times;
+    uint64_t start, phaseStart;
+    unsigned long iterations;
+    int *order;
+    int i, j, value;
+
+    contexts = malloc(t->contexts * sizeof(GLXContext));
+    if (!contexts) {
+        printError("Out of memory!\n");
+        exit(1);
+    }
+
+    iterations = WorkerIterations(t);
+    phaseStart = testUtilsGetTime();
+
+    start = testUtilsGetTime();
+    for (i = 0; i < t->contexts; i++) {
+        contexts[i] = glXCreateNewContext(dpy, configs[i % numConfigs],
+                                          GLX_RGBA_TYPE, NULL, True);
+        if (!contexts[i]) {
+            printError("Failed to create context %d!\n", i);
+            while (--i >= 0) {
+                glXDestroyContext(dpy, contexts[i]);
+            }
+            free(contexts);
+            return 0;
+        }
+    }
+    times.insert = PerObject(testUtilsGetTime() - start, t->contexts);
+
+    order = ShuffledOrder(t->contexts);
+    start = testUtilsGetTime();
+    for (j = 0; j < t->rounds; j++) {
+        for (i = 0; i < t->contexts; i++) {
+            glXQueryContext(dpy, contexts[order[i]], GLX_FBCONFIG_ID, &value);
+        }
+    }
+    times.lookup = PerObject(testUtilsGetTime() - start,
+                             (long)t->contexts * t->rounds);
+
+    start = testUtilsGetTime();
+    for (i = 0; i < t->contexts; i++) {
+        glXDestroyContext(dpy, contexts[order[i]]);
+    }
+    times.remove = PerObject(testUtilsGetTime() - start, t->contexts);
+    free(order);
+
+    PrintPhase(t, "context", t->contexts, &times,
+               testUtilsGetTime() - phaseStart,
+               WorkerIterations(t) - iterations);
+
+    free(contexts);
+    return 1;
+}
+
+static int MeasureDrawables(const TestOptions *t, Display *dpy,
+                            const GLXFBConfig *configs, int numConfigs)
+{
+    GLXPixmap *pixmaps;
+    PhaseTimes times;
+    uint64_t start, phaseStart;
+    unsigned long iterations;
+    unsigned int value;
+    int *order;
+    int i, j;
+
+    pixmaps = malloc(t->drawables * sizeof(GLXPixmap));
+    if (!pixmaps) {
+        printError("Out of memory!\n");
+        exit(1);
+    }
+
+    iterations = WorkerIterations(t);
+    phaseStart = testUtilsGetTime();
+
+    /*
+     * GLX_dummy doesn't look at the X pixmap, so this doesn't need to
+     * create any on the server.
+     */
+    start = testUtilsGetTime();
+    for (i = 0; i < t->drawables; i++) {
+        pixmaps[i] = glXCreatePixmap(dpy, configs[i % numConfigs],
+                                     DefaultRootWindow(dpy), NULL);
+        if (pixmaps[i] == None) {
+            printError("Failed to create GLX pixmap %d!\n", i);
+            while (--i >= 0) {
+                glXDestroyPixmap(dpy, pixmaps[i]);
+            }
+            free(pixmaps);
+            return 0;
+        }
+    }
+    times.insert = PerObject(testUtilsGetTime() - start, t->drawables);
+
+    order = ShuffledOrder(t->drawables);
+    start = testUtilsGetTime();
+    for (j = 0; j < t->rounds; j++) {
+        for (i = 0; i < t->drawables; i++) {
+            glXQueryDrawable(dpy, pixmaps[order[i]], GLX_WIDTH, &value);
+        }
+    }
+    times.lookup = PerObject(testUtilsGetTime() - start,
+                             (long)t->drawables * t->rounds);
+
+    start = testUtilsGetTime();
+    for (i = 0; i < t->drawables; i++) {
+        glXDestroyPixmap(dpy, pixmaps[order[i]]);
+    }
+    times.remove = PerObject(testUtilsGetTime() - start, t->drawables);
+    free(order);
+
+    PrintPhase(t, "drawable", t->drawables, &times,
+               testUtilsGetTime() - phaseStart,
+               WorkerIterations(t) - iterations);
+
+    free(pixmaps);
+    return 1;
+}
+
+int main(int argc, char **argv)
+{
+    TestOptions t;
+    glvnd_thread_t *threads = NULL;
+    GLXFBConfig *configs;
+    Display *dpy;
+    void *ret;
+    int numConfigs = 0;
+    int failed = 0;
+    int i;
+
+    init_options(argc, argv, &t);
+
+    XInitThreads();
+
+    if (!glvndSetupPthreads(RTLD_DEFAULT, &pImp)) {
+        exit(1);
+    }
+
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        printError("No display! Please re-test with a running X server\n"
+                   "and the DISPLAY environment variable set appropriately.\n");
+        exit(1);
+    }
+
+    if (t.threads > 0) {
+        workerArgs = calloc(t.threads, sizeof(WorkerArgs));
+        threads = malloc(t.threads * sizeof(glvnd_thread_t));
+        if (!workerArgs || !threads) {
+            printError("Out of memory!\n");
+            exit(1);
+        }
+    }
+    for (i = 0; i < t.threads; i++) {
+        if (pImp.create(&threads[i], NULL, WorkerThread,
+                        (void *)&workerArgs[i]) != 0) {
+            printError("Error in pthread_create(): %s\n", strerror(errno));
+            exit(1);
+        }
+    }
+    for (i = 0; i < t.threads; i++) {
+        while (!workerArgs[i].ready) {
+            usleep(1000);
+        }
+        failed |= workerArgs[i].failed;
+    }
+
+    if (!failed) {
+        configs = MeasureFBConfigs(&t, dpy, &numConfigs);
+        if (configs) {
+            failed = !MeasureContexts(&t, dpy, configs, numConfigs) ||
+                !MeasureDrawables(&t, dpy, configs, numConfigs);
+            free(configs);
+        } else {
+            failed = 1;
+        }
+    }
+
+    stopWorkers = 1;
+    for (i = 0; i < t.threads; i++) {
+        if (pImp.join(threads[i], &ret) != 0) {
+            printError("Error in pthread_join(): %s\n", strerror(errno));
+            exit(1);
+        }
+        if (!ret) {
+            failed = 1;
+        }
+    }
+
+    free(workerArgs);
+    free(threads);
+    XCloseDisplay(dpy);
+
+    return failed ? 1 : 0;
+}
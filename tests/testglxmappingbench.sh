@@ -0,0 +1,19 @@
+#!/bin/bash
+
+export __GLX_VENDOR_LIBRARY_NAME=dummy
+export __GLX_DUMMY_FBCONFIGS=1000
+export LD_LIBRARY_PATH=$LD_LIBRARY_PATH:$TOP_BUILDDIR/tests/GLX_dummy/.libs
+
+# We require pthreads be loaded before libGLX for correctness
+export LD_PRELOAD="${LD_PRELOAD:+$LD_PRELOAD }libpthread.so.0 $FAKE_X_PRELOAD"
+
+# Fill libGLX's object to screen hashes to increasing sizes, with and without
+# other threads making current and swapping at the same time.
+for THREADS in 0 4; do
+    for DRAWABLES in 1000 10000 100000; do
+        ./testglxmappingbench -t $THREADS -d $DRAWABLES -c 1000 -r 4 || exit 1
+    done
+done
+
+# Print the lock contention for the largest run.
+__GL_LOCK_STATS=1 ./testglxmappingbench -t 4 -d 100000 -c 1000 -r 4 || exit 1
@@ -2,6 +2,7 @@
 
 export __GLX_VENDOR_LIBRARY_NAME=dummy
 export LD_LIBRARY_PATH=$LD_LIBRARY_PATH:$TOP_BUILDDIR/tests/GLX_dummy/.libs
+export LD_PRELOAD="${LD_PRELOAD:+$LD_PRELOAD }$FAKE_X_PRELOAD"
 
 # Run the make current test exactly once.
 ./testglxmakecurrent -t 1 -i 1
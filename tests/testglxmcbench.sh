@@ -0,0 +1,33 @@
+#!/bin/bash
+
+export __GLX_VENDOR_LIBRARY_NAME=dummy
+export LD_LIBRARY_PATH=$LD_LIBRARY_PATH:$TOP_BUILDDIR/tests/GLX_dummy/.libs
+
+# We require pthreads be loaded before libGLX for correctness
+export LD_PRELOAD="${LD_PRELOAD:+$LD_PRELOAD }libpthread.so.0 $FAKE_X_PRELOAD"
+
+# Measure make current throughput and latency with an increasing number of
+# threads, to check that make current scales when threads share a dispatch
+# table.
+for THREADS in 1 2 4 8 16 32; do
+    ./testglxmakecurrent -b -t $THREADS -i 20000 || exit 1
+done
+
+# Switch between several contexts from the same vendor, with both
+# glXMakeContextCurrent() and glXMakeCurrent().
+for THREADS in 1 8; do
+    ./testglxmakecurrent -b -p roundrobin -k 4 -t $THREADS -i 20000 || exit 1
+    ./testglxmakecurrent -b -p roundrobin -k 4 -t $THREADS -i 20000 -g || exit 1
+done
+
+if [ -n "$SKIP_ENV_INIT" ] && [ -z "$FAKE_X_PRELOAD" ]; then
+    echo "Skipping the cross-vendor benchmark; requires environment init"
+    exit 0
+fi
+
+# Switch between the two screens, which use the dummy_0 and dummy_1 vendors,
+# so that every make current also loses current on the old vendor.
+unset __GLX_VENDOR_LIBRARY_NAME
+for THREADS in 1 8; do
+    ./testglxmakecurrent -b -p vendors -t $THREADS -i 20000 || exit 1
+done
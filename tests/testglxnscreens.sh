@@ -1,8 +1,9 @@
 #!/bin/bash
 
 export LD_LIBRARY_PATH=$LD_LIBRARY_PATH:$TOP_BUILDDIR/tests/GLX_dummy/.libs
+export LD_PRELOAD="${LD_PRELOAD:+$LD_PRELOAD }$FAKE_X_PRELOAD"
 
-if [ -n "$SKIP_ENV_INIT" ]; then
+if [ -n "$SKIP_ENV_INIT" ] && [ -z "$FAKE_X_PRELOAD" ]; then
     echo "Skipping test; requires environment init"
     exit 77
 fi
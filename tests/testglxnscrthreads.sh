@@ -3,9 +3,9 @@
 export LD_LIBRARY_PATH=$LD_LIBRARY_PATH:$TOP_BUILDDIR/tests/GLX_dummy/.libs
 
 # We require pthreads be loaded before libGLX for correctness
-export LD_PRELOAD=libpthread.so.0
+export LD_PRELOAD="${LD_PRELOAD:+$LD_PRELOAD }libpthread.so.0 $FAKE_X_PRELOAD"
 
-if [ -n "$SKIP_ENV_INIT" ]; then
+if [ -n "$SKIP_ENV_INIT" ] && [ -z "$FAKE_X_PRELOAD" ]; then
     echo "Skipping test; requires environment init"
     exit 77
 fi
@@ -0,0 +1,444 @@
+/*
+ * Copyright (c) 2013, NVIDIA CORPORATION.
+ *
+ * Permission is hereby granted, free of charge, to any person obtaining a
+ * copy of this software and/or associated documentation files (the
+ * "Materials"), to deal in the Materials without restriction, including
+ * without limitation the rights to use, copy, modify, merge, publish,
+ * distribute, sublicense, and/or sell copies of the Materials, and to
+ * permit persons to whom the Materials are furnished to do so, subject to
+ * the following conditions:
+ *
+ * The above copyright notice and this permission notice shall be included
+ * unaltered in all copies or substantial portions of the Materials.
+ * Any additions, deletions, or changes to the original source files
+ * must be clearly indicated in accompanying documentation.
+ *
+ * If only executable code is distributed, then the accompanying
+ * documentation must state that "this software is based in part on the
+ * work of the Khronos Group."
+ *
+ * THE MATERIALS ARE PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND,
+ * EXPRESS OR IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF
+ * MERCHANTABILITY, FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT.
+ * IN NO EVENT SHALL THE AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY
+ * CLAIM, DAMAGES OR OTHER LIABILITY, WHETHER IN AN ACTION OF CONTRACT,
+ * TORT OR OTHERWISE, ARISING FROM, OUT OF OR IN CONNECTION WITH THE
+ * MATERIALS OR THE USE OR OTHER DEALINGS IN THE MATERIALS.
+ */
+
+#define _GNU_SOURCE 1
+
+#include <X11/Xlib.h>
+#include <GL/glx.h>
+#include <dlfcn.h>
+#include <link.h>
+#include <elf.h>
+#include <stdio.h>
+#include <string.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <limits.h>
+#include <getopt.h>
+#include <time.h>
+
+#define printError(...) fprintf(stderr, __VA_ARGS__)
+
+/*
+ * Measures how long it takes to get from dlopen()ing libGL to the first
+ * successful make current, which dominates the cost of a short-lived GL
+ * process. Each step is timed separately, and the results are printed one
+ * per line as whitespace-separated key=value pairs.
+ *
+ * This doesn't link against any of the libglvnd libraries, so that loading
+ * them is part of what's measured. Run it with __GLX_STARTUP_STATS=1 to have
+ * libGLX break down its own part of the work: the __glXInit constructor,
+ * glvndSetupPthreads, __glDispatchInit, loading each vendor and calling its
+ * __glx_Main, the x11glvnd round trips, and CreateGLAPITable.
+ *
+ * It also reports the number of dynamic relocations in each of the libglvnd
+ * and vendor libraries, and how many of them need a symbol lookup.
+ *
+ * The library to load defaults to libGL.so.0, which is the soname that the
+ * build gives libGL. If -d is given, the test fails unless the library that
+ * actually got loaded is under that directory, so that it can't silently
+ * measure an installed libGL instead of the one that was just built.
+ */
+
+typedef struct TestOptionsRec {
+    const char *library;
+    const char *buildDir;
+} TestOptions;
+
+typedef XVisualInfo *(*PFNGLXCHOOSEVISUALPROC)(Display *dpy, int screen,
+                                               int *attrib_list);
+typedef GLXContext (*PFNGLXCREATECONTEXTPROC)(Display *dpy, XVisualInfo *vis,
+                                             GLXContext share_list,
+                                             Bool direct);
+typedef Bool (*PFNGLXMAKECURRENTPROC)(Display *dpy, GLXDrawable drawable,
+                                     GLXContext ctx);
+typedef void (*PFNGLXDESTROYCONTEXTPROC)(Display *dpy, GLXContext ctx);
+
+#if __SIZEOF_POINTER__ == 8
+#define RELOC_SYM(info) ELF64_R_SYM(info)
+#else
+#define RELOC_SYM(info) ELF32_R_SYM(info)
+#endif
+
+static void print_help(void)
+{
+    const char *help_string =
+        "Options: \n"
+        " -h, --help               Print this help message.\n"
+        " -l<name>, --library=<name>\n"
+        "                          Load libGL with this name or path.\n"
+        "                          The default is libGL.so.0.\n"
+        " -d<dir>, --builddir=<dir>\n"
+        "                          Fail unless the loaded libGL is under\n"
+        "                          this directory.\n";
+    printf("%s", help_string);
+}
+
+static void init_options(int argc, char **argv, TestOptions *t)
+{
+    int c;
+
+    static struct option long_options[] = {
+        { "help", no_argument, NULL, 'h'},
+        { "library", required_argument, NULL, 'l'},
+        { "builddir", required_argument, NULL, 'd'},
+        { NULL, no_argument, NULL, 0 }
+    };
+
+    // Initialize defaults
+    t->library = "libGL.so.0";
+    t->buildDir = NULL;
+
+    do {
+        c = getopt_long(argc, argv, "hl:d:", long_options, NULL);
+        switch (c) {
+        case -1:
+        default:
+            break;
+        case 'h':
+            print_help();
+            exit(0);
+            break;
+        case 'l':
+            t->library = optarg;
+            break;
+        case 'd':
+            t->buildDir = optarg;
+            break;
+        }
+    } while (c != -1);
+}
+
+/*
+ * Checks that the library behind handle was loaded from somewhere under dir.
+ */
+static int IsLoadedFromDir(void *handle, const char *dir)
+{
+    struct link_map *map = NULL;
+    char realDir[PATH_MAX];
+    char realLib[PATH_MAX];
+    size_t len;
+
+    if (dlinfo(handle, RTLD_DI_LINKMAP, &map) != 0 || !map) {
+        printError("dlinfo failed: %s\n", dlerror());
+        return 0;
+    }
+    if (!realpath(dir, realDir) || !realpath(map->l_name, realLib)) {
+        printError("Failed to resolve the path of %s\n", map->l_name);
+        return 0;
+    }
+
+    len = strlen(realDir);
+    if (strncmp(realLib, realDir, len) != 0 ||
+        (realLib[len] != '/' && realDir[len - 1] != '/')) {
+        printError("Loaded %s, which isn't under %s\n", realLib, realDir);
+        return 0;
+    }
+    return 1;
+}
+
+static uint64_t GetTime(void)
+{
+    struct timespec ts;
+
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+
+    return ((uint64_t)ts.tv_sec * 1000000000ULL) + (uint64_t)ts.tv_nsec;
+}
+
+static void PrintPhase(const char *phase, uint64_t time)
+{
+    printf("phase=%s ns=%llu\n", phase, (unsigned long long)time);
+}
+
+typedef struct RelocCountsRec {
+    // Relocations which don't refer to a symbol, such as R_X86_64_RELATIVE
+    unsigned long relative;
+
+    // Relocations which are resolved at load time with a symbol lookup
+    unsigned long symbolic;
+
+    // PLT relocations, which are looked up lazily on the first call unless
+    // the library is bound with BIND_NOW
+    unsigned long plt;
+
+    // The number of distinct symbols that the relocations refer to
+    unsigned long symbols;
+} RelocCounts;
+
+/*
+ * Counts the relocations in a REL or RELA table, and marks the symbols they
+ * use in usedSymbols.
+ */
+static void CountRelocTable(const char *table, size_t size, size_t entSize,
+                            unsigned long *relative, unsigned long *symbolic,
+                            unsigned char **usedSymbols, size_t *numSymbols)
+{
+    const ElfW(Rel) *rel;
+    unsigned char *used;
+    size_t sym;
+    size_t i;
+
+    if (!table || !entSize) {
+        return;
+    }
+
+    // r_offset and r_info are the same for REL and RELA entries.
+    for (i = 0; i + entSize <= size; i += entSize) {
+        rel = (const ElfW(Rel) *)(table + i);
+        sym = RELOC_SYM(rel->r_info);
+        if (sym == 0) {
+            (*relative)++;
+            continue;
+        }
+        (*symbolic)++;
+
+        if (sym >= *numSymbols) {
+            used = realloc(*usedSymbols, sym + 1);
+            if (!used) {
+                continue;
+            }
+            memset(used + *numSymbols, 0, sym + 1 - *numSymbols);
+            *usedSymbols = used;
+            *numSymbols = sym + 1;
+        }
+        (*usedSymbols)[sym] = 1;
+    }
+}
+
+static int IsGLLibrary(const char *name)
+{
+    return !strncmp(name, "libGL", 5) || !strncmp(name, "libOpenGL", 9);
+}
+
+static int PrintLibraryRelocs(struct dl_phdr_info *info, size_t size,
+                              void *data)
+{
+    const char *name = strrchr(info->dlpi_name, '/');
+    const ElfW(Dyn) *dyn = NULL;
+    const char *rela = NULL, *rel = NULL, *jmprel = NULL;
+    size_t relaSize = 0, relaEnt = sizeof(ElfW(Rela));
+    size_t relSize = 0, relEnt = sizeof(ElfW(Rel));
+    size_t jmprelSize = 0, jmprelEnt = sizeof(ElfW(Rela));
+    unsigned char *usedSymbols = NULL;
+    size_t numSymbols = 0;
+    RelocCounts counts;
+    unsigned long plt = 0;
+    size_t i;
+    int bindNow = 0;
+
+    name = name ? name + 1 : info->dlpi_name;
+    if (!IsGLLibrary(name)) {
+        return 0;
+    }
+
+    for (i = 0; i < info->dlpi_phnum; i++) {
+        if (info->dlpi_phdr[i].p_type == PT_DYNAMIC) {
+            dyn = (const ElfW(Dyn) *)
+                (info->dlpi_addr + info->dlpi_phdr[i].p_vaddr);
+            break;
+        }
+    }
+    if (!dyn) {
+        return 0;
+    }
+
+    /*
+     * The dynamic loader relocates the address entries in place on most
+     * architectures, but not all of them, so only add the load address if
+     * it hasn't already been added.
+     */
+#define DYN_ADDR(d) ((const char *)((d)->d_un.d_ptr < info->dlpi_addr ? \
+        info->dlpi_addr + (d)->d_un.d_ptr : (d)->d_un.d_ptr))
+
+    for (; dyn->d_tag != DT_NULL; dyn++) {
+        switch (dyn->d_tag) {
+        case DT_RELA: rela = DYN_ADDR(dyn); break;
+        case DT_RELASZ: relaSize = dyn->d_un.d_val; break;
+        case DT_RELAENT: relaEnt = dyn->d_un.d_val; break;
+        case DT_REL: rel = DYN_ADDR(dyn); break;
+        case DT_RELSZ: relSize = dyn->d_un.d_val; break;
+        case DT_RELENT: relEnt = dyn->d_un.d_val; break;
+        case DT_JMPREL: jmprel = DYN_ADDR(dyn); break;
+        case DT_PLTRELSZ: jmprelSize = dyn->d_un.d_val; break;
+        case DT_PLTREL:
+            jmprelEnt = (dyn->d_un.d_val == DT_REL) ?
+                sizeof(ElfW(Rel)) : sizeof(ElfW(Rela));
+            break;
+        case DT_BIND_NOW:
+            bindNow = 1;
+            break;
+        case DT_FLAGS:
+            if (dyn->d_un.d_val & DF_BIND_NOW) {
+                bindNow = 1;
+            }
+            break;
+        case DT_FLAGS_1:
+            if (dyn->d_un.d_val & DF_1_NOW) {
+                bindNow = 1;
+            }
+            break;
+        }
+    }
+#undef DYN_ADDR
+
+    memset(&counts, 0, sizeof(counts));
+    CountRelocTable(rela, relaSize, relaEnt, &counts.relative,
+                    &counts.symbolic, &usedSymbols, &numSymbols);
+    CountRelocTable(rel, relSize, relEnt, &counts.relative,
+                    &counts.symbolic, &usedSymbols, &numSymbols);
+    CountRelocTable(jmprel, jmprelSize, jmprelEnt, &counts.relative,
+                    &plt, &usedSymbols, &numSymbols);
+    counts.plt = plt;
+    for (i = 0; i < numSymbols; i++) {
+        counts.symbols += usedSymbols[i];
+    }
+    free(usedSymbols);
+
+    printf("library=%s relocs=%lu relative=%lu symbolic=%lu plt=%lu "
+           "symbols=%lu bind_now=%d\n", name,
+           counts.relative + counts.symbolic + counts.plt,
+           counts.relative, counts.symbolic, counts.plt, counts.symbols,
+           bindNow);
+
+    return 0;
+}
+
+int main(int argc, char **argv)
+{
+    int visattr[] = {
+        GLX_RGBA,
+        GLX_RED_SIZE, 1,
+        GLX_GREEN_SIZE, 1,
+        GLX_BLUE_SIZE, 1,
+        GLX_DOUBLEBUFFER,
+        None,
+    };
+    TestOptions t;
+    PFNGLXCHOOSEVISUALPROC pChooseVisual;
+    PFNGLXCREATECONTEXTPROC pCreateContext;
+    PFNGLXMAKECURRENTPROC pMakeCurrent;
+    PFNGLXDESTROYCONTEXTPROC pDestroyContext;
+    XSetWindowAttributes wattr;
+    XVisualInfo *visinfo;
+    GLXContext ctx;
+    Display *dpy;
+    Window root, win;
+    void *handle;
+    uint64_t start, phaseStart, total, xTime = 0, checkTime = 0;
+
+    init_options(argc, argv, &t);
+
+    // Open the display first, since that's not part of libglvnd's startup.
+    dpy = XOpenDisplay(NULL);
+    if (!dpy) {
+        printError("No display! Please re-test with a running X server\n"
+                   "and the DISPLAY environment variable set appropriately.\n");
+        return 1;
+    }
+
+    start = phaseStart = GetTime();
+    handle = dlopen(t.library, RTLD_LAZY);
+    if (!handle) {
+        printError("Failed to load %s: %s\n", t.library, dlerror());
+        return 1;
+    }
+    PrintPhase("dlopen", GetTime() - phaseStart);
+
+    // Checking where libGL came from isn't part of the startup cost.
+    phaseStart = GetTime();
+    if (t.buildDir && !IsLoadedFromDir(handle, t.buildDir)) {
+        return 1;
+    }
+    checkTime = GetTime() - phaseStart;
+
+    phaseStart = GetTime();
+    pChooseVisual = (PFNGLXCHOOSEVISUALPROC)dlsym(handle, "glXChooseVisual");
+    pCreateContext = (PFNGLXCREATECONTEXTPROC)
+        dlsym(handle, "glXCreateContext");
+    pMakeCurrent = (PFNGLXMAKECURRENTPROC)dlsym(handle, "glXMakeCurrent");
+    pDestroyContext = (PFNGLXDESTROYCONTEXTPROC)
+        dlsym(handle, "glXDestroyContext");
+    if (!pChooseVisual || !pCreateContext || !pMakeCurrent ||
+        !pDestroyContext) {
+        printError("Failed to look up the GLX functions!\n");
+        return 1;
+    }
+    PrintPhase("dlsym", GetTime() - phaseStart);
+
+    // The first GLX call on a screen looks up and loads its vendor.
+    phaseStart = GetTime();
+    visinfo = pChooseVisual(dpy, DefaultScreen(dpy), visattr);
+    if (!visinfo) {
+        printError("Failed to find a suitable visual!\n");
+        return 1;
+    }
+    PrintPhase("glXChooseVisual", GetTime() - phaseStart);
+
+    // Creating the window is the application's cost, not ours.
+    phaseStart = GetTime();
+    root = RootWindow(dpy, DefaultScreen(dpy));
+    wattr.background_pixmap = None;
+    wattr.border_pixel = 0;
+    wattr.colormap = XCreateColormap(dpy, root, visinfo->visual, AllocNone);
+    win = XCreateWindow(dpy, root, 0, 0, 64, 64, 0, visinfo->depth,
+                        InputOutput, visinfo->visual,
+                        CWBackPixmap | CWBorderPixel | CWColormap, &wattr);
+    XSync(dpy, False);
+    xTime = GetTime() - phaseStart;
+
+    phaseStart = GetTime();
+    ctx = pCreateContext(dpy, visinfo, NULL, True);
+    if (!ctx) {
+        printError("Failed to create a context!\n");
+        return 1;
+    }
+    PrintPhase("glXCreateContext", GetTime() - phaseStart);
+
+    // The first make current builds the vendor's GL dispatch table.
+    phaseStart = GetTime();
+    if (!pMakeCurrent(dpy, win, ctx)) {
+        printError("Failed to make current!\n");
+        return 1;
+    }
+    PrintPhase("glXMakeCurrent", GetTime() - phaseStart);
+
+    total = GetTime() - start - xTime - checkTime;
+    PrintPhase("total", total);
+
+    dl_iterate_phdr(PrintLibraryRelocs, NULL);
+
+    pMakeCurrent(dpy, None, NULL);
+    pDestroyContext(dpy, ctx);
+    XDestroyWindow(dpy, win);
+    XFreeColormap(dpy, wattr.colormap);
+    XFree(visinfo);
+    XCloseDisplay(dpy);
+
+    return 0;
+}
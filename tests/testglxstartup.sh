@@ -0,0 +1,23 @@
+#!/bin/bash
+
+export __GLX_VENDOR_LIBRARY_NAME=dummy
+export LD_LIBRARY_PATH=$LD_LIBRARY_PATH:$TOP_BUILDDIR/tests/GLX_dummy/.libs
+
+# The test loads libGL with dlopen, so it needs to find the uninstalled
+# libraries itself.
+export LD_LIBRARY_PATH=$LD_LIBRARY_PATH:$TOP_BUILDDIR/src/GL/.libs:$TOP_BUILDDIR/src/GLX/.libs:$TOP_BUILDDIR/src/GLdispatch/.libs
+
+# We require pthreads be loaded before libGLX for correctness
+export LD_PRELOAD="${LD_PRELOAD:+$LD_PRELOAD }libpthread.so.0 $FAKE_X_PRELOAD"
+
+# Time each step from loading libGL to the first make current, with libGLX's
+# own breakdown of its startup work.
+export __GLX_STARTUP_STATS=1
+./testglxstartup -d "$TOP_BUILDDIR" || exit 1
+
+# Cold starts vary a lot from run to run, so take a few more samples of just
+# the totals.
+unset __GLX_STARTUP_STATS
+for i in 1 2 3 4 5; do
+    ./testglxstartup -d "$TOP_BUILDDIR" | grep "phase=total" || exit 1
+done
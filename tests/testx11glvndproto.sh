@@ -1,6 +1,8 @@
 #!/bin/bash
 
-if [ -n "$SKIP_ENV_INIT" ]; then
+export LD_PRELOAD="${LD_PRELOAD:+$LD_PRELOAD }$FAKE_X_PRELOAD"
+
+if [ -n "$SKIP_ENV_INIT" ] && [ -z "$FAKE_X_PRELOAD" ]; then
     echo "Skipping test; requires environment init"
     exit 77
 fi